@@ -0,0 +1,596 @@
+#include "perlin.h"
+#include "terrain.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/// <summary>
+/// Noise table layout used before NoiseTable2D: separate p, g1, g2 and g3 arrays stored
+/// by value in every noise object, kept here as the baseline for layout comparisons
+/// </summary>
+struct LegacyPerlin
+{
+	static const int B = SAMPLE_SIZE;
+	static const int BM = SAMPLE_SIZE - 1;
+	static const int N = 0x1000;
+
+	int octaves;
+	float frequency;
+	float amplitude;
+
+	int p[B + B + 2];
+	float g3[B + B + 2][3];
+	float g2[B + B + 2][2];
+	float g1[B + B + 2];
+
+	LegacyPerlin(int octaves, float freq, float amp, int seed)
+		: octaves(octaves), frequency(freq), amplitude(amp)
+	{
+		int i, j, k;
+		std::mt19937 random((uint32_t)seed);
+
+		for (i = 0; i < B; i++)
+		{
+			p[i] = i;
+			g1[i] = (float)((int)(random() % (B + B)) - B) / B;
+			for (j = 0; j < 2; j++)
+				g2[i][j] = (float)((int)(random() % (B + B)) - B) / B;
+			float s = 1.0f / (float)sqrt(g2[i][0] * g2[i][0] + g2[i][1] * g2[i][1]);
+			g2[i][0] = g2[i][0] * s;
+			g2[i][1] = g2[i][1] * s;
+			for (j = 0; j < 3; j++)
+				g3[i][j] = (float)((int)(random() % (B + B)) - B) / B;
+		}
+
+		while (--i)
+		{
+			k = p[i];
+			p[i] = p[j = random() % B];
+			p[j] = k;
+		}
+
+		for (i = 0; i < B + 2; i++)
+		{
+			p[B + i] = p[i];
+			g1[B + i] = g1[i];
+			for (j = 0; j < 2; j++)
+				g2[B + i][j] = g2[i][j];
+			for (j = 0; j < 3; j++)
+				g3[B + i][j] = g3[i][j];
+		}
+	}
+
+	float noise2(const float vec[2]) const
+	{
+		float tx = vec[0] + N;
+		int bx0 = ((int)tx) & BM;
+		int bx1 = (bx0 + 1) & BM;
+		float rx0 = tx - (int)tx;
+		float rx1 = rx0 - 1.0f;
+
+		float ty = vec[1] + N;
+		int by0 = ((int)ty) & BM;
+		int by1 = (by0 + 1) & BM;
+		float ry0 = ty - (int)ty;
+		float ry1 = ry0 - 1.0f;
+
+		int i = p[bx0];
+		int j = p[bx1];
+
+		const float* q00 = g2[p[i + by0]];
+		const float* q10 = g2[p[j + by0]];
+		const float* q01 = g2[p[i + by1]];
+		const float* q11 = g2[p[j + by1]];
+
+		float sx = rx0 * rx0 * (3.0f - 2.0f * rx0);
+		float sy = ry0 * ry0 * (3.0f - 2.0f * ry0);
+
+		float u = rx0 * q00[0] + ry0 * q00[1];
+		float v = rx1 * q10[0] + ry0 * q10[1];
+		float a = u + sx * (v - u);
+
+		u = rx0 * q01[0] + ry1 * q01[1];
+		v = rx1 * q11[0] + ry1 * q11[1];
+		float b = u + sx * (v - u);
+
+		return a + sy * (b - a);
+	}
+
+	float Get(float x, float y) const
+	{
+		float vec[2] = { x * frequency, y * frequency };
+		float result = 0.0f;
+		float amp = amplitude;
+		for (int i = 0; i < octaves; i++)
+		{
+			result += noise2(vec) * amp;
+			vec[0] *= 2.0f;
+			vec[1] *= 2.0f;
+			amp *= 0.5f;
+		}
+		return result;
+	}
+};
+
+/// <summary>
+/// Same evaluation code as LegacyPerlin reading the shared NoiseTable2D instead, so the
+/// comparison between the two isolates the effect of the table layout
+/// </summary>
+struct PackedPerlin
+{
+	static const int BM = SAMPLE_SIZE - 1;
+	static const int N = 0x1000;
+
+	int octaves;
+	float frequency;
+	float amplitude;
+
+	std::shared_ptr<const NoiseTable2D> table;
+
+	PackedPerlin(int octaves, float freq, float amp, int seed)
+		: octaves(octaves), frequency(freq), amplitude(amp), table(NoiseTable2D::get(seed))
+	{
+	}
+
+	float noise2(const float vec[2]) const
+	{
+		const NoiseEntry2D* e = table->entries;
+
+		float tx = vec[0] + N;
+		int bx0 = ((int)tx) & BM;
+		int bx1 = (bx0 + 1) & BM;
+		float rx0 = tx - (int)tx;
+		float rx1 = rx0 - 1.0f;
+
+		float ty = vec[1] + N;
+		int by0 = ((int)ty) & BM;
+		int by1 = (by0 + 1) & BM;
+		float ry0 = ty - (int)ty;
+		float ry1 = ry0 - 1.0f;
+
+		int i = e[bx0].perm;
+		int j = e[bx1].perm;
+
+		const NoiseEntry2D& q00 = e[i + by0];
+		const NoiseEntry2D& q10 = e[j + by0];
+		const NoiseEntry2D& q01 = e[i + by1];
+		const NoiseEntry2D& q11 = e[j + by1];
+
+		float sx = rx0 * rx0 * (3.0f - 2.0f * rx0);
+		float sy = ry0 * ry0 * (3.0f - 2.0f * ry0);
+
+		float u = rx0 * q00.gx + ry0 * q00.gy;
+		float v = rx1 * q10.gx + ry0 * q10.gy;
+		float a = u + sx * (v - u);
+
+		u = rx0 * q01.gx + ry1 * q01.gy;
+		v = rx1 * q11.gx + ry1 * q11.gy;
+		float b = u + sx * (v - u);
+
+		return a + sy * (b - a);
+	}
+
+	float Get(float x, float y) const
+	{
+		float vec[2] = { x * frequency, y * frequency };
+		float result = 0.0f;
+		float amp = amplitude;
+		for (int i = 0; i < octaves; i++)
+		{
+			result += noise2(vec) * amp;
+			vec[0] *= 2.0f;
+			vec[1] *= 2.0f;
+			amp *= 0.5f;
+		}
+		return result;
+	}
+};
+
+/// L1 data cache read miss counter, only available on Linux through perf events
+class CacheMissCounter
+{
+protected:
+	int fd;
+
+public:
+	CacheMissCounter()
+		: fd(-1)
+	{
+#ifdef __linux__
+		perf_event_attr attr = {};
+		attr.type = PERF_TYPE_HW_CACHE;
+		attr.size = sizeof(attr);
+		attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+	}
+
+	~CacheMissCounter()
+	{
+#ifdef __linux__
+		if (fd >= 0)
+			close(fd);
+#endif
+	}
+
+	bool available() const
+	{
+		return fd >= 0;
+	}
+
+	void start()
+	{
+#ifdef __linux__
+		if (fd >= 0)
+		{
+			ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	long long stop()
+	{
+		long long count = -1;
+#ifdef __linux__
+		if (fd >= 0)
+		{
+			ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+			if (read(fd, &count, sizeof(count)) != sizeof(count))
+				count = -1;
+		}
+#endif
+		return count;
+	}
+};
+
+/// Result of one benchmark run
+struct Measurement
+{
+	double nsPerSample;
+	double missesPerSample;
+	float checksum;
+};
+
+/// <summary>
+/// Run the terrain vertex loop of TerrainMesh::generate over a grid, sampling every noise
+/// object in turn at each vertex (several noise layers per vertex)
+/// </summary>
+template <typename Noise>
+Measurement terrainLoop(const std::vector<const Noise*>& layers, unsigned int width, unsigned int length, int repeats)
+{
+	CacheMissCounter counter;
+	float checksum = 0.0f;
+
+	auto begin = std::chrono::steady_clock::now();
+	counter.start();
+	for (int r = 0; r < repeats; ++r)
+	{
+		for (unsigned int i = 0; i < length; ++i)
+		{
+			for (unsigned int j = 0; j < width; ++j)
+			{
+				float x = -(width / 2.0f) + j;
+				float z = -(length / 2.0f) + i;
+				for (const Noise* layer : layers)
+					checksum += layer->Get(x, z);
+			}
+		}
+	}
+	long long misses = counter.stop();
+	auto end = std::chrono::steady_clock::now();
+
+	double samples = double(width) * length * layers.size() * repeats;
+	Measurement m;
+	m.nsPerSample = std::chrono::duration<double, std::nano>(end - begin).count() / samples;
+	m.missesPerSample = misses >= 0 ? misses / samples : -1.0;
+	m.checksum = checksum;
+	return m;
+}
+
+/// Names of the noise backends as printed in the CSV
+const char* backendName(NoiseBackend backend)
+{
+	switch (backend)
+	{
+	case NOISE_BACKEND_OPENSIMPLEX2:
+		return "opensimplex2";
+	case NOISE_BACKEND_VALUE:
+		return "value";
+	default:
+		return "perlin";
+	}
+}
+
+/// <summary>
+/// Time Get, GetBatch (one call per grid row), GetWithGradient and GetBatchWithGradient over the terrain grid
+/// </summary>
+/// <returns>ns per sample of each of the four entry points</returns>
+std::vector<double> backendLoop(const Perlin& noise, unsigned int width, unsigned int length, int repeats)
+{
+	std::vector<float> xs(width), zs(width), ys(width), dxs(width), dzs(width);
+	std::vector<double> result;
+	double samples = double(width) * length * repeats;
+	float checksum = 0.0f;
+
+	for (int mode = 0; mode < 4; ++mode)
+	{
+		auto begin = std::chrono::steady_clock::now();
+		for (int r = 0; r < repeats; ++r)
+		{
+			for (unsigned int i = 0; i < length; ++i)
+			{
+				for (unsigned int j = 0; j < width; ++j)
+				{
+					xs[j] = -(width / 2.0f) + j;
+					zs[j] = -(length / 2.0f) + i;
+				}
+
+				if (mode == 0)
+				{
+					for (unsigned int j = 0; j < width; ++j)
+						ys[j] = noise.Get(xs[j], zs[j]);
+				}
+				else if (mode == 1)
+				{
+					noise.GetBatch(xs.data(), zs.data(), ys.data(), width);
+				}
+				else if (mode == 2)
+				{
+					float dx, dz;
+					for (unsigned int j = 0; j < width; ++j)
+						ys[j] = noise.GetWithGradient(xs[j], zs[j], &dx, &dz);
+				}
+				else
+				{
+					noise.GetBatchWithGradient(xs.data(), zs.data(), ys.data(), dxs.data(), dzs.data(), width);
+				}
+				checksum += ys[width / 2];
+			}
+		}
+		auto end = std::chrono::steady_clock::now();
+		result.push_back(std::chrono::duration<double, std::nano>(end - begin).count() / samples);
+	}
+
+	if (checksum != checksum)
+		std::cerr << "WARNING: backend produced NaN" << std::endl;
+	return result;
+}
+
+/// Time per sample in ns projected to the time per square grid in ms
+double msPerGrid(double nsPerSample, unsigned int size)
+{
+	return nsPerSample * size * size / 1e6;
+}
+
+/// Print one row of the noise and terrain sweeps
+void printSweepRow(const char* stage, int octaves, float frequency, unsigned int grid, unsigned int threads, double nsPerSample)
+{
+	std::cout << stage << "," << octaves << "," << frequency << "," << grid << "," << threads << ","
+		<< nsPerSample << "," << 1e9 / nsPerSample << ","
+		<< msPerGrid(nsPerSample, 500) << "," << msPerGrid(nsPerSample, 4096) << std::endl;
+}
+
+/// <summary>
+/// Time Perlin::Get over a square grid split into row tiles on the pool, a single octave with unit amplitude measures the bare noise2 basis
+/// </summary>
+double noiseLoop(const Perlin& noise, unsigned int size, ThreadPool& pool, int repeats)
+{
+	// Every row sums into its own slot so the tiles share no counter
+	std::vector<float> rowSums(size, 0.0f);
+	auto begin = std::chrono::steady_clock::now();
+	for (int r = 0; r < repeats; ++r)
+	{
+		pool.parallelFor(0, size, TerrainGrid::TILE_ROWS, [&](unsigned int first, unsigned int last)
+		{
+			for (unsigned int i = first; i < last; ++i)
+			{
+				float sum = 0.0f;
+				for (unsigned int j = 0; j < size; ++j)
+				{
+					sum += noise.Get(-(size / 2.0f) + j, -(size / 2.0f) + i);
+				}
+				rowSums[i] += sum;
+			}
+		});
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	float checksum = 0.0f;
+	for (float sum : rowSums)
+		checksum += sum;
+	if (checksum != checksum)
+		std::cerr << "WARNING: noise produced NaN" << std::endl;
+	return std::chrono::duration<double, std::nano>(end - begin).count() / (double(size) * size * repeats);
+}
+
+/// <summary>
+/// Time the CPU stages of TerrainMesh::generate on a square grid, including allocation of the arrays
+/// </summary>
+/// <param name="vertexData">Generate vertex data too, otherwise only the strip indices</param>
+double terrainGridLoop(const Perlin& noise, unsigned int size, ThreadPool& pool, bool vertexData, int repeats)
+{
+	double ns = 0.0;
+	for (int r = 0; r < repeats; ++r)
+	{
+		TerrainGrid grid(size, size, noise, true, true);
+		auto begin = std::chrono::steady_clock::now();
+		grid.generate(pool, vertexData);
+		auto end = std::chrono::steady_clock::now();
+		ns += std::chrono::duration<double, std::nano>(end - begin).count();
+	}
+	return ns / (double(size) * size * repeats);
+}
+
+/// Repeats of a sweep configuration, keeps roughly the same amount of work for every grid size
+int sweepRepeats(unsigned int size)
+{
+	return std::max(1, int(4096u * 4096u / (size * size)) / 4);
+}
+
+/// Thread counts of the noise and terrain sweeps, powers of two up to the hardware concurrency and the concurrency itself
+std::vector<unsigned int> threadCounts()
+{
+	unsigned int hardware = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<unsigned int> counts;
+	for (unsigned int t = 1; t < hardware; t *= 2)
+		counts.push_back(t);
+	counts.push_back(hardware);
+	return counts;
+}
+
+void printRow(const std::string& layout, size_t layers, size_t tableBytes, const Measurement& m)
+{
+	std::cout << layout << "," << layers << "," << tableBytes << ","
+		<< m.nsPerSample << "," << 1e9 / m.nsPerSample << ",";
+	if (m.missesPerSample >= 0.0)
+		std::cout << m.missesPerSample;
+	else
+		std::cout << "n/a";
+	std::cout << "," << m.checksum << std::endl;
+}
+
+/// Sections run when no section is named on the command line
+const char* SECTIONS[] = { "layout", "backend", "noise", "terrain" };
+
+/// Whether a section was requested on the command line, no arguments run every section
+bool sectionEnabled(int argc, char** argv, const char* name)
+{
+	if (argc < 2)
+		return true;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], name) == 0)
+			return true;
+	}
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	const unsigned int width = 500;
+	const unsigned int length = 500;
+	const int repeats = 4;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::find_if(std::begin(SECTIONS), std::end(SECTIONS), [&](const char* s) { return strcmp(s, argv[i]) == 0; }) == std::end(SECTIONS))
+		{
+			std::cerr << "usage: benchmark [layout] [backend] [noise] [terrain]" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (sectionEnabled(argc, argv, "layout"))
+	{
+		std::cout << "layout,layers,table_bytes,ns_per_sample,samples_per_s,l1d_misses_per_sample,checksum" << std::endl;
+
+		// Up to 16 layers both layouts stay in cache, the larger counts show where the smaller packed tables pay off
+		for (size_t layerCount : { 1, 4, 16, 64, 256 })
+		{
+			std::vector<LegacyPerlin*> legacy;
+			std::vector<PackedPerlin*> packed;
+			std::vector<Perlin*> perlin;
+			for (size_t l = 0; l < layerCount; ++l)
+			{
+				legacy.push_back(new LegacyPerlin(2, 0.012f, 20.0f, int(1000 + l)));
+				packed.push_back(new PackedPerlin(2, 0.012f, 20.0f, int(1000 + l)));
+				perlin.push_back(new Perlin(2, 0.012f, 20.0f, int(1000 + l)));
+			}
+
+			Measurement legacyResult = terrainLoop(std::vector<const LegacyPerlin*>(legacy.begin(), legacy.end()), width, length, repeats);
+			Measurement packedResult = terrainLoop(std::vector<const PackedPerlin*>(packed.begin(), packed.end()), width, length, repeats);
+			Measurement perlinResult = terrainLoop(std::vector<const Perlin*>(perlin.begin(), perlin.end()), width, length, repeats);
+
+			printRow("legacy", layerCount, layerCount * sizeof(LegacyPerlin), legacyResult);
+			printRow("packed", layerCount, layerCount * sizeof(NoiseTable2D), packedResult);
+			printRow("perlin", layerCount, layerCount * sizeof(NoiseTable2D), perlinResult);
+
+			if (legacyResult.checksum != packedResult.checksum || legacyResult.checksum != perlinResult.checksum)
+				std::cerr << "WARNING: layouts disagree" << std::endl;
+
+			for (auto n : legacy)
+				delete n;
+			for (auto n : packed)
+				delete n;
+			for (auto n : perlin)
+				delete n;
+		}
+		std::cout << std::endl;
+	}
+
+	if (sectionEnabled(argc, argv, "backend"))
+	{
+		std::cout << "backend,get_ns_per_sample,batch_ns_per_sample,gradient_ns_per_sample,batch_gradient_ns_per_sample,batch_samples_per_s" << std::endl;
+
+		for (NoiseBackend backend : { NOISE_BACKEND_PERLIN, NOISE_BACKEND_OPENSIMPLEX2, NOISE_BACKEND_VALUE })
+		{
+			Perlin noise(2, 0.012f, 20.0f, 1000, backend);
+			std::vector<double> ns = backendLoop(noise, width, length, repeats);
+			std::cout << backendName(backend) << "," << ns[0] << "," << ns[1] << "," << ns[2] << "," << ns[3] << "," << 1e9 / ns[1] << std::endl;
+		}
+		std::cout << std::endl;
+	}
+
+	const char* sweepHeader = "stage,octaves,frequency,grid,threads,ns_per_sample,samples_per_s,ms_per_500x500,ms_per_4096x4096";
+	const unsigned int sweepSizes[] = { 500u, 1024u, 4096u };
+
+	if (sectionEnabled(argc, argv, "noise"))
+	{
+		std::cout << sweepHeader << std::endl;
+		for (unsigned int size : sweepSizes)
+		{
+			int gridRepeats = sweepRepeats(size);
+			for (unsigned int threads : threadCounts())
+			{
+				ThreadPool pool(threads - 1);
+				for (float frequency : { 0.012f, 0.05f, 0.2f })
+				{
+					printSweepRow("noise2", 1, frequency, size, threads, noiseLoop(Perlin(1, frequency, 1.0f, 1000), size, pool, gridRepeats));
+					for (int octaves : { 1, 2, 4, 8 })
+					{
+						printSweepRow("get", octaves, frequency, size, threads, noiseLoop(Perlin(octaves, frequency, 20.0f, 1000), size, pool, gridRepeats));
+					}
+				}
+			}
+		}
+		std::cout << std::endl;
+	}
+
+	if (sectionEnabled(argc, argv, "terrain"))
+	{
+		std::cout << sweepHeader << std::endl;
+		for (unsigned int size : sweepSizes)
+		{
+			int gridRepeats = sweepRepeats(size);
+			for (unsigned int threads : threadCounts())
+			{
+				ThreadPool pool(threads - 1);
+				for (int octaves : { 2, 8 })
+				{
+					Perlin noise(octaves, 0.012f, 20.0f, 1000);
+					printSweepRow("generate", octaves, 0.012f, size, threads, terrainGridLoop(noise, size, pool, true, gridRepeats));
+				}
+				Perlin noise(2, 0.012f, 20.0f, 1000);
+				printSweepRow("strips", 0, 0.012f, size, threads, terrainGridLoop(noise, size, pool, false, gridRepeats));
+			}
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
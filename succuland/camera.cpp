@@ -6,39 +6,42 @@ int Camera::refreshRate = 120;
 Camera * Camera::active = nullptr;
 
 Camera::Camera(void) 
-	: position(glm::vec3(0.0f)), direction(glm::vec3(0.0f)), up(glm::vec3(0.0f)),
+	: position(glm::dvec3(0.0)), direction(glm::vec3(0.0f)), up(glm::vec3(0.0f)),
 	yaw(0.0f), pitch(0.0f), sensitivity(0.0f), speed(0.0f), freeMode(false),
 	angle(0.0f), nearPlane(0.0f), farPlane(0.0f),
 	elevation(0.0f), radius(0.0f), circling(false),
-	lastActive(nullptr) 
+	lastActive(nullptr), groundTree(nullptr) 
 {
 }
 
-Camera::Camera(glm::vec3 position, glm::vec3 direction, float nearPlane, float farPlane, float captureAngle)
+Camera::Camera(glm::dvec3 position, glm::vec3 direction, float nearPlane, float farPlane, float captureAngle)
 	: position(position), direction(direction), up(glm::vec3(0.0f, 1.0f, 0.0f)),
 	yaw(0.0f), pitch(0.0f), sensitivity(1.5f), speed(0.0f), freeMode(false),
 	angle(glm::radians(captureAngle)), nearPlane(nearPlane), farPlane(farPlane),
 	elevation(0.0f), radius(0.0f), circling(false),
-	lastActive(nullptr), locked(true)
+	lastActive(nullptr), locked(true), groundTree(nullptr)
 {
 }
-Camera::Camera(glm::vec3 position, glm::vec3 direction, float nearPlane, float farPlane, float captureAngle, float movementSpeed, float width, float length, float up, const Perlin* down)
+Camera::Camera(glm::dvec3 position, glm::vec3 direction, float nearPlane, float farPlane, float captureAngle, float movementSpeed, float width, float length, float up, const HeightQuery* down)
 	: position(position), direction(direction), up(glm::vec3(0.0f, 1.0f, 0.0f)),
 	yaw(0.0f), pitch(0.0f), sensitivity(1.5f), speed(movementSpeed), freeMode(false),
 	angle(glm::radians(captureAngle)), nearPlane(nearPlane), farPlane(farPlane),
 	elevation(0.0f), radius(0.0f), circling(false),
-	lastActive(nullptr), locked(false)
+	lastActive(nullptr), locked(false), groundTree(nullptr)
 {
 	circlingParameters(glm::vec3(0.0f, 0.0f, 0.0f), 20.0f, 40.0f);
 	initBoundaries(width, length, up, down);
 }
 
 
-void Camera::checkBoundariesAndMove(const glm::vec3& newPos)
+void Camera::checkBoundariesAndMove(const glm::dvec3& newPos)
 {
 	bool leftright = (newPos.x < widthBoundary / 2 && newPos.x > -widthBoundary / 2);
 	bool frontback = (newPos.z < lengthBoundary / 2 && newPos.z > -lengthBoundary / 2);
-	bool down = (newPos.y > (*downBoundary)(newPos.x, newPos.z) + 0.1f);
+	bool down = (newPos.y > downBoundary->Get(float(newPos.x), float(newPos.z)) + 0.1f);
+	glm::vec3 stop;
+	if (down && groundTree != nullptr)
+		down = !groundTree->sweep(glm::vec3(position), glm::vec3(newPos), 0.1f, stop);
 	bool up = (newPos.y < upBoundary);
 	if (leftright && frontback && up && down)
 		position = newPos;
@@ -46,7 +49,7 @@ void Camera::checkBoundariesAndMove(const glm::vec3& newPos)
 		Particle::createParticle("textures/cloud.png", position);
 }
 
-void Camera::initBoundaries(float width, float length, float up, const Perlin* down)
+void Camera::initBoundaries(float width, float length, float up, const HeightQuery* down)
 {
 	this->widthBoundary = width;
 	this->lengthBoundary = length;
@@ -54,6 +57,11 @@ void Camera::initBoundaries(float width, float length, float up, const Perlin* d
 	this->downBoundary = down;
 }
 
+void Camera::setGroundTree(const HeightTree* tree)
+{
+	groundTree = tree;
+}
+
 void Camera::makeActive() {
 	if (active != nullptr) 
 	{
@@ -119,7 +127,7 @@ void Camera::moveLeft()
 {
 	if (freeMode && !locked)
 	{
-		glm::vec3 newPos = position - (glm::normalize(glm::cross(direction, up)) * (speed / refreshRate));
+		glm::dvec3 newPos = position - glm::dvec3(glm::normalize(glm::cross(direction, up)) * (speed / refreshRate));
 		checkBoundariesAndMove(newPos);
 	}
 }
@@ -128,7 +136,7 @@ void Camera::moveRight()
 {
 	if (freeMode && !locked)
 	{
-		glm::vec3 newPos = position + (glm::normalize(glm::cross(direction, up)) * (speed / refreshRate));
+		glm::dvec3 newPos = position + glm::dvec3(glm::normalize(glm::cross(direction, up)) * (speed / refreshRate));
 		checkBoundariesAndMove(newPos);
 	}
 }
@@ -137,7 +145,7 @@ void Camera::moveForward()
 {
 	if (freeMode && !locked)
 	{
-		glm::vec3 newPos = position + (glm::normalize(direction) * (speed / refreshRate));
+		glm::dvec3 newPos = position + glm::dvec3(glm::normalize(direction) * (speed / refreshRate));
 		checkBoundariesAndMove(newPos);
 	}
 }
@@ -146,7 +154,7 @@ void Camera::moveBackward()
 {
 	if (freeMode && !locked)
 	{
-		glm::vec3 newPos = position - (glm::normalize(direction) * (speed / refreshRate));
+		glm::dvec3 newPos = position - glm::dvec3(glm::normalize(direction) * (speed / refreshRate));
 		checkBoundariesAndMove(newPos);
 	}
 }
@@ -158,11 +166,11 @@ void Camera::moveBackward()
 void Camera::circleTimerCallback(int)
 {
 	float alpha = float(glutGet(GLUT_ELAPSED_TIME)) * 0.001;
-	active->position = glm::vec3(glm::sin(alpha) * active->radius, active->elevation, glm::cos(alpha) * active->radius) + active->point;
+	active->position = glm::dvec3(glm::vec3(glm::sin(alpha) * active->radius, active->elevation, glm::cos(alpha) * active->radius) + active->point);
 
 	if (!active->freeMode) 
 	{
-		active->direction = glm::normalize(active->point - active->position);
+		active->direction = glm::normalize(glm::vec3(glm::dvec3(active->point) - active->position));
 		active->up = glm::normalize(glm::cross(glm::cross(glm::vec3(0.0f, -1.0f, 0.0f), active->direction), active->direction));
 	}
 
@@ -205,7 +213,7 @@ void Camera::toggleCircling()
 
 void Camera::updateMatrices() 
 {
-	this->view = glm::lookAt(position, position + direction, up);
+	this->view = glm::lookAt(glm::vec3(0.0f), direction, up);
 	this->projection = glm::perspective(angle, float(GLUT_WIDTH) / float(GLUT_HEIGHT), nearPlane, farPlane);
 }
 
@@ -226,4 +234,10 @@ const glm::mat4& Camera::projectMatrix() const
 	 return projection;
 }
 
+Frustum Camera::frustum() const
+{
+	// Built in double precision so the planes of a camera far from the origin stay exact
+	return Frustum(glm::mat4(glm::dmat4(projection) * glm::dmat4(view) * glm::translate(glm::dmat4(1.0), -position)));
+}
+
 
@@ -4,7 +4,9 @@
 #define _CAMERA_H
 
 #include "pgr.h"
-#include "perlin.h"
+#include "heightfield.h"
+#include "heighttree.h"
+#include "frustum.h"
 
 #include <iostream>
 #include <glm/ext.hpp>
@@ -45,7 +47,7 @@ protected:
 	/// Boolean value for whether the camera can use free or spinning mode
 	bool locked;
 
-	// View matrices
+	// View matrices, the view only rotates, the translation is applied in double precision by Shader::setTransformParameters
 	glm::mat4 view;
 	glm::mat4 projection;
 
@@ -53,13 +55,15 @@ protected:
 	float widthBoundary;
 	float lengthBoundary;
 	float upBoundary;
-	const Perlin* downBoundary;
+	const HeightQuery* downBoundary;
+	/// Terrain the moves are swept against, nullptr only checks the new position
+	const HeightTree* groundTree;
 
 	/// <summary>
 	/// Check if the camera can move to new position and if so, move it there
 	/// </summary>
 	/// <param name="newPosition">position to check</param>
-	void checkBoundariesAndMove(const glm::vec3& newPosition);
+	void checkBoundariesAndMove(const glm::dvec3& newPosition);
 
 	/// <summary>
 	/// Initialize boundaries for camera
@@ -67,8 +71,8 @@ protected:
 	/// <param name="width">Width around 0.0</param>
 	/// <param name="length">Height around 0.0</param>
 	/// <param name="up">Upper boundary</param>
-	/// <param name="down">Lower boundary perlin noise function</param>
-	void initBoundaries(float width, float length, float up, const Perlin* down);
+	/// <param name="down">Lower boundary terrain heights</param>
+	void initBoundaries(float width, float length, float up, const HeightQuery* down);
 
 public:
 	static int refreshRate;
@@ -78,21 +82,24 @@ public:
 	glm::vec3 up;
 	/// Direction camera is facing
 	glm::vec3 direction;
-	/// Position of the camera
-	glm::vec3 position;
+	/// Position of the camera, double precision keeps small moves and the model matrices exact far from the origin
+	glm::dvec3 position;
 
 	/// Currently active camera
 	static Camera* active;
 
 	Camera();
 	/// Initialize static camera
-	Camera(glm::vec3 position, glm::vec3 direction, float nearPlane, float farPlane, float captureAngle);
+	Camera(glm::dvec3 position, glm::vec3 direction, float nearPlane, float farPlane, float captureAngle);
 	/// Initialize dynamic camera with bounds
-	Camera(glm::vec3 position, glm::vec3 direction, float nearPlane, float farPlane, float captureAngle, float movementSpeed, float width, float length, float up, const Perlin* down);
+	Camera(glm::dvec3 position, glm::vec3 direction, float nearPlane, float farPlane, float captureAngle, float movementSpeed, float width, float length, float up, const HeightQuery* down);
 
 	/// Make current camera active
 	void makeActive();
 
+	/// Sweep moves against the terrain, so fast moves can't pass through a ridge between two positions
+	void setGroundTree(const HeightTree* tree);
+
 	/// Change projection parameters
 	void setProjectionParameters(float angle, float nearPlane, float farPlane);
 
@@ -118,8 +125,11 @@ public:
 	/// Update view and projection matrices with current camera parameters
 	void updateMatrices();
 
+	/// View rotation, model matrices have to be made relative to position first
 	const glm::mat4& viewMatrix() const;
 	const glm::mat4& projectMatrix() const;
+	/// World space view frustum of the current matrices
+	Frustum frustum() const;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,131 @@
+/*
+*	Error bounded terrain triangulation
+*/
+
+#include "decimator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+TerrainDecimator::TerrainDecimator(const HeightField& heights)
+	: width(heights.getWidth()), length(heights.getLength()), size(2)
+{
+	if (width < 2 || length < 2)
+		throw std::runtime_error("Decimated terrain needs at least 2 x 2 grid points");
+
+	while (size - 1 < std::max(width, length) - 1)
+		size = 2 * (size - 1) + 1;
+	const unsigned int cells = size - 1;
+	errors.assign(size_t(size) * size, 0.0f);
+
+	auto height = [&](unsigned int x, unsigned int y)
+	{
+		return heights.at(y, x);
+	};
+
+	// Triangle t of the binary tree has id t + 2, the two roots have ids 2 and 3 and children of id are 2 id and
+	// 2 id + 1. Children are visited before their parents so their errors are known when the parent is measured
+	const size_t triangles = size_t(cells) * cells * 2 - 2;
+	const size_t parents = triangles - size_t(cells) * cells;
+	for (size_t t = triangles; t-- > 0;)
+	{
+		// Walk down from the root to find the hypotenuse a, b of the triangle
+		size_t id = t + 2;
+		unsigned int ax = 0, ay = 0, bx = 0, by = 0, cx = 0, cy = 0;
+		if (id & 1)
+		{
+			bx = by = cx = cells;
+		}
+		else
+		{
+			ax = ay = cy = cells;
+		}
+		while ((id >>= 1) > 1)
+		{
+			unsigned int mx = (ax + bx) >> 1;
+			unsigned int my = (ay + by) >> 1;
+			if (id & 1)
+			{
+				bx = ax; by = ay;
+				ax = cx; ay = cy;
+			}
+			else
+			{
+				ax = bx; ay = by;
+				bx = cx; by = cy;
+			}
+			cx = mx;
+			cy = my;
+		}
+
+		unsigned int mx = (ax + bx) >> 1;
+		unsigned int my = (ay + by) >> 1;
+		float& error = errors[size_t(my) * size + mx];
+		// Splits of triangles reaching past the grid are forced, their corners have no heights
+		if (!inside(ax, ay) || !inside(bx, by) || !inside(cx, cy))
+		{
+			error = std::numeric_limits<float>::infinity();
+			continue;
+		}
+		error = std::max(error, std::abs((height(ax, ay) + height(bx, by)) * 0.5f - height(mx, my)));
+		if (t < parents)
+		{
+			// The midpoint alone doesn't bound the error of larger triangles, every grid point they cover is measured
+			int area = (int(bx) - int(ax)) * (int(cy) - int(ay)) - (int(by) - int(ay)) * (int(cx) - int(ax));
+			for (unsigned int y = std::min({ ay, by, cy }); y <= std::max({ ay, by, cy }); ++y)
+			{
+				for (unsigned int x = std::min({ ax, bx, cx }); x <= std::max({ ax, bx, cx }); ++x)
+				{
+					// Barycentric weights scaled by the doubled area, all of the same sign inside the triangle
+					int wa = (int(bx) - int(x)) * (int(cy) - int(y)) - (int(by) - int(y)) * (int(cx) - int(x));
+					int wb = (int(cx) - int(x)) * (int(ay) - int(y)) - (int(cy) - int(y)) * (int(ax) - int(x));
+					int wc = area - wa - wb;
+					if (area < 0)
+					{
+						wa = -wa; wb = -wb; wc = -wc;
+					}
+					if (wa < 0 || wb < 0 || wc < 0)
+						continue;
+					float interpolated = (wa * height(ax, ay) + wb * height(bx, by) + wc * height(cx, cy)) / float(std::abs(area));
+					error = std::max(error, std::abs(interpolated - height(x, y)));
+				}
+			}
+			error = std::max(error, errors[size_t((ay + cy) >> 1) * size + ((ax + cx) >> 1)]);
+			error = std::max(error, errors[size_t((by + cy) >> 1) * size + ((bx + cx) >> 1)]);
+		}
+	}
+}
+
+std::vector<unsigned int> TerrainDecimator::triangulate(float maxError) const
+{
+	const unsigned int cells = size - 1;
+	std::vector<unsigned int> indices;
+	split(0, 0, cells, cells, cells, 0, maxError, indices);
+	split(cells, cells, 0, 0, 0, cells, maxError, indices);
+	return indices;
+}
+
+bool TerrainDecimator::inside(unsigned int x, unsigned int y) const
+{
+	return x < width && y < length;
+}
+
+void TerrainDecimator::split(unsigned int ax, unsigned int ay, unsigned int bx, unsigned int by, unsigned int cx, unsigned int cy, float maxError, std::vector<unsigned int>& indices) const
+{
+	unsigned int mx = (ax + bx) >> 1;
+	unsigned int my = (ay + by) >> 1;
+	bool leaf = std::abs(int(ax) - int(cx)) + std::abs(int(ay) - int(cy)) <= 1;
+	if (!leaf && errors[size_t(my) * size + mx] > maxError)
+	{
+		split(cx, cy, ax, ay, mx, my, maxError, indices);
+		split(bx, by, cx, cy, mx, my, maxError, indices);
+		return;
+	}
+
+	// Leaves past the grid edge are dropped, larger triangles reaching past it were split
+	if (!inside(ax, ay) || !inside(bx, by) || !inside(cx, cy))
+		return;
+	indices.insert(indices.end(), { ay * width + ax, by * width + bx, cy * width + cx });
+}
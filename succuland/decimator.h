@@ -0,0 +1,44 @@
+#pragma once
+
+#ifndef _DECIMATOR_H
+#define _DECIMATOR_H
+
+#include "heightfield.h"
+
+#include <vector>
+
+/// <summary>
+/// Error bounded triangulation of a height field as a right triangulated irregular network (RTIN), GL free.
+/// The grid is covered by the smallest square of 2^k cells and every triangle is split along its hypotenuse
+/// while the height at the hypotenuse midpoint is further than the allowed error from the interpolated one.
+/// Errors carry over to the triangles sharing the hypotenuse and to the parents, so the result has no cracks.
+/// Triangles reaching past the grid are always split, the grid edge is therefore kept at full resolution
+/// </summary>
+class TerrainDecimator
+{
+public:
+	/// Measure the error of every split of the height field
+	explicit TerrainDecimator(const HeightField& heights);
+
+	/// <summary>
+	/// Triangulate the grid with the coarsest triangles within maxError
+	/// </summary>
+	/// <param name="maxError">Largest vertical distance between the triangles and the grid points they leave out</param>
+	/// <returns>Counter clockwise seen from above triangle list of grid point indices i * width + j</returns>
+	std::vector<unsigned int> triangulate(float maxError) const;
+
+protected:
+	const unsigned int width;
+	const unsigned int length;
+	/// Grid points along one side of the covering square, 2^k + 1
+	unsigned int size;
+	/// Error of splitting at each point of the square, row major
+	std::vector<float> errors;
+
+	/// Whether square point x, y lies on the grid
+	bool inside(unsigned int x, unsigned int y) const;
+	/// Emit triangle a, b, c with the right angle at c or split it at the midpoint of ab
+	void split(unsigned int ax, unsigned int ay, unsigned int bx, unsigned int by, unsigned int cx, unsigned int cy, float maxError, std::vector<unsigned int>& indices) const;
+};
+
+#endif
@@ -0,0 +1,34 @@
+/*
+*	View frustum
+*/
+
+#include "frustum.h"
+
+Frustum::Frustum(const glm::mat4& projectView)
+{
+	// Rows of the matrix, a clip space coordinate c is inside when -c.w <= c.xyz <= c.w
+	glm::vec4 rows[4];
+	for (int r = 0; r < 4; ++r)
+	{
+		rows[r] = glm::vec4(projectView[0][r], projectView[1][r], projectView[2][r], projectView[3][r]);
+	}
+
+	planes[PLANE_LEFT] = rows[3] + rows[0];
+	planes[PLANE_RIGHT] = rows[3] - rows[0];
+	planes[PLANE_BOTTOM] = rows[3] + rows[1];
+	planes[PLANE_TOP] = rows[3] - rows[1];
+	planes[PLANE_NEAR] = rows[3] + rows[2];
+	planes[PLANE_FAR] = rows[3] - rows[2];
+}
+
+bool Frustum::intersects(const glm::vec3& low, const glm::vec3& high) const
+{
+	for (const glm::vec4& plane : planes)
+	{
+		// Box corner furthest along the plane normal
+		glm::vec3 corner(plane.x >= 0.0f ? high.x : low.x, plane.y >= 0.0f ? high.y : low.y, plane.z >= 0.0f ? high.z : low.z);
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+			return false;
+	}
+	return true;
+}
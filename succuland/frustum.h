@@ -0,0 +1,31 @@
+#pragma once
+
+#ifndef _FRUSTUM_H
+#define _FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+/// View frustum as six inward facing planes, a point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0
+class Frustum
+{
+public:
+	/// Order of the planes
+	enum Plane { PLANE_LEFT, PLANE_RIGHT, PLANE_BOTTOM, PLANE_TOP, PLANE_NEAR, PLANE_FAR, PLANE_COUNT };
+
+	glm::vec4 planes[PLANE_COUNT];
+
+	/// <summary>
+	/// Extract the planes of a projection * view matrix, they are then in world space
+	/// </summary>
+	explicit Frustum(const glm::mat4& projectView);
+
+	/// <summary>
+	/// Conservative box test, boxes near a frustum corner may pass while lying outside
+	/// </summary>
+	/// <param name="low">Box corner with the lowest coordinates</param>
+	/// <param name="high">Box corner with the highest coordinates</param>
+	/// <returns>False only if the box lies fully outside one of the planes</returns>
+	bool intersects(const glm::vec3& low, const glm::vec3& high) const;
+};
+
+#endif
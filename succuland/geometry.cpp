@@ -30,6 +30,31 @@ Mesh::Mesh(float* data, unsigned int* indices, unsigned int numPrimitives, unsig
 		setTexData((char*)data + texOffset);
 }
 
+void Mesh::optimize(const std::string& name, std::vector<unsigned int>& indices, std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>* normals, std::vector<glm::vec3>* colors, std::vector<glm::vec2>* texCoords, const std::vector<size_t>& ranges)
+{
+	unsigned int vertexCount = (unsigned int)positions.size();
+	float before = MeshOptimizer::acmr(indices.data(), indices.size(), vertexCount);
+
+	size_t first = 0;
+	for (size_t count : ranges.empty() ? std::vector<size_t>{ indices.size() } : ranges)
+	{
+		MeshOptimizer::optimizeVertexCache(indices.data() + first, count, vertexCount);
+		first += count;
+	}
+	std::vector<unsigned int> remap = MeshOptimizer::optimizeVertexFetch(indices.data(), indices.size(), vertexCount);
+	MeshOptimizer::remapVertices(positions, remap);
+	if (normals)
+		MeshOptimizer::remapVertices(*normals, remap);
+	if (colors)
+		MeshOptimizer::remapVertices(*colors, remap);
+	if (texCoords)
+		MeshOptimizer::remapVertices(*texCoords, remap);
+
+	float after = MeshOptimizer::acmr(indices.data(), indices.size(), vertexCount);
+	std::cout << "INFO: " << name << " ACMR " << before << " -> " << after << std::endl;
+}
+
 void Mesh::initOffsets() 
 {
 	bool normal = flags & NORMAL_BIT;
@@ -163,119 +188,619 @@ void TexturedMesh::draw() const
 
 TerrainMesh::TerrainMesh()
 	: TexturedMesh(), 
-	width(0), height(0) 
+	width(0), height(0), grid(0, 0, perlin, false, false), visibleBlocks(0)
 {
 }
 
-TerrainMesh::TerrainMesh(unsigned int width, unsigned int height, float scale, int seed, Shader* shader, Material* material, uint8_t flags)
+TerrainMesh::TerrainMesh(unsigned int width, unsigned int height, float scale, int seed, Shader* shader, Material* material, uint8_t flags, NoiseBackend backend, const ComputeShader* generator, const std::string& cachePath)
 	: TexturedMesh(shader, material, flags, width* height, height -1, width* height * sizeof(float)), 
-	width(width), height(height), perlin(Perlin(2, 0.012f, 20.0f, seed))
+	width(width), height(height), perlin(noise(seed, backend)),
+	grid(width, height, perlin, flags & NORMAL_BIT, flags & TEXTURE_BIT, flags & COMPACT_BIT), visibleBlocks(0)
 {
- 	generate();
 	initOffsets();
 	initBuffers();
 
+	TerrainCache::Key key = TerrainCache::key(grid, flags);
+	if (!cachePath.empty() && loadCache(cachePath, key))
+		return;
+
+	generate(generator);
+	std::cout << "INFO: terrain ACMR " << MeshOptimizer::stripAcmr(grid.indices.data(), grid.indices.size(), numVertices, TerrainGrid::RESTART_INDEX) << std::endl;
+
+	// GPU generation already wrote the vertex data into the VBO
+	upload(generator == nullptr);
+	if (!cachePath.empty())
+		saveCache(cachePath, key);
+}
+
+TerrainMesh::TerrainMesh(TerrainGrid&& generated, Shader* shader, Material* material, uint8_t flags)
+	: TexturedMesh(shader, material, flags, generated.width * generated.height, generated.height - 1, generated.width * generated.height * sizeof(float)),
+	width(generated.width), height(generated.height), perlin(generated.noise()),
+	grid(std::move(generated)), visibleBlocks(0)
+{
+	initOffsets();
+	initBuffers();
+	upload(true);
+}
+
+Perlin TerrainMesh::noise(int seed, NoiseBackend backend)
+{
+	return Perlin(OCTAVES, 0.012f, 20.0f, seed, backend);
+}
+
+void TerrainMesh::upload(bool vertexData)
+{
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, grid.indices.size() * sizeof(unsigned int), grid.indices.data(), GL_STATIC_DRAW);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-	setPositionData(vertices.data());
+	resetRanges(grid.indices.size());
+
+	if (!vertexData)
+		return;
+
+	if (flags & COMPACT_BIT)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, vertexSetSize, grid.heightField.data());
+		if (flags & NORMAL_BIT)
+			glBufferSubData(GL_ARRAY_BUFFER, normalOffset, vertexSetSize, grid.packedNormals.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return;
+	}
+
+	setPositionData(grid.vertices.data());
 	if (flags & NORMAL_BIT)
-		setNormalData(normals.data());
-	if (flags & COLOR_BIT)
-		setColorData(colors.data());
+		setNormalData(grid.normals.data());
 	if (flags & TEXTURE_BIT)
-		setTexData(texCoords.data());
+		setTexData(grid.texCoords.data());
 }
 
-void TerrainMesh::generate() 
+void TerrainMesh::resetRanges(size_t indexCount)
 {
+	drawCounts.assign(1, GLsizei(indexCount));
+	drawOffsets.assign(1, nullptr);
+	visibleBlocks = grid.blocks.size();
+}
 
-	// Fill vertices
-	vertices.reserve(numVertices);
-	for (unsigned int i = 0; i < height; ++i)
+bool TerrainMesh::loadCache(const std::string& path, const TerrainCache::Key& key)
+{
+	TerrainCache cache(path, key);
+	if (!cache.valid())
+		return false;
+
+	// Buffers are filled straight from the mapped file, only the heights and blocks are copied for the CPU
+	cache.restore(grid);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, cache.indexCount() * sizeof(unsigned int), cache.indices(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, cache.vertexBytes(), cache.vertexData());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	resetRanges(cache.indexCount());
+
+	std::cout << "INFO: terrain loaded from " << path << std::endl;
+	return true;
+}
+
+void TerrainMesh::saveCache(const std::string& path, const TerrainCache::Key& key) const
+{
+	// The VBO is read back as a whole, GPU generation leaves the grid vertex arrays empty
+	GLint64 bytes = 0;
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glGetBufferParameteri64v(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &bytes);
+	std::vector<char> vertexData((size_t)bytes);
+	glGetBufferSubData(GL_ARRAY_BUFFER, 0, bytes, vertexData.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	try
 	{
-		for (unsigned int j = 0; j < width; ++j) 
+		TerrainCache::write(path, key, grid, vertexData.data(), vertexData.size());
+		std::cout << "INFO: terrain cached in " << path << std::endl;
+	}
+	catch (const std::runtime_error& e)
+	{
+		std::cerr << "WARNING: " << e.what() << std::endl;
+	}
+}
+
+void TerrainMesh::initOffsets()
+{
+	if (!(flags & COMPACT_BIT))
+	{
+		Mesh::initOffsets();
+		return;
+	}
+
+	// One float height and one packed normal per vertex, both take vertexSetSize bytes
+	colorOffset = 0;
+	normalOffset = vertexSetSize;
+	texOffset = 0;
+}
+
+void TerrainMesh::initBuffers()
+{
+	if (!(flags & COMPACT_BIT))
+	{
+		Mesh::initBuffers();
+		return;
+	}
+
+	bool normal = flags & NORMAL_BIT;
+
+	glGenBuffers(1, &vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	glGenBuffers(1, &ebo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+
+	glEnableVertexAttribArray(shader->attributes.height);
+	glVertexAttribPointer(shader->attributes.height, 1, GL_FLOAT, GL_FALSE, 0, 0);
+
+	if (normal)
+	{
+		glEnableVertexAttribArray(shader->attributes.packedNormal);
+		glVertexAttribPointer(shader->attributes.packedNormal, 2, GL_SHORT, GL_TRUE, 0, (void*)normalOffset);
+	}
+
+	glBufferData(GL_ARRAY_BUFFER, vertexSetSize * (1 + normal), nullptr, GL_STATIC_DRAW);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void TerrainMesh::generate(const ComputeShader* generator) 
+{
+	grid.generate(ThreadPool::shared(), generator == nullptr);
+	if (generator != nullptr)
+		generateOnGPU(generator);
+}
+
+/// <summary>
+/// Bind rows [first, first + rows) of a planar vertex stream to a shader storage block
+/// </summary>
+/// <param name="streamOffset">Byte offset of the stream in the buffer</param>
+/// <param name="components">Floats per vertex</param>
+/// <returns>Number of floats between the start of the bound range and the first row, the range start has to be aligned</returns>
+static GLint bindRows(GLuint binding, GLuint buffer, long streamOffset, unsigned int components, unsigned int width, unsigned int first, unsigned int rows, GLint alignment)
+{
+	GLintptr offset = streamOffset + GLintptr(first) * width * components * sizeof(float);
+	GLintptr aligned = offset - offset % alignment;
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, buffer, aligned, offset - aligned + GLsizeiptr(rows) * width * components * sizeof(float));
+	return GLint((offset - aligned) / sizeof(float));
+}
+
+void TerrainMesh::generateOnGPU(const ComputeShader* generator)
+{
+	// Noise table as a buffer texture of (perm, gx, gy) texels, gradients are read back with intBitsToFloat
+	const NoiseTable2D& table = perlin.table();
+	GLuint tableBuffer, tableTexture;
+	glGenBuffers(1, &tableBuffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, tableBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(table.entries), table.entries, GL_STATIC_DRAW);
+	glGenTextures(1, &tableTexture);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_BUFFER, tableTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32I, tableBuffer);
+
+	// Heights are written to their own buffer too, the height field is read back from it.
+	// Compact meshes store them in the VBO already, they are read back from there
+	bool compact = flags & COMPACT_BIT;
+	GLuint heightBuffer = 0;
+	if (!compact)
+	{
+		glGenBuffers(1, &heightBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, heightBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, numVertices * sizeof(float), nullptr, GL_STREAM_READ);
+	}
+	GLuint heights = compact ? vbo : heightBuffer;
+
+	glm::vec2 origin = grid.origin;
+	generator->use();
+	generator->setInteger("noiseTable", 0);
+	generator->setInteger("width", width);
+	generator->setVec2("origin", origin);
+	generator->setInteger("octaves", perlin.octaves());
+	generator->setFloat("frequency", perlin.frequency());
+	generator->setFloat("amplitude", perlin.amplitude());
+	generator->setInteger("seed", perlin.seed());
+	generator->setInteger("backend", perlin.backend());
+	generator->setInteger("writeNormals", (flags & NORMAL_BIT) != 0);
+	generator->setInteger("writeTexCoords", (flags & TEXTURE_BIT) != 0 && !compact);
+	generator->setInteger("compact", compact);
+	generator->setFloat("texSpacing", TerrainGrid::TEX_SPACING);
+
+	// Large grids don't fit into one storage block, they are generated in bands of rows
+	GLint maxBlockSize, alignment;
+	glGetIntegerv(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &maxBlockSize);
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	unsigned int bandRows = std::clamp<unsigned int>((maxBlockSize - alignment) / (width * 3 * sizeof(float)), 1, height);
+
+	for (unsigned int first = 0; first < height; first += bandRows)
+	{
+		unsigned int rows = std::min(bandRows, height - first);
+		GLint skip[4] = { 0, 0, 0, 0 };
+		if (!compact)
+			skip[0] = bindRows(0, vbo, 0, 3, width, first, rows, alignment);
+		if ((flags & NORMAL_BIT) && compact)
+			skip[1] = bindRows(4, vbo, normalOffset, 1, width, first, rows, alignment);
+		else if (flags & NORMAL_BIT)
+			skip[1] = bindRows(1, vbo, normalOffset, 3, width, first, rows, alignment);
+		if ((flags & TEXTURE_BIT) && !compact)
+			skip[2] = bindRows(2, vbo, texOffset, 2, width, first, rows, alignment);
+		skip[3] = bindRows(3, heights, 0, 1, width, first, rows, alignment);
+
+		generator->setInteger("firstRow", first);
+		generator->setInteger("rowCount", rows);
+		generator->setIntegerArray("skip", skip, 4);
+		generator->dispatch((width + 15) / 16, (rows + 15) / 16);
+	}
+
+	glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, heights);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, numVertices * sizeof(float), grid.heightField.data());
+	grid.measureBlocks();
+
+	for (GLuint binding = 0; binding < 5; ++binding)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	Shader::unbind();
+
+	if (heightBuffer != 0)
+		glDeleteBuffers(1, &heightBuffer);
+	glDeleteTextures(1, &tableTexture);
+	glDeleteBuffers(1, &tableBuffer);
+}
+
+void TerrainMesh::draw() const 
+{
+	if (drawCounts.empty())
+		return;
+	shader->setMaterial(material);
+	if (flags & COMPACT_BIT)
+		shader->setTerrainGrid(grid.origin, width, TerrainGrid::TEX_SPACING);
+	glBindVertexArray(vao);
+	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+	// Strips are separated by restart indices, all visible blocks are one call
+	glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+	glMultiDrawElements(GL_TRIANGLE_STRIP, drawCounts.data(), GL_UNSIGNED_INT, drawOffsets.data(), GLsizei(drawCounts.size()));
+	glDisable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+	//glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	glBindVertexArray(0);
+	if (flags & COMPACT_BIT)
+		shader->disableTerrain();
+}
+
+void TerrainMesh::cull(const Frustum& frustum)
+{
+	drawCounts.clear();
+	drawOffsets.clear();
+	visibleBlocks = 0;
+	size_t end = 0;
+	for (const TerrainGrid::Block& block : grid.blocks)
+	{
+		if (!frustum.intersects(block.low, block.high))
+			continue;
+		++visibleBlocks;
+		if (!drawCounts.empty() && end == block.firstIndex)
+		{
+			drawCounts.back() += block.indexCount;
+		}
+		else
 		{
-			float x = -(width / 2.0f) + j;
-			float z = -(height / 2.0f) + i;
-			vertices.emplace_back(x, perlin(x,z), z);
+			drawCounts.push_back(block.indexCount);
+			drawOffsets.push_back((const void*)(block.firstIndex * sizeof(unsigned int)));
 		}
+		end = block.firstIndex + block.indexCount;
 	}
+}
+
+size_t TerrainMesh::drawnBlocks() const
+{
+	return visibleBlocks;
+}
+
+size_t TerrainMesh::culledBlocks() const
+{
+	return grid.blocks.size() - visibleBlocks;
+}
+
+TerrainGrid::Region TerrainMesh::editHeights(const glm::vec2& low, const glm::vec2& high, const std::function<float(float x, float z, float height)>& edit)
+{
+	glm::vec2 first = glm::max(glm::ceil(low - grid.origin), 0.0f);
+	glm::vec2 last = glm::min(glm::floor(high - grid.origin) + 1.0f, glm::vec2(width, height));
+	if (last.x <= first.x || last.y <= first.y)
+		return { 0, 0, 0, 0 };
+
+	TerrainGrid::Region dirty = grid.editHeights({ unsigned(first.y), unsigned(first.x), unsigned(last.y), unsigned(last.x) }, edit);
+	uploadRegion(dirty);
+	return dirty;
+}
 
-	// Fill indices
-	indices.reserve(width * 2 * (height - 1));
-	for (unsigned int i = 0; i < height - 1; ++i) 
+void TerrainMesh::uploadRegion(const TerrainGrid::Region& region)
+{
+	unsigned int columns = region.j1 - region.j0;
+	if (region.i0 >= region.i1 || columns == 0)
+		return;
+
+	// Every row of the region is one run in each planar section, texture coordinates don't depend on the heights
+	bool normal = flags & NORMAL_BIT;
+	const float* heights = grid.heightField.data();
+	std::vector<glm::vec3> positions(columns);
+	std::vector<glm::vec3> normals(columns);
+	std::vector<uint32_t> packedNormals(columns);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	for (unsigned int i = region.i0; i < region.i1; ++i)
 	{
-		for (unsigned int j = 0; j < width; ++j) 
+		size_t first = size_t(i) * width + region.j0;
+		if (flags & COMPACT_BIT)
 		{
-			indices.push_back(i * width + j);
-			indices.push_back((i + 1)*width + j);
+			glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(float), columns * sizeof(float), heights + first);
+			if (!normal)
+				continue;
+			for (unsigned int k = 0; k < columns; ++k)
+				packedNormals[k] = TerrainGrid::packNormal(grid.heightNormal(i, region.j0 + k));
+			glBufferSubData(GL_ARRAY_BUFFER, normalOffset + first * sizeof(uint32_t), columns * sizeof(uint32_t), packedNormals.data());
+			continue;
 		}
+
+		for (unsigned int k = 0; k < columns; ++k)
+			positions[k] = glm::vec3(float(region.j0 + k), heights[first + k], float(i));
+		glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(glm::vec3), columns * sizeof(glm::vec3), positions.data());
+		if (!normal)
+			continue;
+		for (unsigned int k = 0; k < columns; ++k)
+			normals[k] = grid.heightNormal(i, region.j0 + k);
+		glBufferSubData(GL_ARRAY_BUFFER, normalOffset + first * sizeof(glm::vec3), columns * sizeof(glm::vec3), normals.data());
 	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+const Perlin& TerrainMesh::getPerlin() const 
+{
+	return perlin;
+}
+
+const HeightField& TerrainMesh::getHeightField() const
+{
+	return grid.heightField;
+}
+
+glm::dmat4 TerrainMesh::model() const
+{
+	return grid.model();
+}
+
+/*
+*	Decimated terrain mesh
+*/
+
+DecimatedTerrainMesh::DecimatedTerrainMesh(unsigned int width, unsigned int height, int seed, float maxError, Shader* shader, Material* material, uint8_t flags, NoiseBackend backend)
+	: TexturedMesh(shader, material, flags & ~COMPACT_BIT, 0, 0, 0),
+	perlin(TerrainMesh::noise(seed, backend))
+{
+	bool normal = this->flags & NORMAL_BIT;
+	bool tex = this->flags & TEXTURE_BIT;
+	TerrainGrid grid(width, height, perlin, normal, tex);
+	grid.generate(ThreadPool::shared());
+
+	std::vector<unsigned int> indices = TerrainDecimator(grid.heightField).triangulate(maxError);
+	optimize("decimated terrain", indices, grid.vertices, normal ? &grid.normals : nullptr, nullptr, tex ? &grid.texCoords : nullptr);
+
+	// Grid points left out of every triangle were moved past the used ones
+	unsigned int used = *std::max_element(indices.begin(), indices.end()) + 1;
+	grid.vertices.resize(used);
+	if (normal)
+		grid.normals.resize(used);
+	if (tex)
+		grid.texCoords.resize(used);
+
+	numVertices = used;
+	numPrimitives = (unsigned int)(indices.size() / 3);
+	vertexSetSize = used * sizeof(float);
+	std::cout << "INFO: decimated terrain " << numPrimitives << " of " << 2 * (width - 1) * (height - 1)
+		<< " triangles, " << used << " of " << width * height << " vertices" << std::endl;
+
+	initOffsets();
+	initBuffers();
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-	// Fill normals
-	if (flags & NORMAL_BIT) 
+	setPositionData(grid.vertices.data());
+	if (normal)
+		setNormalData(grid.normals.data());
+	if (tex)
+		setTexData(grid.texCoords.data());
+
+	heightField = std::move(grid.heightField);
+	gridModel = grid.model();
+}
+
+void DecimatedTerrainMesh::draw() const
+{
+	shader->setMaterial(material);
+	glBindVertexArray(vao);
+	glDrawElements(GL_TRIANGLES, numPrimitives * 3, GL_UNSIGNED_INT, 0);
+	glBindVertexArray(0);
+}
+
+const Perlin& DecimatedTerrainMesh::getPerlin() const
+{
+	return perlin;
+}
+
+const HeightField& DecimatedTerrainMesh::getHeightField() const
+{
+	return heightField;
+}
+
+glm::dmat4 DecimatedTerrainMesh::model() const
+{
+	return gridModel;
+}
+
+/*
+*	Grid patch mesh
+*/
+
+GridPatchMesh::GridPatchMesh(unsigned int size, Shader* shader)
+	: Mesh(shader, 0, (size + 1) * (size + 1), 2 * size * size, (size + 1) * (size + 1) * sizeof(float)),
+	size(size)
+{
+	if (size == 0 || size % 2 != 0)
+		throw std::runtime_error("Grid patch size has to be even");
+
+	std::vector<glm::vec3> vertices;
+	vertices.reserve(numVertices);
+	for (unsigned int i = 0; i <= size; ++i)
 	{
-		float off = 0.2;
-		normals.reserve(numVertices);
-		for (int i = 0; i < height; ++i) 
+		for (unsigned int j = 0; j <= size; ++j)
 		{
-			for (int j = 0; j < width; ++j) 
-			{
-				const glm::vec3& vertex = vertices[i * height + j];
-				volatile float x = vertex.x + off;
-				volatile float z = vertex.z;
-				glm::vec3 up = glm::vec3(x, perlin(x,z), z);
-				x = vertex.x;
-				z = vertex.z + off;
-				glm::vec3 right = glm::vec3(x, perlin(x, z), z);
-				x = vertex.x - off;
-				z = vertex.z;
-				glm::vec3 down = glm::vec3(x, perlin(x, z), z);
-				x = vertex.x;
-				z = vertex.z - off;
-				glm::vec3 left = glm::vec3(x, perlin(x, z), z);
-				normals.push_back(glm::normalize(glm::cross(right - left, up - down)));
-			}
+			vertices.emplace_back(float(j), 0.0f, float(i));
 		}
 	}
 
-	if (flags & TEXTURE_BIT) 
+	// Same diagonal as the terrain strips, (i + 1, j) - (i, j + 1)
+	unsigned int half = size / 2;
+	std::vector<unsigned int> indices;
+	indices.reserve(3 * numPrimitives);
+	for (unsigned int q = 0; q < 4; ++q)
 	{
-		float spacing = 0.05;
-		float u = 0.0f;
-		float v = 0.0f;
-		texCoords.reserve(width * height);
-		for (int i = 0; i < height; ++i) 
+		unsigned int qx = (q & 1) * half;
+		unsigned int qz = (q >> 1) * half;
+		for (unsigned int i = qz; i < qz + half; ++i)
 		{
-			for (int j = 0; j < width; ++j) 
+			for (unsigned int j = qx; j < qx + half; ++j)
 			{
-				texCoords.emplace_back(u, v);
-				u += spacing;
+				unsigned int v = i * (size + 1) + j;
+				indices.insert(indices.end(), { v, v + size + 1, v + 1 });
+				indices.insert(indices.end(), { v + 1, v + size + 1, v + size + 2 });
 			}
-			v += spacing;
-			u = 0.0f;
 		}
 	}
+	optimize("grid patch", indices, vertices, nullptr, nullptr, nullptr, std::vector<size_t>(4, indices.size() / 4));
+
+	initOffsets();
+	initBuffers();
+	setPositionData(vertices.data());
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
-void TerrainMesh::draw() const 
+void GridPatchMesh::draw() const
 {
-	shader->setMaterial(material);
+	drawQuadrants(0b1111);
+}
+
+void GridPatchMesh::drawQuadrants(uint8_t mask) const
+{
+	const unsigned int quadrantIndices = 3 * numPrimitives / 4;
+
 	glBindVertexArray(vao);
-	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	for (unsigned int s = 0; s < height - 1; s++) 
+	// Neighbouring quadrants are neighbours in the index buffer too, each run of set bits is one draw call
+	for (unsigned int q = 0; q < 4;)
 	{
-		glDrawElements(GL_TRIANGLE_STRIP, width * 2, GL_UNSIGNED_INT, (void*)(width * 2 * s * sizeof(unsigned int)));
+		if ((mask & (1 << q)) == 0)
+		{
+			++q;
+			continue;
+		}
+		unsigned int first = q;
+		while (q < 4 && (mask & (1 << q)) != 0)
+			++q;
+		glDrawElements(GL_TRIANGLES, (q - first) * quadrantIndices, GL_UNSIGNED_INT, (void*)(size_t(first) * quadrantIndices * sizeof(unsigned int)));
 	}
-	//glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 	glBindVertexArray(0);
 }
 
-const Perlin& TerrainMesh::getPerlin() const 
+void GridPatchMesh::setInstanceOrigins(GLuint buffer)
 {
-	return perlin;
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glEnableVertexAttribArray(shader->attributes.patchOrigin);
+	glVertexAttribPointer(shader->attributes.patchOrigin, 2, GL_FLOAT, GL_FALSE, 0, 0);
+	glVertexAttribDivisor(shader->attributes.patchOrigin, 1);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GridPatchMesh::drawInstanced(unsigned int instances) const
+{
+	glBindVertexArray(vao);
+	glDrawElementsInstanced(GL_TRIANGLES, 3 * numPrimitives, GL_UNSIGNED_INT, 0, instances);
+	glBindVertexArray(0);
+}
+
+/*
+*	Quad Patch Mesh
+*/
+
+QuadPatchMesh::QuadPatchMesh(const glm::vec2& origin, unsigned int width, unsigned int length, unsigned int patchSize, Shader* shader)
+	: Mesh(shader, 0, 0, 0, 0)
+{
+	if (width < 2 || length < 2 || patchSize == 0)
+		throw std::runtime_error("Quad patch mesh needs at least one cell");
+
+	// Corner coordinates along one axis, the last one sits on the map edge
+	auto corners = [patchSize](unsigned int points)
+	{
+		std::vector<float> result;
+		for (unsigned int k = 0; k < points - 1; k += patchSize)
+			result.push_back(float(k));
+		result.push_back(float(points - 1));
+		return result;
+	};
+	std::vector<float> xs = corners(width);
+	std::vector<float> zs = corners(length);
+	unsigned int columns = (unsigned int)xs.size();
+
+	std::vector<glm::vec3> vertices;
+	vertices.reserve(xs.size() * zs.size());
+	for (float z : zs)
+	{
+		for (float x : xs)
+		{
+			vertices.emplace_back(origin.x + x, 0.0f, origin.y + z);
+		}
+	}
+
+	std::vector<unsigned int> indices;
+	for (unsigned int i = 0; i + 1 < zs.size(); ++i)
+	{
+		for (unsigned int j = 0; j + 1 < columns; ++j)
+		{
+			unsigned int v = i * columns + j;
+			indices.insert(indices.end(), { v, v + 1, v + columns + 1, v + columns });
+		}
+	}
+
+	numVertices = (unsigned int)vertices.size();
+	numPrimitives = (unsigned int)indices.size() / 4;
+	vertexSetSize = numVertices * sizeof(float);
+
+	initOffsets();
+	initBuffers();
+	setPositionData(vertices.data());
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void QuadPatchMesh::draw() const
+{
+	glBindVertexArray(vao);
+	glPatchParameteri(GL_PATCH_VERTICES, 4);
+	glDrawElements(GL_PATCHES, 4 * numPrimitives, GL_UNSIGNED_INT, 0);
+	glBindVertexArray(0);
 }
 
 /*
@@ -291,6 +816,7 @@ OBJMesh::OBJMesh(const std::string& path, Shader* shader)
 	: TexturedMesh(shader, nullptr, 0, 0, 0, 0)
 {
 	loadFile(path);
+	optimize(path, indices, vertices, flags & NORMAL_BIT ? &normals : nullptr, flags & COLOR_BIT ? &colors : nullptr, flags & TEXTURE_BIT ? &texCoords : nullptr);
 	initOffsets();
 	initBuffers();
 
@@ -320,6 +846,7 @@ OBJMesh::OBJMesh(const aiMesh* mesh, const aiMaterial* mat, const std::string& p
 	: TexturedMesh(shader, nullptr, 0, 0, 0, 0)
 {
 	loadMesh(mesh, mat, path);
+	optimize(path + " / " + mesh->mName.C_Str(), indices, vertices, flags & NORMAL_BIT ? &normals : nullptr, flags & COLOR_BIT ? &colors : nullptr, flags & TEXTURE_BIT ? &texCoords : nullptr);
 	initOffsets();
 	initBuffers();
 
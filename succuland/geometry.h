@@ -7,6 +7,11 @@
 #include "shader.h"
 #include "properties.h"
 #include "perlin.h"
+#include "terrain.h"
+#include "frustum.h"
+#include "meshopt.h"
+#include "decimator.h"
+#include "terraincache.h"
 
 #include <algorithm>
 #include <iostream>
@@ -16,6 +21,8 @@
 #define COLOR_BIT			0b0001
 #define NORMAL_BIT			0b0010
 #define TEXTURE_BIT			0b0100
+/// Terrain only, vertices store a height and a packed normal, positions and texture coordinates are rebuilt in the vertex shader
+#define COMPACT_BIT			0b1000
 
 /// Class defining generic mesh
 class Mesh 
@@ -46,6 +53,16 @@ protected:
 	virtual void setColorData(void* data);
 	virtual void setTexData(void* data);
 
+	/// <summary>
+	/// Mesh build stage for triangle lists, reorder the triangles for the post-transform cache and then the vertices
+	/// in order of first use. Prints the ACMR before and after
+	/// </summary>
+	/// <param name="ranges">Index counts of consecutive ranges optimized on their own so they can still be drawn on their own,
+	/// empty for a single range</param>
+	/// <param name="normals">Arrays remapped along with the positions, nullptr if the mesh doesn't have them</param>
+	static void optimize(const std::string& name, std::vector<unsigned int>& indices, std::vector<glm::vec3>& positions,
+		std::vector<glm::vec3>* normals, std::vector<glm::vec3>* colors, std::vector<glm::vec2>* texCoords, const std::vector<size_t>& ranges = {});
+
 	/// Initialize mesh parameters without creating buffers, used by derived classes
 	Mesh(Shader* shader, uint8_t flags, int numVertices, int numPrimitives, long setSize); 
 
@@ -84,30 +101,157 @@ public:
 class TerrainMesh : public TexturedMesh 
 {
 protected:
+	/// Octave count of the terrain noise, rows are generated by the Perlin batch kernels while
+	/// scalar Get queries, e.g. of the camera, reach the matching Perlin::Fbm specialization
+	static const int OCTAVES = 2;
+
 	const unsigned int width;
 	const unsigned int height;
 
 	/// Perling noise defining height of the terrain
 	const Perlin perlin;
 
-	std::vector<glm::vec3> vertices;
-	std::vector<glm::vec3> colors;
-	std::vector<glm::vec3> normals;
-	std::vector<glm::vec2> texCoords;
+	/// Generated grid data, vertex arrays stay empty when the grid is generated on the GPU
+	TerrainGrid grid;
 
-	std::vector<unsigned int> indices;
+	/// Index ranges of the visible blocks, neighbouring blocks are merged into one range
+	std::vector<GLsizei> drawCounts;
+	std::vector<const void*> drawOffsets;
+	size_t visibleBlocks;
 
-	/// Generate terrain mesh data using constructor parameters
-	void generate();
+	/// <summary>
+	/// Generate terrain mesh data using constructor parameters, rows are generated in parallel tiles
+	/// </summary>
+	/// <param name="generator">Compute shader generating the vertex data straight into the VBO, nullptr generates it on the CPU</param>
+	void generate(const ComputeShader* generator);
+	/// Run the generator compute shader over the grid and read the heights back into the height field
+	void generateOnGPU(const ComputeShader* generator);
+	/// Upload the grid indices and, if vertexData is set, its vertex arrays
+	void upload(bool vertexData);
+	/// Draw all indexCount indices until the first cull
+	void resetRanges(size_t indexCount);
+	/// Rewrite the vertex data of a region from the height field, only its row runs of each VBO section are uploaded
+	void uploadRegion(const TerrainGrid::Region& region);
+	/// Upload the mesh from the cache file at path, false if the file doesn't hold this mesh
+	bool loadCache(const std::string& path, const TerrainCache::Key& key);
+	/// Write the uploaded mesh into the cache file at path, failures only print a warning
+	void saveCache(const std::string& path, const TerrainCache::Key& key) const;
+
+	/// Compact meshes store a float height block and a packed normal block
+	void initOffsets() override;
+	void initBuffers() override;
 
 public:
 	TerrainMesh();
-	TerrainMesh(unsigned int width, unsigned int height, float scale, int seed, Shader* shader, Material* material, uint8_t flags);
+	/// <param name="generator">Compute shader generating the vertex data straight into the VBO, nullptr generates it on the CPU</param>
+	/// <param name="cachePath">File caching the generated mesh, it is rebuilt when it holds another terrain. Empty disables the cache</param>
+	TerrainMesh(unsigned int width, unsigned int height, float scale, int seed, Shader* shader, Material* material, uint8_t flags, NoiseBackend backend = NOISE_BACKEND_PERLIN, const ComputeShader* generator = nullptr, const std::string& cachePath = "");
+	/// Upload a grid generated elsewhere (e.g. off the GL thread), the grid keeps referring to its noise
+	TerrainMesh(TerrainGrid&& generated, Shader* shader, Material* material, uint8_t flags);
+
+	/// Noise the terrain heights are generated from
+	static Perlin noise(int seed, NoiseBackend backend = NOISE_BACKEND_PERLIN);
+
+	/// Low level draw call to render current mesh, additionally sets material uniforms (one triangle strip draw with primitive restart)
+	void draw() const override;
+	/// <summary>
+	/// Pick the blocks draw submits, until the first call every block is drawn
+	/// </summary>
+	/// <param name="frustum">World space frustum, the mesh is expected to be drawn with model()</param>
+	void cull(const Frustum& frustum);
+	/// Blocks drawn since the last cull
+	size_t drawnBlocks() const;
+	/// Blocks left out since the last cull
+	size_t culledBlocks() const;
+	/// <summary>
+	/// Change the terrain heights inside a rectangle, e.g. to stamp a crater, and upload only the changed vertices
+	/// </summary>
+	/// <param name="low">Lower x, z corner of the rectangle in world space</param>
+	/// <param name="high">Upper x, z corner of the rectangle in world space</param>
+	/// <param name="edit">New height of a grid point from its world x, z and current height</param>
+	/// <returns>Grid points whose vertex data changed</returns>
+	TerrainGrid::Region editHeights(const glm::vec2& low, const glm::vec2& high, const std::function<float(float x, float z, float height)>& edit);
+	/// Gets a reference to meshes perlin noise function
+	const Perlin& getPerlin() const;
+	/// Gets a reference to the heights of the generated grid, matches the rendered triangles
+	const HeightField& getHeightField() const;
+	/// Model matrix of the mesh, vertices are stored relative to the grid origin
+	glm::dmat4 model() const;
+};
+
+/// <summary>
+/// Terrain generated like TerrainMesh but triangulated by TerrainDecimator, flat regions take a fraction of the
+/// full grid triangles. Drawn as an indexed triangle list, only the grid points the triangles use are uploaded
+/// </summary>
+class DecimatedTerrainMesh : public TexturedMesh
+{
+protected:
+	/// Perling noise defining height of the terrain
+	const Perlin perlin;
+	/// Full resolution heights, within maxError of the rendered triangles
+	HeightField heightField;
+	/// Places the grid relative vertices at the grid origin
+	glm::dmat4 gridModel;
+
+public:
+	/// <param name="maxError">Largest vertical distance between the triangles and the full resolution grid</param>
+	/// <param name="flags">Vertex attributes, COMPACT_BIT is ignored since the kept vertices no longer follow the grid order</param>
+	DecimatedTerrainMesh(unsigned int width, unsigned int height, int seed, float maxError, Shader* shader, Material* material, uint8_t flags, NoiseBackend backend = NOISE_BACKEND_PERLIN);
 
-	/// Low level draw call to render current mesh, additionally sets material uniforms (uses triangle strips)
+	/// Low level draw call to render current mesh, additionally sets material uniforms
 	void draw() const override;
 	/// Gets a reference to meshes perlin noise function
 	const Perlin& getPerlin() const;
+	/// Gets a reference to the heights of the full resolution grid
+	const HeightField& getHeightField() const;
+	/// Model matrix of the mesh, vertices are stored relative to the grid origin
+	glm::dmat4 model() const;
+};
+
+/// <summary>
+/// Flat square grid of size x size cells in the xz plane, vertex (i, j) lies at (j, 0, i) in cell units.
+/// Drawn with GL_TRIANGLES, the indices are ordered quadrant by quadrant so quadrants can be drawn on their own
+/// </summary>
+class GridPatchMesh : public Mesh
+{
+public:
+	/// Cells along one side, has to be even
+	const unsigned int size;
+
+	GridPatchMesh(unsigned int size, Shader* shader);
+
+	/// Draw the whole grid
+	void draw() const override;
+	/// <summary>
+	/// Draw only some quadrants of the grid
+	/// </summary>
+	/// <param name="mask">Bit qz * 2 + qx is set for every quadrant to draw, qx and qz are 0 for the quadrant at the origin</param>
+	void drawQuadrants(uint8_t mask) const;
+
+	/// Read the per instance patch corner relative to the map origin, two floats per instance, from buffer
+	void setInstanceOrigins(GLuint buffer);
+	/// Draw the whole grid once per instance
+	void drawInstanced(unsigned int instances) const;
+};
+
+/// <summary>
+/// Grid of quads covering a height map, drawn as four point patches for the tessellation stages. Corners are
+/// positions on the y = 0 plane and run counter clockwise from the patch corner with the lowest x and z
+/// </summary>
+class QuadPatchMesh : public Mesh
+{
+public:
+	/// <summary>
+	/// Split the map into square patches, the last row and column are cut at the map edge
+	/// </summary>
+	/// <param name="origin">xz position of grid point (0, 0)</param>
+	/// <param name="width">Grid points along x</param>
+	/// <param name="length">Grid points along z</param>
+	/// <param name="patchSize">Cells along one side of a patch</param>
+	QuadPatchMesh(const glm::vec2& origin, unsigned int width, unsigned int length, unsigned int patchSize, Shader* shader);
+
+	/// Draw all patches
+	void draw() const override;
 };
 
 /// Mesh that can be loaded from a file, handles multiple sub meshes and materials
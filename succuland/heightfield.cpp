@@ -0,0 +1,80 @@
+/*
+*	Height field sampled from the generated terrain grid
+*/
+
+#include "heightfield.h"
+
+#include <algorithm>
+#include <cmath>
+
+/*
+*	Height query
+*/
+
+void HeightQuery::GetBatch(const float* xs, const float* zs, float* out, size_t n) const
+{
+	for (size_t k = 0; k < n; ++k)
+	{
+		out[k] = Get(xs[k], zs[k]);
+	}
+}
+
+/*
+*	Height field
+*/
+
+HeightField::HeightField()
+	: width(0), length(0), originX(0.0f), originZ(0.0f)
+{
+}
+
+HeightField::HeightField(unsigned int width, unsigned int length, float originX, float originZ)
+	: width(width), length(length), originX(originX), originZ(originZ), heights(size_t(width) * length, 0.0f)
+{
+}
+
+float HeightField::Get(float x, float z) const
+{
+	if (width < 2 || length < 2)
+		return heights.empty() ? 0.0f : heights[0];
+
+	float u = std::clamp(x - originX, 0.0f, float(width - 1));
+	float v = std::clamp(z - originZ, 0.0f, float(length - 1));
+
+	// Last row and column belong to the cell before them
+	unsigned int j = std::min((unsigned int)u, width - 2);
+	unsigned int i = std::min((unsigned int)v, length - 2);
+	float fx = u - j;
+	float fz = v - i;
+
+	const float* row = &heights[size_t(i) * width + j];
+	float h00 = row[0];
+	float h01 = row[1];
+	float h10 = row[width];
+	float h11 = row[width + 1];
+
+	// Strip triangles are (i, j) (i + 1, j) (i, j + 1) and (i + 1, j) (i, j + 1) (i + 1, j + 1)
+	if (fx + fz <= 1.0f)
+		return h00 + fx * (h01 - h00) + fz * (h10 - h00);
+	return h11 + (1.0f - fx) * (h10 - h11) + (1.0f - fz) * (h01 - h11);
+}
+
+unsigned int HeightField::getWidth() const
+{
+	return width;
+}
+
+unsigned int HeightField::getLength() const
+{
+	return length;
+}
+
+float HeightField::getOriginX() const
+{
+	return originX;
+}
+
+float HeightField::getOriginZ() const
+{
+	return originZ;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#ifndef _HEIGHTFIELD_H
+#define _HEIGHTFIELD_H
+
+#include <vector>
+#include <cstddef>
+
+/// Source of terrain heights for collision and object placement
+class HeightQuery
+{
+public:
+	virtual ~HeightQuery() {}
+
+	/// Height of the terrain at world position x, z
+	virtual float Get(float x, float z) const = 0;
+	float operator()(float x, float z) const { return Get(x, z); }
+
+	/// <summary>
+	/// Query heights of n positions at once
+	/// </summary>
+	/// <param name="xs">x coordinates</param>
+	/// <param name="zs">z coordinates</param>
+	/// <param name="out">n heights</param>
+	virtual void GetBatch(const float* xs, const float* zs, float* out, size_t n) const;
+};
+
+/// <summary>
+/// Regular grid of terrain heights with unit spacing, answers height queries without evaluating the noise.
+/// Heights are interpolated over the same two triangles per cell the terrain triangle strips use,
+/// split along the diagonal from (i + 1, j) to (i, j + 1), so queries match the rendered surface exactly.
+/// </summary>
+class HeightField : public HeightQuery
+{
+protected:
+	unsigned int width;
+	unsigned int length;
+	/// World position of grid point (0, 0)
+	float originX;
+	float originZ;
+
+	/// Row major heights, row i holds the points with z = originZ + i
+	std::vector<float> heights;
+
+public:
+	HeightField();
+	/// Create a grid of zero heights
+	HeightField(unsigned int width, unsigned int length, float originX, float originZ);
+
+	/// Height of the terrain at world position x, z, positions outside of the grid are clamped to its edge
+	float Get(float x, float z) const override;
+
+	/// Height of grid point in row i, column j
+	float at(unsigned int i, unsigned int j) const { return heights[i * width + j]; }
+	/// Row major height storage, used to fill the grid
+	float* data() { return heights.data(); }
+	const float* data() const { return heights.data(); }
+
+	unsigned int getWidth() const;
+	unsigned int getLength() const;
+	/// World position of grid point (0, 0)
+	float getOriginX() const;
+	float getOriginZ() const;
+};
+
+#endif
@@ -0,0 +1,202 @@
+/*
+*	Height and normal textures of the terrain
+*/
+
+#include "heightmap.h"
+#include "heighttree.h"
+
+#include <algorithm>
+#include <limits>
+#include <glm/gtc/matrix_transform.hpp>
+
+HeightMap::HeightMap(unsigned int width, unsigned int length, const glm::vec2& origin, const Perlin& perlin)
+	: width(width), length(length), origin(origin), heights(0), normals(0), sun(0), sunDirection(0.0f)
+{
+	if (width < 2 || length < 2)
+		throw std::runtime_error("Height map needs at least 2 x 2 grid points");
+
+	glGenTextures(1, &heights);
+	glGenTextures(1, &normals);
+	for (GLuint texture : { heights, normals })
+	{
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	generate(perlin);
+}
+
+HeightMap::~HeightMap()
+{
+	glDeleteTextures(1, &heights);
+	glDeleteTextures(1, &normals);
+	if (sun != 0)
+		glDeleteTextures(1, &sun);
+}
+
+void HeightMap::bakeSun(const glm::vec3& direction)
+{
+	bool allocate = sun == 0;
+	if (allocate)
+	{
+		glGenTextures(1, &sun);
+		glBindTexture(GL_TEXTURE_2D, sun);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+	sunDirection = glm::normalize(direction);
+	bake({ 0, 0, length, width }, allocate);
+}
+
+TerrainGrid::Region HeightMap::editHeights(const glm::vec2& low, const glm::vec2& high, const std::function<float(float x, float z, float height)>& edit)
+{
+	glm::vec2 first = glm::max(glm::ceil(low - origin), 0.0f);
+	glm::vec2 last = glm::min(glm::floor(high - origin) + 1.0f, glm::vec2(width, length));
+	if (last.x <= first.x || last.y <= first.y)
+		return { 0, 0, 0, 0 };
+
+	TerrainGrid::Region edited = { unsigned(first.y), unsigned(first.x), unsigned(last.y), unsigned(last.x) };
+	float* data = heightField.data();
+	for (unsigned int i = edited.i0; i < edited.i1; ++i)
+	{
+		for (unsigned int j = edited.j0; j < edited.j1; ++j)
+		{
+			data[i * width + j] = edit(origin.x + j, origin.y + i, data[i * width + j]);
+		}
+	}
+
+	// Normals of the neighbours of edited points depend on the new heights too
+	TerrainGrid::Region dirty = { edited.i0 > 0 ? edited.i0 - 1 : 0, edited.j0 > 0 ? edited.j0 - 1 : 0, std::min(edited.i1 + 1, length), std::min(edited.j1 + 1, width) };
+	unsigned int columns = dirty.j1 - dirty.j0;
+	unsigned int rows = dirty.i1 - dirty.i0;
+	std::vector<glm::vec3> dirtyNormals;
+	dirtyNormals.reserve(size_t(columns) * rows);
+	for (unsigned int i = dirty.i0; i < dirty.i1; ++i)
+	{
+		for (unsigned int j = dirty.j0; j < dirty.j1; ++j)
+		{
+			dirtyNormals.push_back(heightNormal(i, j));
+		}
+	}
+
+	// Heights are read straight from the field, the unpack row length skips the columns outside the region
+	glBindTexture(GL_TEXTURE_2D, heights);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, dirty.j0, dirty.i0, columns, rows, GL_RED, GL_FLOAT, data + size_t(dirty.i0) * width + dirty.j0);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glBindTexture(GL_TEXTURE_2D, normals);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, dirty.j0, dirty.i0, columns, rows, GL_RGB, GL_FLOAT, dirtyNormals.data());
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (sun != 0)
+	{
+		// Shadow rays leaving towards the sun from behind the edit can cross it until they climb above the highest point,
+		// so the dirty region is stretched away from the sun by the horizontal distance they cover meanwhile
+		TerrainGrid::Region shaded = { 0, 0, length, width };
+		glm::vec2 toSun(sunDirection.x, sunDirection.z);
+		if (sunDirection.y > 0.0f)
+		{
+			auto range = std::minmax_element(data, data + size_t(width) * length);
+			glm::vec2 reach = toSun * ((*range.second - *range.first) / sunDirection.y);
+			glm::vec2 lowest = glm::min(glm::vec2(dirty.j0, dirty.i0) - reach, glm::vec2(dirty.j0, dirty.i0));
+			glm::vec2 highest = glm::max(glm::vec2(dirty.j1, dirty.i1) - reach, glm::vec2(dirty.j1, dirty.i1));
+			lowest = glm::max(glm::floor(lowest), 0.0f);
+			highest = glm::min(glm::ceil(highest), glm::vec2(width, length));
+			shaded = { unsigned(lowest.y), unsigned(lowest.x), unsigned(highest.y), unsigned(highest.x) };
+		}
+		bake(shaded, false);
+	}
+	return dirty;
+}
+
+void HeightMap::bake(const TerrainGrid::Region& region, bool allocate)
+{
+	// Shadow rays start just above the surface so they don't hit the cell they leave from
+	const float SHADOW_BIAS = 0.05f;
+	HeightTree tree(heightField);
+	unsigned int columns = region.j1 - region.j0;
+	std::vector<uint8_t> factors(size_t(columns) * (region.i1 - region.i0));
+
+	ThreadPool::shared().parallelFor(region.i0, region.i1, TerrainGrid::TILE_ROWS, [&](unsigned int first, unsigned int last)
+	{
+		for (unsigned int i = first; i < last; ++i)
+		{
+			for (unsigned int j = region.j0; j < region.j1; ++j)
+			{
+				float factor = glm::max(glm::dot(heightNormal(i, j), sunDirection), 0.0f);
+
+				glm::vec3 point(origin.x + j, heightField.at(i, j) + SHADOW_BIAS, origin.y + i);
+				float t;
+				if (factor > 0.0f && tree.raycast(point, sunDirection, std::numeric_limits<float>::infinity(), t))
+					factor = 0.0f;
+				factors[size_t(i - region.i0) * columns + (j - region.j0)] = uint8_t(factor * 255.0f + 0.5f);
+			}
+		}
+	});
+
+	glBindTexture(GL_TEXTURE_2D, sun);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (allocate)
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, length, 0, GL_RED, GL_UNSIGNED_BYTE, factors.data());
+	else
+		glTexSubImage2D(GL_TEXTURE_2D, 0, region.j0, region.i0, columns, region.i1 - region.i0, GL_RED, GL_UNSIGNED_BYTE, factors.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+glm::vec3 HeightMap::heightNormal(unsigned int i, unsigned int j) const
+{
+	unsigned int jl = j > 0 ? j - 1 : j;
+	unsigned int jr = std::min(j + 1, width - 1);
+	unsigned int il = i > 0 ? i - 1 : i;
+	unsigned int ir = std::min(i + 1, length - 1);
+	float dhdx = (heightField.at(i, jr) - heightField.at(i, jl)) / float(jr - jl);
+	float dhdz = (heightField.at(ir, j) - heightField.at(il, j)) / float(ir - il);
+	return glm::normalize(glm::vec3(-dhdx, 1.0f, -dhdz));
+}
+
+void HeightMap::generate(const Perlin& perlin)
+{
+	// Only heights and normals are needed, positions are rebuilt in phong.vert
+	TerrainGrid grid(width, length, origin, perlin, true, false);
+	grid.generate(ThreadPool::shared());
+	heightField = std::move(grid.heightField);
+
+	glBindTexture(GL_TEXTURE_2D, heights);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, length, 0, GL_RED, GL_FLOAT, heightField.data());
+	glBindTexture(GL_TEXTURE_2D, normals);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, width, length, 0, GL_RGB, GL_FLOAT, grid.normals.data());
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+GLuint HeightMap::heightTexture() const
+{
+	return heights;
+}
+
+GLuint HeightMap::normalTexture() const
+{
+	return normals;
+}
+
+const HeightField& HeightMap::getHeightField() const
+{
+	return heightField;
+}
+
+glm::dmat4 HeightMap::model() const
+{
+	return glm::translate(glm::dmat4(1.0), glm::dvec3(origin.x, 0.0, origin.y));
+}
+
+GLuint HeightMap::sunTexture() const
+{
+	return sun;
+}
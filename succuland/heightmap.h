@@ -0,0 +1,71 @@
+#pragma once
+
+#ifndef _HEIGHTMAP_H
+#define _HEIGHTMAP_H
+
+#include "pgr.h"
+#include "terrain.h"
+
+/// <summary>
+/// Terrain heights and normals stored as textures for displacement in the vertex stage, texel (j, i) lies at
+/// origin + (j, i). A HeightField with the same heights answers queries on the CPU
+/// </summary>
+class HeightMap
+{
+public:
+	const unsigned int width;
+	const unsigned int length;
+	const glm::vec2 origin;
+
+	/// Generate the heights and normals from the noise and upload them
+	HeightMap(unsigned int width, unsigned int length, const glm::vec2& origin, const Perlin& perlin);
+	~HeightMap();
+
+	HeightMap(const HeightMap&) = delete;
+	HeightMap& operator=(const HeightMap&) = delete;
+
+	/// R32F texture of the heights
+	GLuint heightTexture() const;
+	/// RGB32F texture of the normals
+	GLuint normalTexture() const;
+	/// Heights of the grid points
+	const HeightField& getHeightField() const;
+	/// <summary>
+	/// Change the heights inside a rectangle, e.g. to stamp a crater, and upload only the changed texels.
+	/// Normals of the changed texels follow from the height differences, a baked sun is baked again where the edit can shade it
+	/// </summary>
+	/// <param name="low">Lower x, z corner of the rectangle in world space</param>
+	/// <param name="high">Upper x, z corner of the rectangle in world space</param>
+	/// <param name="edit">New height of a grid point from its world x, z and current height</param>
+	/// <returns>Grid points whose heights or normals changed</returns>
+	TerrainGrid::Region editHeights(const glm::vec2& low, const glm::vec2& high, const std::function<float(float x, float z, float height)>& edit);
+	/// Model matrix of the map, terrain drawn from the textures is placed relative to the map origin
+	glm::dmat4 model() const;
+
+	/// <summary>
+	/// Precompute the sun diffuse factor of every texel so shading the terrain takes one fetch for the sun.
+	/// Texels the terrain shadows from the sun get none, regenerating the map bakes the new terrain again
+	/// </summary>
+	/// <param name="direction">Direction towards the sun</param>
+	void bakeSun(const glm::vec3& direction);
+	/// R8 texture of the baked sun diffuse factor, 0 until bakeSun
+	GLuint sunTexture() const;
+
+protected:
+	GLuint heights;
+	GLuint normals;
+	GLuint sun;
+	/// Direction the sun was baked for
+	glm::vec3 sunDirection;
+	HeightField heightField;
+
+	/// Generate the grid and upload it into the textures
+	void generate(const Perlin& perlin);
+	/// Bake the sun factor of the current heights of the grid points in region into the sun texture,
+	/// allocate creates the storage first and needs the whole map as region
+	void bake(const TerrainGrid::Region& region, bool allocate);
+	/// Normal of grid point i, j from the differences of its neighbouring heights, one sided on the map edge
+	glm::vec3 heightNormal(unsigned int i, unsigned int j) const;
+};
+
+#endif
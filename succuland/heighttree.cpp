@@ -0,0 +1,247 @@
+/*
+*	Min/max quadtree over the terrain heights
+*/
+
+#include "heighttree.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+HeightTree::HeightTree(const HeightField& field)
+	: field(field), cellColumns(0), cellRows(0)
+{
+	if (field.getWidth() < 2 || field.getLength() < 2)
+		throw std::runtime_error("Height tree needs at least 2 x 2 grid points");
+	cellColumns = field.getWidth() - 1;
+	cellRows = field.getLength() - 1;
+
+	Level cells = { cellColumns, cellRows, std::vector<glm::vec2>(size_t(cellColumns) * cellRows) };
+	for (unsigned int y = 0; y < cellRows; ++y)
+	{
+		for (unsigned int x = 0; x < cellColumns; ++x)
+		{
+			cells.ranges[size_t(y) * cellColumns + x] = cellRange(x, y);
+		}
+	}
+	levels.push_back(std::move(cells));
+
+	// Odd node counts leave the last parent with fewer children
+	while (levels.back().columns > 1 || levels.back().rows > 1)
+	{
+		unsigned int columns = (levels.back().columns + 1) / 2;
+		unsigned int rows = (levels.back().rows + 1) / 2;
+		levels.push_back({ columns, rows, std::vector<glm::vec2>(size_t(columns) * rows) });
+		unsigned int top = (unsigned int)levels.size() - 1;
+		for (unsigned int y = 0; y < rows; ++y)
+		{
+			for (unsigned int x = 0; x < columns; ++x)
+			{
+				levels[top].ranges[size_t(y) * columns + x] = mergeChildren(top, x, y);
+			}
+		}
+	}
+}
+
+void HeightTree::update(unsigned int i0, unsigned int j0, unsigned int i1, unsigned int j1)
+{
+	// Cells touching the changed points, the nodes above them cover a shrinking rectangle on every level
+	unsigned int x0 = j0 > 0 ? j0 - 1 : 0;
+	unsigned int y0 = i0 > 0 ? i0 - 1 : 0;
+	unsigned int x1 = std::min(j1, cellColumns);
+	unsigned int y1 = std::min(i1, cellRows);
+	if (x0 >= x1 || y0 >= y1)
+		return;
+
+	for (unsigned int y = y0; y < y1; ++y)
+	{
+		for (unsigned int x = x0; x < x1; ++x)
+		{
+			levels[0].ranges[size_t(y) * cellColumns + x] = cellRange(x, y);
+		}
+	}
+	for (unsigned int level = 1; level < levels.size(); ++level)
+	{
+		x0 /= 2;
+		y0 /= 2;
+		x1 = (x1 + 1) / 2;
+		y1 = (y1 + 1) / 2;
+		for (unsigned int y = y0; y < y1; ++y)
+		{
+			for (unsigned int x = x0; x < x1; ++x)
+			{
+				levels[level].ranges[size_t(y) * levels[level].columns + x] = mergeChildren(level, x, y);
+			}
+		}
+	}
+}
+
+glm::vec2 HeightTree::cellRange(unsigned int x, unsigned int y) const
+{
+	float h00 = field.at(y, x);
+	float h01 = field.at(y, x + 1);
+	float h10 = field.at(y + 1, x);
+	float h11 = field.at(y + 1, x + 1);
+	return glm::vec2(std::min({ h00, h01, h10, h11 }), std::max({ h00, h01, h10, h11 }));
+}
+
+glm::vec2 HeightTree::mergeChildren(unsigned int level, unsigned int x, unsigned int y) const
+{
+	const Level& below = levels[level - 1];
+	glm::vec2 range = below.ranges[size_t(2 * y) * below.columns + 2 * x];
+	for (unsigned int cy = 2 * y; cy < std::min(2 * y + 2, below.rows); ++cy)
+	{
+		for (unsigned int cx = 2 * x; cx < std::min(2 * x + 2, below.columns); ++cx)
+		{
+			const glm::vec2& child = below.ranges[size_t(cy) * below.columns + cx];
+			range = glm::vec2(std::min(range.x, child.x), std::max(range.y, child.y));
+		}
+	}
+	return range;
+}
+
+bool HeightTree::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxT, float& t, float clearance) const
+{
+	Ray ray = { origin, direction, clearance };
+	unsigned int root = (unsigned int)levels.size() - 1;
+	glm::vec3 low, high;
+	nodeBounds(root, 0, 0, clearance, low, high);
+	float t0 = 0.0f;
+	float t1 = maxT;
+	return clip(ray, low, high, t0, t1) && castNode(ray, root, 0, 0, t0, t1, t);
+}
+
+bool HeightTree::sweep(const glm::vec3& from, const glm::vec3& to, float clearance, glm::vec3& stop) const
+{
+	float t;
+	if (!raycast(from, to - from, 1.0f, t, clearance))
+	{
+		stop = to;
+		return false;
+	}
+	stop = from + t * (to - from);
+	return true;
+}
+
+bool HeightTree::lineOfSight(const glm::vec3& from, const glm::vec3& to) const
+{
+	float t;
+	return !raycast(from, to - from, 1.0f, t);
+}
+
+bool HeightTree::clip(const Ray& ray, const glm::vec3& low, const glm::vec3& high, float& t0, float& t1)
+{
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		// Rays parallel to a slab either stay inside it or miss the box
+		if (ray.direction[axis] == 0.0f)
+		{
+			if (ray.origin[axis] < low[axis] || ray.origin[axis] > high[axis])
+				return false;
+			continue;
+		}
+		float inverse = 1.0f / ray.direction[axis];
+		float entry = (low[axis] - ray.origin[axis]) * inverse;
+		float leave = (high[axis] - ray.origin[axis]) * inverse;
+		if (entry > leave)
+			std::swap(entry, leave);
+		t0 = std::max(t0, entry);
+		t1 = std::min(t1, leave);
+		if (t0 > t1)
+			return false;
+	}
+	return true;
+}
+
+void HeightTree::nodeBounds(unsigned int level, unsigned int x, unsigned int y, float clearance, glm::vec3& low, glm::vec3& high) const
+{
+	unsigned int size = 1u << level;
+	const glm::vec2& range = levels[level].ranges[size_t(y) * levels[level].columns + x];
+	low = glm::vec3(field.getOriginX() + x * size, range.x + clearance, field.getOriginZ() + y * size);
+	high = glm::vec3(field.getOriginX() + std::min((x + 1) * size, cellColumns), range.y + clearance, field.getOriginZ() + std::min((y + 1) * size, cellRows));
+}
+
+bool HeightTree::castNode(const Ray& ray, unsigned int level, unsigned int x, unsigned int y, float t0, float t1, float& t) const
+{
+	if (level == 0)
+		return castCell(ray, x, y, t0, t1, t);
+
+	// Children don't overlap along xz, the one the ray enters first holds the first hit if it has any
+	struct Child
+	{
+		unsigned int x;
+		unsigned int y;
+		float t0;
+		float t1;
+	};
+	Child children[4];
+	int count = 0;
+	const Level& below = levels[level - 1];
+	for (unsigned int cy = 2 * y; cy < std::min(2 * y + 2, below.rows); ++cy)
+	{
+		for (unsigned int cx = 2 * x; cx < std::min(2 * x + 2, below.columns); ++cx)
+		{
+			Child child = { cx, cy, t0, t1 };
+			glm::vec3 low, high;
+			nodeBounds(level - 1, cx, cy, ray.clearance, low, high);
+			if (clip(ray, low, high, child.t0, child.t1))
+				children[count++] = child;
+		}
+	}
+	std::sort(children, children + count, [](const Child& a, const Child& b) { return a.t0 < b.t0; });
+
+	for (int k = 0; k < count; ++k)
+	{
+		if (castNode(ray, level - 1, children[k].x, children[k].y, children[k].t0, children[k].t1, t))
+			return true;
+	}
+	return false;
+}
+
+bool HeightTree::castCell(const Ray& ray, unsigned int x, unsigned int y, float t0, float t1, float& t) const
+{
+	float h00 = field.at(y, x) + ray.clearance;
+	float h01 = field.at(y, x + 1) + ray.clearance;
+	float h10 = field.at(y + 1, x) + ray.clearance;
+	float h11 = field.at(y + 1, x + 1) + ray.clearance;
+
+	// Ray position relative to the cell corner, fx + fz = 1 is the diagonal between the two triangles
+	float fx0 = ray.origin.x - (field.getOriginX() + x);
+	float fz0 = ray.origin.z - (field.getOriginZ() + y);
+	auto above = [&](float s, bool lower)
+	{
+		float fx = fx0 + s * ray.direction.x;
+		float fz = fz0 + s * ray.direction.z;
+		float surface = lower ? h00 + fx * (h01 - h00) + fz * (h10 - h00) : h11 + (1.0f - fx) * (h10 - h11) + (1.0f - fz) * (h01 - h11);
+		return ray.origin.y + s * ray.direction.y - surface;
+	};
+
+	float pieces[3] = { t0, t1, t1 };
+	int count = 1;
+	float slope = ray.direction.x + ray.direction.z;
+	if (slope != 0.0f)
+	{
+		float diagonal = (1.0f - fx0 - fz0) / slope;
+		if (diagonal > t0 && diagonal < t1)
+		{
+			pieces[1] = diagonal;
+			count = 2;
+		}
+	}
+
+	// Height over each triangle is linear along the ray, a sign change from above to below is the hit
+	for (int k = 0; k < count; ++k)
+	{
+		float p = pieces[k];
+		float q = pieces[k + 1];
+		float m = 0.5f * (p + q);
+		bool lower = fx0 + m * ray.direction.x + fz0 + m * ray.direction.z <= 1.0f;
+		float fp = above(p, lower);
+		float fq = above(q, lower);
+		if (fp >= 0.0f && fq < 0.0f)
+		{
+			t = p + (q - p) * fp / (fp - fq);
+			return true;
+		}
+	}
+	return false;
+}
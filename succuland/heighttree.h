@@ -0,0 +1,85 @@
+#pragma once
+
+#ifndef _HEIGHTTREE_H
+#define _HEIGHTTREE_H
+
+#include "heightfield.h"
+
+#include <vector>
+#include <glm/glm.hpp>
+
+/// <summary>
+/// Min/max quadtree over the cells of a height field for ray queries, GL free. Level 0 holds the height range
+/// of every cell, each further level merges 2 x 2 nodes of the one below. Rays only descend into nodes whose
+/// bounds they cross, so a query visits the cells near the ray instead of marching the whole grid.
+/// The surface is the same triangle pair per cell HeightField::Get interpolates, the field has to outlive the tree
+/// </summary>
+class HeightTree
+{
+public:
+	explicit HeightTree(const HeightField& field);
+
+	/// <summary>
+	/// Find the first point where a ray passes from above the surface to below it
+	/// </summary>
+	/// <param name="origin">Ray start in world space</param>
+	/// <param name="direction">Ray direction, points of the ray are origin + t * direction</param>
+	/// <param name="maxT">Largest t tested</param>
+	/// <param name="t">Ray parameter of the hit</param>
+	/// <param name="clearance">Height the surface is raised by</param>
+	/// <returns>Whether the ray hits the surface over the grid within maxT, rays entering under the grid edge don't hit it</returns>
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxT, float& t, float clearance = 0.0f) const;
+
+	/// <summary>
+	/// Move a point along the segment from, to until it comes within clearance of the surface
+	/// </summary>
+	/// <param name="stop">Furthest reachable point, to when nothing is in the way</param>
+	/// <returns>Whether the surface blocks the segment</returns>
+	bool sweep(const glm::vec3& from, const glm::vec3& to, float clearance, glm::vec3& stop) const;
+
+	/// Whether the terrain doesn't block the segment between two points
+	bool lineOfSight(const glm::vec3& from, const glm::vec3& to) const;
+
+	/// Refit the nodes over grid points in rows [i0, i1) and columns [j0, j1) after their heights changed
+	void update(unsigned int i0, unsigned int j0, unsigned int i1, unsigned int j1);
+
+protected:
+	/// Height ranges of the nodes of one level, row major
+	struct Level
+	{
+		unsigned int columns;
+		unsigned int rows;
+		std::vector<glm::vec2> ranges;
+	};
+
+	const HeightField& field;
+	/// Cells along x and z
+	unsigned int cellColumns;
+	unsigned int cellRows;
+	/// Levels from single cells up to the root node
+	std::vector<Level> levels;
+
+	/// Ray being cast, passed down the node recursion
+	struct Ray
+	{
+		glm::vec3 origin;
+		glm::vec3 direction;
+		float clearance;
+	};
+
+	/// Height range of node x, y of a level from its children
+	glm::vec2 mergeChildren(unsigned int level, unsigned int x, unsigned int y) const;
+	/// Height range of cell x, y
+	glm::vec2 cellRange(unsigned int x, unsigned int y) const;
+
+	/// Clip the ray parameter range [t0, t1] to the box, false if nothing is left
+	static bool clip(const Ray& ray, const glm::vec3& low, const glm::vec3& high, float& t0, float& t1);
+	/// Bounds of node x, y of a level
+	void nodeBounds(unsigned int level, unsigned int x, unsigned int y, float clearance, glm::vec3& low, glm::vec3& high) const;
+	/// First hit inside node x, y over ray parameters [t0, t1], already clipped to the node bounds
+	bool castNode(const Ray& ray, unsigned int level, unsigned int x, unsigned int y, float t0, float t1, float& t) const;
+	/// First hit on the two triangles of cell x, y over ray parameters [t0, t1], already clipped to the cell bounds
+	bool castCell(const Ray& ray, unsigned int x, unsigned int y, float t0, float t1, float& t) const;
+};
+
+#endif
@@ -6,6 +6,11 @@
 #include "data.h"
 #include "shader.h"
 #include "geometry.h"
+#include "terrainstream.h"
+#include "terrainlod.h"
+#include "terrainpatches.h"
+#include "terraintess.h"
+#include "virtualtexture.h"
 #include "camera.h"
 #include "object.h"
 #include "properties.h"
@@ -13,6 +18,8 @@
 
 #include <chrono>
 #include <fstream>
+#include <random>
+#include <limits>
 #include <glm/ext.hpp>
 
 namespace warreign 
@@ -29,6 +36,8 @@ Shader* skyboxShader;
 Shader* bannerShader;
 Shader* particleShader;
 LightingShader* lightingShader;
+LightingShader* terrainShader = nullptr;
+ComputeShader* terrainGenerator = nullptr;
 
 // Meshes
 Mesh* cubeGeometry;
@@ -36,7 +45,18 @@ Mesh* skyboxGeometry;
 Mesh* lightCubeGeometry;
 Mesh* bannerGeometry;
 Mesh* particleGeometry;
-TerrainMesh* terrainMesh;
+TerrainMesh* terrainMesh = nullptr;
+TerrainStreamer* terrainStreamer = nullptr;
+TerrainLOD* terrainLOD = nullptr;
+TerrainPatches* terrainPatches = nullptr;
+TerrainTessellation* terrainTessellation = nullptr;
+DecimatedTerrainMesh* terrainDecimated = nullptr;
+/// Ray queries over the terrain heights, not built for the edgeless streamed terrain
+HeightTree* groundTree = nullptr;
+/// Object of the terrain meshes drawn through objects
+ObjectInstance* terrainObject = nullptr;
+/// Virtual texture of the terrain material, not used by the edgeless streamed terrain
+VirtualTexture* terrainTexture = nullptr;
 OBJMesh* cactusGeometry;
 OBJMesh* arrowMesh;
 
@@ -45,6 +65,7 @@ Material* brick;
 Material* grass;
 MaterialMap* sand;
 MaterialMap* brickMap;
+VirtualMaterial* terrainMaterial = nullptr;
 
 // Light Properties
 PointLight* bulbProperties;
@@ -89,6 +110,21 @@ void arrowAnimationTimerCallback(int)
 	glutTimerFunc(REFRESH_TIME, arrowAnimationTimerCallback, 0);
 }
 
+/// Draw the terrain into the virtual texture feedback target, the pages it asks for are streamed in over the next frames
+void terrainFeedback(const Camera& camera)
+{
+	terrainTexture->beginFeedback();
+	if (terrainObject != nullptr)
+		terrainObject->draw(camera);
+	if (terrainLOD != nullptr)
+		terrainLOD->draw(camera);
+	if (terrainPatches != nullptr)
+		terrainPatches->draw(camera);
+	if (terrainTessellation != nullptr)
+		terrainTessellation->draw(camera);
+	terrainTexture->endFeedback();
+}
+
 void displayCallback()
 {
 	lightingShader->resetLights();
@@ -123,6 +159,22 @@ void displayCallback()
 	}
 	glStencilFunc(GL_ALWAYS, 0, -1);
 
+	if (terrainMesh != nullptr)
+		terrainMesh->cull(currentCamera.frustum());
+	if (terrainTexture != nullptr)
+		terrainFeedback(currentCamera);
+	if (terrainStreamer != nullptr)
+	{
+		terrainStreamer->stream(currentCamera.position);
+		terrainStreamer->draw(currentCamera);
+	}
+	if (terrainLOD != nullptr)
+		terrainLOD->draw(currentCamera);
+	if (terrainPatches != nullptr)
+		terrainPatches->draw(currentCamera);
+	if (terrainTessellation != nullptr)
+		terrainTessellation->draw(currentCamera);
+
 	for (const auto& o : objects)
 		o->draw(currentCamera);
 
@@ -154,6 +206,21 @@ void initShaders()
 	lightSourceShader = new Shader("shaders/light.vert", "shaders/light.frag");
 	bannerShader = new Shader("shaders/banner.vert", "shaders/banner.frag");
 	particleShader = new Shader("shaders/particle.vert", "shaders/particle.frag");
+	if (TERRAIN_RENDERER == TERRAIN_RENDERER_TESSELLATION)
+		terrainShader = new LightingShader("shaders/terrain.vert", "shaders/terrain.tesc", "shaders/terrain.tese", "shaders/phong.frag");
+
+	if (TERRAIN_GPU_GENERATION)
+	{
+		try
+		{
+			terrainGenerator = new ComputeShader("shaders/terrain.comp");
+		}
+		catch (const std::runtime_error& e)
+		{
+			std::cerr << "WARNING: " << e.what() << ", terrain will be generated on the CPU" << std::endl;
+			terrainGenerator = nullptr;
+		}
+	}
 }
 
 /// <summary>
@@ -163,20 +230,27 @@ void initShaders()
 /// <param name="count">Number of cacti</param>
 /// <param name="width">Width of area around 0.0</param>
 /// <param name="length">Length of area around 0.0</param>
-/// <param name="perlin">Perlin noise function for height</param>
-void genCacti(uint32_t count, const Perlin& perlin, uint32_t width, uint32_t length) 
+/// <param name="ground">Heights of the terrain</param>
+void genCacti(uint32_t count, const HeightQuery& ground, uint32_t width, uint32_t length) 
 {
-	if (count > 255) {
+	if (count >= Arrow::TERRAIN_IDX) {
 		throw std::runtime_error("Exceeded maximum number of cacti");
 	}
-	srand(SEED);
+	std::mt19937 random((uint32_t)SEED);
 
+	std::vector<float> xs(count), zs(count), ys(count), angles(count);
 	for (int i = 0; i < count; ++i)
 	{
-		float x = -(width / 2.0f) + (rand() % width);
-		float z = -(length / 2.0f) + (rand() % length);
-		glm::mat4 translate = glm::translate(glm::vec3(x, perlin(x,z), z));
-		glm::mat4 rotate = glm::rotate( glm::radians(float(rand() % 360)), glm::vec3(0.0f, 1.0f, 0.0f));
+		xs[i] = -(width / 2.0f) + (random() % width);
+		zs[i] = -(length / 2.0f) + (random() % length);
+		angles[i] = float(random() % 360);
+	}
+	ground.GetBatch(xs.data(), zs.data(), ys.data(), count);
+
+	for (int i = 0; i < count; ++i)
+	{
+		glm::mat4 translate = glm::translate(glm::vec3(xs[i], ys[i], zs[i]));
+		glm::mat4 rotate = glm::rotate( glm::radians(angles[i]), glm::vec3(0.0f, 1.0f, 0.0f));
 		glm::mat4 scale = glm::scale(glm::vec3(CACTUS_SCALE));
 		cacti.push_back(new ObjectInstance(cactusGeometry, translate * rotate * scale));
 	}
@@ -193,17 +267,79 @@ void initData()
 	brick = new MaterialMap(glm::vec3(0.1f), glm::vec3(0.8f), glm::vec3(0.8f), 256.0, "textures/wall.jpg");
 	sand = new MaterialMap(glm::vec3(0.05f, 0.05f, 0.0f), glm::vec3(0.81f, 0.81f, 0.8f), glm::vec3(0.05f, 0.05f, 0.05f), 23.0f, "textures/sand/diffuse.jpg", "textures/sand/specular.png");
 
+	// The sand tiles are varied by noise into a texture that doesn't repeat over the whole terrain
+	Material* terrainSurface = sand;
+	if (TERRAIN_VIRTUAL_TEXTURE && TERRAIN_RENDERER != TERRAIN_RENDERER_STREAMING)
+	{
+		glm::vec2 corner(-(TERRAIN_WIDTH / 2.0f), -(TERRAIN_LENGTH / 2.0f));
+		MaterialPages pages(sand->diffuseMap, TerrainGrid::TEX_SPACING, Perlin(3, 0.02f, 1.0f, (int)SEED + 2));
+		terrainTexture = new VirtualTexture(corner, glm::vec2(TERRAIN_WIDTH - 1, TERRAIN_LENGTH - 1), TERRAIN_VIRTUAL_PAGES, TERRAIN_VIRTUAL_SLOTS, pages);
+		terrainMaterial = new VirtualMaterial(sand->ambient, sand->diffuse, sand->specular, sand->shininess, terrainTexture, sand->specularMap);
+		terrainSurface = terrainMaterial;
+	}
+
 	skyboxGeometry = new Mesh(skyboxVertices, nullptr, 12, 8, skyboxShader, 0);
 	lightCubeGeometry = new Mesh(vertices, indices, 12, 8, lightSourceShader, NORMAL_BIT);
 	bannerGeometry = new Mesh(bannerVertices, nullptr, 2, 4, bannerShader, TEXTURE_BIT);
 	arrowMesh = new OBJMesh(ARROW_OBJ_PATH, lightingShader);
 	particleGeometry = new Mesh(particleSpriteVertices, nullptr, 2, 4, particleShader, TEXTURE_BIT);
 
-	terrainMesh = new TerrainMesh(TERRAIN_WIDTH, TERRAIN_LENGTH, 0.0, SEED, lightingShader, sand, NORMAL_BIT | TEXTURE_BIT);
-	objects.push_back(new ObjectInstance(terrainMesh, glm::scale(glm::vec3(1.0))));
+	glm::vec3 cameraStart(0.0f, 10.0f, 0.0f);
+	const HeightQuery* ground;
+	const HeightField* groundField = nullptr;
+	if (TERRAIN_RENDERER == TERRAIN_RENDERER_STREAMING)
+	{
+		// Only the chunks in view of the starting position are generated before the first frame
+		terrainStreamer = new TerrainStreamer(TerrainMesh::noise(SEED, TERRAIN_NOISE_BACKEND), FAR_PLANE, lightingShader, sand, NORMAL_BIT | TEXTURE_BIT | COMPACT_BIT);
+		terrainStreamer->loadAround(cameraStart);
+		ground = terrainStreamer;
+	}
+	else if (TERRAIN_RENDERER == TERRAIN_RENDERER_LOD)
+	{
+		terrainLOD = new TerrainLOD(TERRAIN_WIDTH, TERRAIN_LENGTH, TerrainMesh::noise(SEED, TERRAIN_NOISE_BACKEND), TERRAIN_LOD_DETAIL_RANGE, FAR_PLANE, lightingShader, terrainSurface);
+		if (TERRAIN_BAKED_SUN)
+			terrainLOD->bakeSun(SUN_DIRECTION);
+		groundField = &terrainLOD->getHeightField();
+		ground = groundField;
+	}
+	else if (TERRAIN_RENDERER == TERRAIN_RENDERER_PATCHES)
+	{
+		terrainPatches = new TerrainPatches(TERRAIN_WIDTH, TERRAIN_LENGTH, TerrainMesh::noise(SEED, TERRAIN_NOISE_BACKEND), FAR_PLANE, lightingShader, terrainSurface);
+		if (TERRAIN_BAKED_SUN)
+			terrainPatches->bakeSun(SUN_DIRECTION);
+		groundField = &terrainPatches->getHeightField();
+		ground = groundField;
+	}
+	else if (TERRAIN_RENDERER == TERRAIN_RENDERER_TESSELLATION)
+	{
+		terrainTessellation = new TerrainTessellation(TERRAIN_WIDTH, TERRAIN_LENGTH, TerrainMesh::noise(SEED, TERRAIN_NOISE_BACKEND), terrainShader, terrainSurface);
+		if (TERRAIN_BAKED_SUN)
+			terrainTessellation->bakeSun(SUN_DIRECTION);
+		groundField = &terrainTessellation->getHeightField();
+		ground = groundField;
+	}
+	else if (TERRAIN_RENDERER == TERRAIN_RENDERER_DECIMATED)
+	{
+		terrainDecimated = new DecimatedTerrainMesh(TERRAIN_WIDTH, TERRAIN_LENGTH, SEED, TERRAIN_DECIMATION_ERROR, lightingShader, terrainSurface, NORMAL_BIT | TEXTURE_BIT, TERRAIN_NOISE_BACKEND);
+		terrainObject = new ObjectInstance(terrainDecimated, terrainDecimated->model());
+		objects.push_back(terrainObject);
+		groundField = &terrainDecimated->getHeightField();
+		ground = groundField;
+	}
+	else
+	{
+		terrainMesh = new TerrainMesh(TERRAIN_WIDTH, TERRAIN_LENGTH, 0.0, SEED, lightingShader, terrainSurface, NORMAL_BIT | TEXTURE_BIT | COMPACT_BIT, TERRAIN_NOISE_BACKEND, terrainGenerator, TERRAIN_CACHE_PATH);
+		terrainObject = new ObjectInstance(terrainMesh, terrainMesh->model());
+		objects.push_back(terrainObject);
+		groundField = &terrainMesh->getHeightField();
+		ground = groundField;
+	}
+
+	if (groundField != nullptr)
+		groundTree = new HeightTree(*groundField);
 
 	cactusGeometry = new OBJMesh(CACTUS_OBJ_PATH, lightingShader);
-	genCacti(CACTUS_COUNT, terrainMesh->getPerlin(), TERRAIN_WIDTH, TERRAIN_LENGTH);
+	genCacti(CACTUS_COUNT, *ground, TERRAIN_WIDTH, TERRAIN_LENGTH);
 
 	bulbProperties = new PointLight(glm::vec3(0.0f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(1.0f));
 	sunProperties = new DirectionalLight(glm::vec3(1.0f), glm::vec3(2.0f), glm::vec3(2.0f));
@@ -222,16 +358,23 @@ void initData()
 	Particle::init(particleGeometry);
 
 	Camera::refreshRate = REFRESH_RATE;
-	camera = Camera(glm::vec3(0.0f, 10.0f, 0.0f), glm::vec3(0.0f, -1.0f, 1.0f), NEAR_PLANE, FAR_PLANE, CAMERA_ANGLE, 50.0f, TERRAIN_WIDTH, TERRAIN_LENGTH, CAMERA_UPPER_BOUNDARY, &terrainMesh->getPerlin());
+	// Streamed terrain has no edge
+	bool edgeless = TERRAIN_RENDERER == TERRAIN_RENDERER_STREAMING;
+	float boundaryWidth = edgeless ? std::numeric_limits<float>::infinity() : TERRAIN_WIDTH;
+	float boundaryLength = edgeless ? std::numeric_limits<float>::infinity() : TERRAIN_LENGTH;
+	camera = Camera(cameraStart, glm::vec3(0.0f, -1.0f, 1.0f), NEAR_PLANE, FAR_PLANE, CAMERA_ANGLE, 50.0f, boundaryWidth, boundaryLength, CAMERA_UPPER_BOUNDARY, ground);
+	camera.setGroundTree(groundTree);
 	camera.makeActive();
 
-	float x = (rand() % TERRAIN_WIDTH) - TERRAIN_WIDTH / 2.0f;
+	// Static cameras use their own stream so their placement doesn't depend on cacti generation
+	std::mt19937 random((uint32_t)SEED + 1);
+	float x = (random() % TERRAIN_WIDTH) - TERRAIN_WIDTH / 2.0f;
 	float y = 20.0f;
-	float z = (rand() % TERRAIN_LENGTH) - TERRAIN_LENGTH / 2.0f;
+	float z = (random() % TERRAIN_LENGTH) - TERRAIN_LENGTH / 2.0f;
 	staticCam1 = Camera(glm::vec3(x, y, z), glm::vec3(-0.45, -0.15, 0.87), NEAR_PLANE, FAR_PLANE, CAMERA_ANGLE);
-	x = (rand() % TERRAIN_WIDTH) - TERRAIN_WIDTH / 2.0f;
+	x = (random() % TERRAIN_WIDTH) - TERRAIN_WIDTH / 2.0f;
 	y = 20.0f;
-	z = (rand() % TERRAIN_LENGTH) - TERRAIN_LENGTH / 2.0f;
+	z = (random() % TERRAIN_LENGTH) - TERRAIN_LENGTH / 2.0f;
 	staticCam2 = Camera(glm::vec3(x, y, z), glm::vec3(-1.0f, -0.5f, 1.0f), NEAR_PLANE, FAR_PLANE, CAMERA_ANGLE);
 }
 
@@ -299,6 +442,21 @@ void keysTimerCallback(int)
 }
 
 
+/// Print how much of the terrain the last frame drew and culled
+void printTerrainStats()
+{
+	if (terrainMesh != nullptr)
+		std::cout << "Terrain blocks drawn: " << terrainMesh->drawnBlocks() << ", culled: " << terrainMesh->culledBlocks() << std::endl;
+	if (terrainStreamer != nullptr)
+		std::cout << "Terrain chunks: " << terrainStreamer->loadedChunks() << ", blocks drawn: " << terrainStreamer->drawnBlocks() << ", culled: " << terrainStreamer->culledBlocks() << std::endl;
+	if (terrainLOD != nullptr)
+		std::cout << "Terrain nodes drawn: " << terrainLOD->drawnNodes() << ", culled: " << terrainLOD->culledNodes() << ", triangles: " << terrainLOD->drawnTriangles() << std::endl;
+	if (terrainPatches != nullptr)
+		std::cout << "Terrain patches drawn: " << terrainPatches->drawnPatches() << ", culled: " << terrainPatches->culledPatches() << std::endl;
+	if (terrainTexture != nullptr)
+		std::cout << "Terrain virtual texture pages resident: " << terrainTexture->residentPages() << std::endl;
+}
+
 void specialCallback(int key, int x, int y)
 {
 	skeys[key] = true;
@@ -317,7 +475,7 @@ void specialCallback(int key, int x, int y)
 		daytime = !daytime;
 		break;
 	case GLUT_KEY_F5:
-		lights.emplace_back(new LightObject(lightCubeGeometry, bulbProperties, lightingShader, glm::translate(Camera::active->position) * glm::scale(glm::vec3(0.2f))));
+		lights.emplace_back(new LightObject(lightCubeGeometry, bulbProperties, lightingShader, glm::translate(Camera::active->position) * glm::scale(glm::dvec3(0.2))));
 		break;
 	case GLUT_KEY_F11:
 		glutFullScreenToggle();
@@ -328,6 +486,9 @@ void specialCallback(int key, int x, int y)
 		else
 			Camera::refreshRate = 60;
 		break;
+	case GLUT_KEY_F8:
+		printTerrainStats();
+		break;
 	}
 }
 
@@ -352,11 +513,77 @@ void keyboardUpCallback(unsigned char key, int x, int y)
 	keys[key] = false;
 }
 
+/// <summary>
+/// Cast a ray from the active camera through a window pixel onto the terrain
+/// </summary>
+/// <param name="x">Window x coordinate</param>
+/// <param name="y">Window y coordinate, from the top</param>
+/// <param name="point">Picked terrain point</param>
+/// <returns>Whether the ray hits the terrain before the far plane</returns>
+bool pickTerrain(int x, int y, glm::vec3& point)
+{
+	if (groundTree == nullptr)
+		return false;
+
+	const Camera& currentCamera = *Camera::active;
+	// The view only rotates, the ray is unprojected relative to the camera and then moved to its position
+	glm::mat4 inverse = glm::inverse(currentCamera.projectMatrix() * currentCamera.viewMatrix());
+	glm::vec2 ndc(2.0f * (x + 0.5f) / GLUT_WIDTH - 1.0f, 1.0f - 2.0f * (y + 0.5f) / GLUT_HEIGHT);
+	glm::vec4 nearPoint = inverse * glm::vec4(ndc, -1.0f, 1.0f);
+	glm::vec4 farPoint = inverse * glm::vec4(ndc, 1.0f, 1.0f);
+	glm::vec3 direction = glm::vec3(farPoint) / farPoint.w - glm::vec3(nearPoint) / nearPoint.w;
+	glm::vec3 origin = glm::vec3(currentCamera.position + glm::dvec3(glm::vec3(nearPoint) / nearPoint.w));
+
+	float t;
+	if (!groundTree->raycast(origin, direction, 1.0f, t))
+		return false;
+	point = origin + t * direction;
+	return true;
+}
+
+/// Sink a bowl shaped crater into the terrain around a point, only the touched rows or texels are uploaded again.
+/// The streamed and the decimated terrain can't be edited
+void stampCrater(const glm::vec3& center, float radius, float depth)
+{
+	glm::vec2 middle(center.x, center.z);
+	auto crater = [=](float x, float z, float height)
+	{
+		float d = glm::distance(glm::vec2(x, z), middle) / radius;
+		float falloff = glm::max(1.0f - d * d, 0.0f);
+		return height - depth * falloff * falloff;
+	};
+
+	TerrainGrid::Region changed;
+	if (terrainLOD != nullptr)
+		changed = terrainLOD->editHeights(middle - radius, middle + radius, crater);
+	else if (terrainPatches != nullptr)
+		changed = terrainPatches->editHeights(middle - radius, middle + radius, crater);
+	else if (terrainTessellation != nullptr)
+		changed = terrainTessellation->editHeights(middle - radius, middle + radius, crater);
+	else
+		changed = terrainMesh->editHeights(middle - radius, middle + radius, crater);
+	if (groundTree != nullptr)
+		groundTree->update(changed.i0, changed.j0, changed.i1, changed.j1);
+}
+
 void mouseCallback(int button, int state, int x, int y)
 {
 	if (state != GLUT_DOWN)
 		return;
 
+	glm::vec3 point;
+	// The right button belongs to the menu, craters are stamped with the middle one
+	if (button == GLUT_MIDDLE_BUTTON)
+	{
+		if (terrainStreamer != nullptr || terrainDecimated != nullptr)
+			std::cout << "INFO: craters can't be stamped into the streamed or the decimated terrain" << std::endl;
+		else if (pickTerrain(x, y, point))
+			stampCrater(point, TERRAIN_CRATER_RADIUS, TERRAIN_CRATER_DEPTH);
+		return;
+	}
+	if (button != GLUT_LEFT_BUTTON)
+		return;
+
 	GLuint idx;
 	glReadPixels(x, glutGet(GLUT_WINDOW_HEIGHT) - y - 1, 1, 1, GL_STENCIL_INDEX, GL_UNSIGNED_INT, &idx);
 
@@ -367,6 +594,16 @@ void mouseCallback(int button, int state, int x, int y)
 		if (arrow->currentIdx == 0)
 			glutTimerFunc(REFRESH_TIME, arrowAnimationTimerCallback, 0);
 		arrow->currentIdx = idx;
+		return;
+	}
+
+	if (pickTerrain(x, y, point))
+	{
+		std::cout << "INFO: picked terrain at " << point.x << " " << point.y << " " << point.z << std::endl;
+		arrow->target = point;
+		if (arrow->currentIdx == 0)
+			glutTimerFunc(REFRESH_TIME, arrowAnimationTimerCallback, 0);
+		arrow->currentIdx = Arrow::TERRAIN_IDX;
 	}
 }
 
@@ -405,11 +642,13 @@ void initApp()
 void cleanup()
 {
 	delete lightingShader;
+	delete terrainShader;
 	delete lightSourceShader;
 	delete commonShader;
 	delete skyboxShader;
 	delete bannerShader;
 	delete particleShader;
+	delete terrainGenerator;
 
 	delete bulbProperties;
 	delete sunProperties;
@@ -426,6 +665,12 @@ void cleanup()
 	delete skyboxGeometry;
 	delete lightCubeGeometry;
 	delete terrainMesh;
+	delete terrainStreamer;
+	delete terrainLOD;
+	delete terrainPatches;
+	delete terrainTessellation;
+	delete terrainDecimated;
+	delete groundTree;
 	delete bannerGeometry;
 	delete particleGeometry;
 
@@ -433,6 +678,8 @@ void cleanup()
 	delete sand;
 	delete brick;
 	delete brickMap;
+	delete terrainMaterial;
+	delete terrainTexture;
 
 	delete daySkybox;
 	for (auto& c : cacti)
@@ -0,0 +1,181 @@
+/*
+*	Vertex cache and vertex fetch optimization
+*/
+
+#include "meshopt.h"
+
+#include <algorithm>
+
+/// FIFO post-transform cache, a vertex is cached while fewer than size vertices were transformed after it
+class FifoCache
+{
+public:
+	FifoCache(unsigned int vertexCount, unsigned int size)
+		: size(size), transformed(0), stamps(vertexCount, 0)
+	{
+	}
+
+	/// Fetch a vertex, returns whether it had to be transformed
+	bool fetch(unsigned int v)
+	{
+		if (stamps[v] != 0 && transformed - stamps[v] < size)
+			return false;
+		stamps[v] = ++transformed;
+		return true;
+	}
+
+	size_t misses() const
+	{
+		return transformed;
+	}
+
+private:
+	const unsigned int size;
+	size_t transformed;
+	/// Transform count just after each vertex was last transformed, 0 for vertices never transformed
+	std::vector<size_t> stamps;
+};
+
+float MeshOptimizer::acmr(const unsigned int* indices, size_t count, unsigned int vertexCount, unsigned int cacheSize)
+{
+	if (count < 3)
+		return 0.0f;
+
+	FifoCache cache(vertexCount, cacheSize);
+	for (size_t k = 0; k < count; ++k)
+	{
+		cache.fetch(indices[k]);
+	}
+	return float(cache.misses()) / float(count / 3);
+}
+
+float MeshOptimizer::stripAcmr(const unsigned int* indices, size_t count, unsigned int vertexCount, unsigned int restartIndex, unsigned int cacheSize)
+{
+	FifoCache cache(vertexCount, cacheSize);
+	size_t triangles = 0;
+	size_t stripLength = 0;
+	for (size_t k = 0; k < count; ++k)
+	{
+		if (indices[k] == restartIndex)
+		{
+			stripLength = 0;
+			continue;
+		}
+		cache.fetch(indices[k]);
+		if (++stripLength >= 3)
+			++triangles;
+	}
+	return triangles > 0 ? float(cache.misses()) / float(triangles) : 0.0f;
+}
+
+void MeshOptimizer::optimizeVertexCache(unsigned int* indices, size_t count, unsigned int vertexCount, unsigned int cacheSize)
+{
+	const size_t triangleCount = count / 3;
+	if (triangleCount == 0)
+		return;
+
+	// Triangles around every vertex, triangles of vertex v are adjacency[first[v], first[v + 1])
+	std::vector<unsigned int> live(vertexCount, 0);
+	for (size_t k = 0; k < 3 * triangleCount; ++k)
+	{
+		++live[indices[k]];
+	}
+	std::vector<size_t> first(vertexCount + 1, 0);
+	for (unsigned int v = 0; v < vertexCount; ++v)
+	{
+		first[v + 1] = first[v] + live[v];
+	}
+	std::vector<size_t> fill(first.begin(), first.end() - 1);
+	std::vector<unsigned int> adjacency(3 * triangleCount);
+	for (size_t k = 0; k < 3 * triangleCount; ++k)
+	{
+		adjacency[fill[indices[k]]++] = (unsigned int)(k / 3);
+	}
+
+	std::vector<unsigned int> output;
+	output.reserve(3 * triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<size_t> stamps(vertexCount, 0);
+	std::vector<unsigned int> deadEnds;
+	std::vector<unsigned int> candidates;
+	size_t time = cacheSize + 1;
+	unsigned int cursor = 0;
+
+	// Fan out from the current vertex, then continue with the candidate staying longest in the cache
+	// that still has triangles left, or with a dead end vertex, or with the next vertex in input order
+	long fan = 0;
+	while (fan >= 0)
+	{
+		candidates.clear();
+		for (size_t a = first[fan]; a < first[fan + 1]; ++a)
+		{
+			unsigned int t = adjacency[a];
+			if (emitted[t])
+				continue;
+			emitted[t] = true;
+			for (unsigned int c = 0; c < 3; ++c)
+			{
+				unsigned int v = indices[3 * t + c];
+				output.push_back(v);
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				--live[v];
+				if (time - stamps[v] > cacheSize)
+					stamps[v] = time++;
+			}
+		}
+
+		long next = -1;
+		size_t best = 0;
+		for (unsigned int v : candidates)
+		{
+			if (live[v] == 0)
+				continue;
+			// Vertices that would drop out of the cache before their triangles are emitted score 0
+			size_t priority = 0;
+			if (time - stamps[v] + 2 * live[v] <= cacheSize)
+				priority = time - stamps[v];
+			if (next < 0 || priority > best)
+			{
+				best = priority;
+				next = v;
+			}
+		}
+		while (next < 0 && !deadEnds.empty())
+		{
+			unsigned int v = deadEnds.back();
+			deadEnds.pop_back();
+			if (live[v] > 0)
+				next = v;
+		}
+		while (next < 0 && cursor < vertexCount)
+		{
+			if (live[cursor] > 0)
+				next = cursor;
+			++cursor;
+		}
+		fan = next;
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+std::vector<unsigned int> MeshOptimizer::optimizeVertexFetch(unsigned int* indices, size_t count, unsigned int vertexCount)
+{
+	const unsigned int unused = ~0u;
+	std::vector<unsigned int> remap(vertexCount, unused);
+	unsigned int next = 0;
+	for (size_t k = 0; k < count; ++k)
+	{
+		unsigned int& v = remap[indices[k]];
+		if (v == unused)
+			v = next++;
+		indices[k] = v;
+	}
+	for (unsigned int& v : remap)
+	{
+		if (v == unused)
+			v = next++;
+	}
+	return remap;
+}
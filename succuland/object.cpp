@@ -4,7 +4,7 @@
  *	Generic object
  */
 
-ObjectInstance::ObjectInstance(Mesh* geometry, glm::mat4 model) :
+ObjectInstance::ObjectInstance(Mesh* geometry, glm::dmat4 model) :
 	geometry(geometry), model(model), position(model[3])
 {
 }
@@ -29,7 +29,7 @@ void ObjectInstance::draw(const Camera& camera) const
 
 }
 
-void ObjectInstance::update(const glm::mat4& updateModel) 
+void ObjectInstance::update(const glm::dmat4& updateModel) 
 {
 	model = updateModel * model;
 	position = model[3];
@@ -37,9 +37,9 @@ void ObjectInstance::update(const glm::mat4& updateModel)
 
 void ObjectInstance::rotate(float degrees, const glm::vec3& axis)
 {
-	glm::mat4 rotate = glm::rotate(glm::mat4(1.0f), glm::radians(degrees), axis);
-	glm::mat4 translate = glm::translate(glm::mat4(1.0f), glm::vec3(this->model[3]));
-	this->model = glm::mat4(glm::mat3(this->model));
+	glm::dmat4 rotate = glm::rotate(glm::dmat4(1.0), glm::radians(double(degrees)), glm::dvec3(axis));
+	glm::dmat4 translate = glm::translate(glm::dmat4(1.0), glm::dvec3(this->model[3]));
+	this->model = glm::dmat4(glm::dmat3(this->model));
 	this->model = translate * rotate * this->model;
 
 	for (const auto& child : children)
@@ -48,13 +48,13 @@ void ObjectInstance::rotate(float degrees, const glm::vec3& axis)
 	}
 }
 
-void ObjectInstance::move(const glm::vec3& new_position) 
+void ObjectInstance::move(const glm::dvec3& new_position) 
 {
-	model = glm::translate(glm::mat4(1.0f), new_position) * glm::mat4(glm::mat3(model));
+	model = glm::translate(glm::dmat4(1.0), new_position) * glm::dmat4(glm::dmat3(model));
 	position = new_position;
 }
 
-void ObjectInstance::move(const glm::vec3& new_position, const glm::vec3& new_direction) 
+void ObjectInstance::move(const glm::dvec3& new_position, const glm::vec3& new_direction) 
 {
 	move(new_position);
 }
@@ -64,38 +64,39 @@ void ObjectInstance::move(const glm::vec3& new_position, const glm::vec3& new_di
 */
 
 LightObject::LightObject(Light* light, LightingShader* lightingShader, const glm::vec3 direction)
-	: ObjectInstance(nullptr, glm::mat4(1.0f)),
+	: ObjectInstance(nullptr, glm::dmat4(1.0)),
 	light(light), lshader(lightingShader), direction(direction)
 {
 }
 
-LightObject::LightObject(Mesh* geometry, Light* light, LightingShader* lightingShader, const glm::mat4& model)
+LightObject::LightObject(Mesh* geometry, Light* light, LightingShader* lightingShader, const glm::dmat4& model)
 	: ObjectInstance(geometry, model),
 	light(light), lshader(lightingShader), direction(glm::vec3(0.0f))
 {
 }
 
-LightObject::LightObject(Mesh* geometry, Light* light, LightingShader* lightingShader, const glm::mat4& model, const glm::vec3& direction)
+LightObject::LightObject(Mesh* geometry, Light* light, LightingShader* lightingShader, const glm::dmat4& model, const glm::vec3& direction)
 	: ObjectInstance(geometry, model),
 	light(light), lshader(lightingShader), direction(direction)
 {
 }
 
-LightObject::LightObject(Mesh* geometry, Light* light, LightingShader* lightingShader, const glm::vec3& position)
-	: ObjectInstance(geometry, glm::translate(glm::mat4(1.0f), position)),
+LightObject::LightObject(Mesh* geometry, Light* light, LightingShader* lightingShader, const glm::dvec3& position)
+	: ObjectInstance(geometry, glm::translate(glm::dmat4(1.0), position)),
 	light(light), lshader(lightingShader)
 {
 }
 
-LightObject::LightObject(Mesh* geometry, Light* light, LightingShader* lightingShader, const glm::vec3& position, const glm::vec3& direction)
-	: ObjectInstance(geometry, glm::translate(glm::mat4(1.0f), position)),
+LightObject::LightObject(Mesh* geometry, Light* light, LightingShader* lightingShader, const glm::dvec3& position, const glm::vec3& direction)
+	: ObjectInstance(geometry, glm::translate(glm::dmat4(1.0), position)),
 	light(light), lshader(lightingShader), direction(direction)
 {
 }
 
 void LightObject::draw(const Camera& camera) const 
 {
-	lshader->addLight(light, position, direction);
+	// Lights are shaded in the camera relative space of the vertex positions
+	lshader->addLight(light, glm::vec3(position - camera.position), direction);
 
 	if (light->type != LIGHT_DIRECTIONAL && light->type != LIGHT_SPOTLIGHT) {
 		geometry->shader->use();
@@ -106,21 +107,21 @@ void LightObject::draw(const Camera& camera) const
 	}
 }
 
-void LightObject::update(const glm::mat4& model) 
+void LightObject::update(const glm::dmat4& model) 
 {
 	this->model = model * this->model;
 	position = this->model[3];
 }
 
-void LightObject::move(const glm::vec3& new_position)
+void LightObject::move(const glm::dvec3& new_position)
 {
 	position = new_position;
 	if (light->type == LIGHT_POINT || light->type == LIGHT_SPOTLIGHT) {
-		model = glm::translate(glm::mat4(1.0f), new_position) * glm::mat4(glm::mat3(model));
+		model = glm::translate(glm::dmat4(1.0), new_position) * glm::dmat4(glm::dmat3(model));
 	}
 }
 
-void LightObject::move(const glm::vec3& new_position, const glm::vec3& new_direction)
+void LightObject::move(const glm::dvec3& new_position, const glm::vec3& new_direction)
 {
 	direction = new_direction;
 	move(new_position);
@@ -228,7 +229,7 @@ void Banner::draw(const Camera& camera) const
 *	Arrow
 */
 
-Arrow::Arrow(Mesh* geometry, float elevation, float radius, const glm::mat4& model)
+Arrow::Arrow(Mesh* geometry, float elevation, float radius, const glm::dmat4& model)
 	: ObjectInstance(geometry, model),
 	initialModel(model), currentIdx(0), elevation(elevation), radius(radius)
 {
@@ -237,7 +238,7 @@ Arrow::Arrow(Mesh* geometry, float elevation, float radius, const glm::mat4& mod
 void Arrow::animationStep()
 {
 	float alpha = glutGet(GLUT_ELAPSED_TIME) / 100.0f;
-	glm::mat4 newModel = glm::inverse(glm::lookAt(target + glm::vec3(glm::sin(alpha) * radius, elevation, glm::cos(alpha) * radius), target, glm::vec3(0, 1, 0)));
+	glm::dmat4 newModel = glm::inverse(glm::lookAt(target + glm::dvec3(glm::sin(alpha) * radius, elevation, glm::cos(alpha) * radius), target, glm::dvec3(0, 1, 0)));
 	model = newModel * initialModel;
 }
 
@@ -248,8 +249,8 @@ void Arrow::animationStep()
 Mesh* Particle::partGeometry = nullptr;
 std::vector<Particle*> Particle::particles;
 
-Particle::Particle(const std::string& path, uint32_t animationTime, const glm::vec3& position)
-	: ObjectInstance(partGeometry, glm::translate(glm::mat4(1.0f), position + glm::vec3(0.0f, 1.0f, 0.0f)) * glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(10.0f))),
+Particle::Particle(const std::string& path, uint32_t animationTime, const glm::dvec3& position)
+	: ObjectInstance(partGeometry, glm::translate(glm::dmat4(1.0), position + glm::dvec3(0.0, 1.0, 0.0)) * glm::dmat4(glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(10.0f)))),
 	texture(pgr::createTexture(path)), animationTime(animationTime), startTime(glutGet(GLUT_ELAPSED_TIME))
 {
 }
@@ -294,7 +295,7 @@ void Particle::init(Mesh* geometry)
 	partGeometry = geometry;
 }
 
-void Particle::createParticle(const std::string& texturePath, const glm::vec3& position)
+void Particle::createParticle(const std::string& texturePath, const glm::dvec3& position)
 {
 	if (!partGeometry)
 		throw std::runtime_error("Particle geometry not initialized");
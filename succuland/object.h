@@ -19,17 +19,17 @@ protected:
 	/// Pointer to mesh the object uses
 	Mesh* geometry;
 
-	/// Model matrix of the object
-	glm::mat4 model;
+	/// Model matrix of the object, in double precision so objects far from the origin keep their sub-unit detail
+	glm::dmat4 model;
 
 	/// Children objects 
 	std::vector<ObjectInstance*> children;
 
 public:
-	ObjectInstance(Mesh* geometry, glm::mat4 model);
+	ObjectInstance(Mesh* geometry, glm::dmat4 model);
 
 	/// Position of the object
-	glm::vec3 position;
+	glm::dvec3 position;
 
 	/// Add child to vector of children
 	void addChild(ObjectInstance* newChild);
@@ -41,13 +41,13 @@ public:
 	virtual void draw(const Camera& camera) const;
 
 	/// Update model matrix
-	virtual void update(const glm::mat4& model);
+	virtual void update(const glm::dmat4& model);
 	/// Rotate the object in it's model space
 	virtual void rotate(float degrees, const glm::vec3& axis);
 	/// Move object to new position maintaining other transformations
-	virtual void move(const glm::vec3& new_position);
+	virtual void move(const glm::dvec3& new_position);
 	/// Move object to new position, change direction (doesn't change the rotation, mainly used by derived classes)
-	virtual void move(const glm::vec3& new_position, const glm::vec3& new_direction);
+	virtual void move(const glm::dvec3& new_position, const glm::vec3& new_direction);
 };
 
 /// Object additionally storing and setting light parameters
@@ -66,23 +66,23 @@ public:
 
 	/// Constructor for a directional light
 	LightObject(Light* light, LightingShader* lightingShader, const glm::vec3 direction);
-	LightObject(Mesh* geometry, Light* light, LightingShader* lightingShader, const glm::mat4& model);
-	LightObject(Mesh* geometry, Light* light, LightingShader* lightingShader, const glm::mat4& model, const glm::vec3& direction);
-	LightObject(Mesh* geometry, Light* light, LightingShader* lightingShader, const glm::vec3& position);
-	LightObject(Mesh* geomtery, Light* light, LightingShader* lightingShader, const glm::vec3& position, const glm::vec3& direction);
+	LightObject(Mesh* geometry, Light* light, LightingShader* lightingShader, const glm::dmat4& model);
+	LightObject(Mesh* geometry, Light* light, LightingShader* lightingShader, const glm::dmat4& model, const glm::vec3& direction);
+	LightObject(Mesh* geometry, Light* light, LightingShader* lightingShader, const glm::dvec3& position);
+	LightObject(Mesh* geomtery, Light* light, LightingShader* lightingShader, const glm::dvec3& position, const glm::vec3& direction);
 
 	///	<summary>
-	///  Draw current light object if it has geometry, additionaly sets light parameters
+	///  Draw current light object if it has geometry, additionaly sets light parameters relative to the camera
 	/// </summary>
 	/// <param name="camera">Camera object for view and projection matrices</param>
 	void draw(const Camera& camera) const override;
 
 	/// Update model matrix
-	void update(const glm::mat4& model);
+	void update(const glm::dmat4& model);
 	/// Move object to new position maintaining other transformations
-	void move(const glm::vec3& new_position);
+	void move(const glm::dvec3& new_position);
 	/// Move object to new position, change direction
-	void move(const glm::vec3& new_position, const glm::vec3& new_direction);
+	void move(const glm::dvec3& new_position, const glm::vec3& new_direction);
 };
 
 /// Skybox object
@@ -129,7 +129,7 @@ class Arrow : public ObjectInstance
 {
 protected:
 	/// Starting rotation and scale of an arrow
-	glm::mat4 initialModel;
+	glm::dmat4 initialModel;
 
 public:
 	/// Elevation of the arrow during spinning animation
@@ -137,11 +137,13 @@ public:
 	/// Radius of spinning animation
 	float radius;
 	/// Point the arrow is targeted while spinning
-	glm::vec3 target;
+	glm::dvec3 target;
 	/// Index of the object the arrow is spinning above
 	uint8_t currentIdx;
+	/// currentIdx of an arrow spinning above a picked terrain point
+	static const uint8_t TERRAIN_IDX = 255;
 
-	Arrow(Mesh* geometry, float elevation, float radius, const glm::mat4& model);
+	Arrow(Mesh* geometry, float elevation, float radius, const glm::dmat4& model);
 
 	/// Step of a arrow spinning animation 
 	void animationStep();
@@ -167,7 +169,7 @@ protected:
 
 public:
 	/// Construct an animated particle sprite
-	Particle(const std::string& path, uint32_t animationTime, const glm::vec3& position);
+	Particle(const std::string& path, uint32_t animationTime, const glm::dvec3& position);
 
 	/// Draw the particle using blending
 	void draw(const Camera& camera) const override;
@@ -177,7 +179,7 @@ public:
 	/// Initialize geometry
 	static void init(Mesh* geometry);
 	/// Create particle object at given position
-	static void createParticle(const std::string& texturePath, const glm::vec3& position);
+	static void createParticle(const std::string& texturePath, const glm::dvec3& position);
 	/// Get a reference to the static list of particles
 	static const std::vector<Particle*>& getParticles();
 };
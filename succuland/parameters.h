@@ -4,6 +4,7 @@
 #define _PARAMETERS_H
 
 #include "pgr.h"
+#include "perlin.h"
 #include <chrono>
 #include <string>
 #include <fstream>
@@ -28,6 +29,44 @@ const glm::vec3 SUN_DIRECTION = { 2.0f, 2.0f, 3.0f };
 //const float TERRAIN_SCALE = 1.0f;
 const uint32_t TERRAIN_WIDTH = 500;
 const uint32_t TERRAIN_LENGTH = 500;
+const NoiseBackend TERRAIN_NOISE_BACKEND = NOISE_BACKEND_PERLIN;
+/// Generate the terrain with a compute shader, falls back to the CPU when the shader can't be built
+const bool TERRAIN_GPU_GENERATION = true;
+/// File caching the full resolution terrain mesh between launches, rebuilt when the terrain parameters change. Empty disables it
+const std::string TERRAIN_CACHE_PATH = "terrain.cache";
+
+/// Ways of drawing the terrain
+enum TerrainRenderer
+{
+	/// One full resolution TERRAIN_WIDTH x TERRAIN_LENGTH mesh
+	TERRAIN_RENDERER_MESH,
+	/// Chunks streamed around the active camera, the world has no edge
+	TERRAIN_RENDERER_STREAMING,
+	/// TERRAIN_WIDTH x TERRAIN_LENGTH height map drawn with a level of detail quadtree
+	TERRAIN_RENDERER_LOD,
+	/// TERRAIN_WIDTH x TERRAIN_LENGTH height map drawn as instanced patches
+	TERRAIN_RENDERER_PATCHES,
+	/// TERRAIN_WIDTH x TERRAIN_LENGTH height map drawn as coarse patches subdivided by the tessellation stages
+	TERRAIN_RENDERER_TESSELLATION,
+	/// One TERRAIN_WIDTH x TERRAIN_LENGTH mesh with fewer triangles where the terrain is flat
+	TERRAIN_RENDERER_DECIMATED,
+};
+const TerrainRenderer TERRAIN_RENDERER = TERRAIN_RENDERER_MESH;
+/// Bake the sun lighting and shadows of height map terrain at load instead of lighting it per fragment
+const bool TERRAIN_BAKED_SUN = true;
+/// Camera distance of the full resolution level of the level of detail terrain
+const float TERRAIN_LOD_DETAIL_RANGE = 40.0f;
+/// Largest height difference between the decimated terrain and the full resolution grid
+const float TERRAIN_DECIMATION_ERROR = 0.1f;
+/// Crater stamped into the terrain by a middle click, the streamed and the decimated terrain can't be edited
+const float TERRAIN_CRATER_RADIUS = 8.0f;
+const float TERRAIN_CRATER_DEPTH = 3.0f;
+/// Stream the terrain material from a virtual texture instead of tiling one texture, the streamed terrain always tiles it
+const bool TERRAIN_VIRTUAL_TEXTURE = true;
+/// Pages along one side of the finest virtual texture level, VirtualTexture::PAGE_SIZE texels each
+const unsigned int TERRAIN_VIRTUAL_PAGES = 256;
+/// Atlas slots along one side, bounds the video memory the virtual texture takes
+const unsigned int TERRAIN_VIRTUAL_SLOTS = 16;
 
 const uint32_t CAMERA_UPPER_BOUNDARY = 80.0f;
 
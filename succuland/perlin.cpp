@@ -1,7 +1,22 @@
-/* coherent noise function over 1, 2 or 3 dimensions */
+/* coherent noise function over 2 dimensions */
 /* (copyright Ken Perlin) */
 #include "perlin.h"
 
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define PERLIN_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PERLIN_TARGET(isa)
+#else
+#define PERLIN_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
 #define B SAMPLE_SIZE
 #define BM (SAMPLE_SIZE-1)
 
@@ -12,205 +27,1188 @@
 #define s_curve(t) ( t * t * (3.0f - 2.0f * t) )
 #define lerp(t, a, b) ( a + t * (b - a) )
 
-#define setup(i,b0,b1,r0,r1)\
+#define setup_lattice(i,b0,b1,r0)\
 	t = vec[i] + N;\
 	b0 = ((int)t) & BM;\
 	b1 = (b0+1) & BM;\
-	r0 = t - (int)t;\
-	r1 = r0 - 1.0f;
-
-float Perlin::noise1(float arg)
-{
-	int bx0, bx1;
-	float rx0, rx1, sx, t, u, v, vec[1];
-
-	vec[0] = arg;
-
-	setup(0, bx0, bx1, rx0, rx1);
-
-	sx = s_curve(rx0);
-
-	u = rx0 * g1[p[bx0]];
-	v = rx1 * g1[p[bx1]];
+	r0 = t - (int)t;
 
-	return lerp(sx, u, v);
-}
+#define setup(i,b0,b1,r0,r1)\
+	setup_lattice(i,b0,b1,r0)\
+	r1 = r0 - 1.0f;
 
 float Perlin::noise2(float vec[2]) const
 {
-	int bx0, bx1, by0, by1, b00, b10, b01, b11;
+	int bx0, bx1, by0, by1;
 	float rx0, rx1, ry0, ry1, sx, sy, a, b, t, u, v;
-	const float* q;
+	const NoiseEntry2D* e = mTable->entries;
+	const NoiseEntry2D* q;
 	int i, j;
 
 	setup(0, bx0, bx1, rx0, rx1);
 	setup(1, by0, by1, ry0, ry1);
 
-	i = p[bx0];
-	j = p[bx1];
-
-	b00 = p[i + by0];
-	b10 = p[j + by0];
-	b01 = p[i + by1];
-	b11 = p[j + by1];
+	i = e[bx0].perm;
+	j = e[bx1].perm;
 
 	sx = s_curve(rx0);
 	sy = s_curve(ry0);
 
-#define at2(rx,ry) ( rx * q[0] + ry * q[1] )
+#define at2(rx,ry) ( rx * q->gx + ry * q->gy )
 
-	q = g2[b00];
+	q = &e[i + by0];
 	u = at2(rx0, ry0);
-	q = g2[b10];
+	q = &e[j + by0];
 	v = at2(rx1, ry0);
 	a = lerp(sx, u, v);
 
-	q = g2[b01];
+	q = &e[i + by1];
 	u = at2(rx0, ry1);
-	q = g2[b11];
+	q = &e[j + by1];
 	v = at2(rx1, ry1);
 	b = lerp(sx, u, v);
 
 	return lerp(sy, a, b);
 }
 
-float Perlin::noise3(float vec[3])
+/* noise2 with derivatives of the lerp chain, the value is computed exactly as in noise2 */
+float Perlin::noise2_grad(float vec[2], float* dx, float* dy) const
 {
-	int bx0, bx1, by0, by1, bz0, bz1, b00, b10, b01, b11;
-	float rx0, rx1, ry0, ry1, rz0, rz1, * q, sy, sz, a, b, c, d, t, u, v;
+	int bx0, bx1, by0, by1;
+	float rx0, rx1, ry0, ry1, sx, sy, dsx, dsy, a, b, t, u, v;
+	float dax, day, dbx, dby;
+	const NoiseEntry2D* e = mTable->entries;
+	const NoiseEntry2D* q0;
+	const NoiseEntry2D* q1;
 	int i, j;
 
 	setup(0, bx0, bx1, rx0, rx1);
 	setup(1, by0, by1, ry0, ry1);
-	setup(2, bz0, bz1, rz0, rz1);
 
-	i = p[bx0];
-	j = p[bx1];
+	i = e[bx0].perm;
+	j = e[bx1].perm;
 
-	b00 = p[i + by0];
-	b10 = p[j + by0];
-	b01 = p[i + by1];
-	b11 = p[j + by1];
+	sx = s_curve(rx0);
+	sy = s_curve(ry0);
+	dsx = 6.0f * rx0 * (1.0f - rx0);
+	dsy = 6.0f * ry0 * (1.0f - ry0);
+
+	q0 = &e[i + by0];
+	u = rx0 * q0->gx + ry0 * q0->gy;
+	q1 = &e[j + by0];
+	v = rx1 * q1->gx + ry0 * q1->gy;
+	a = lerp(sx, u, v);
+	dax = q0->gx + dsx * (v - u) + sx * (q1->gx - q0->gx);
+	day = lerp(sx, q0->gy, q1->gy);
 
-	t = s_curve(rx0);
+	q0 = &e[i + by1];
+	u = rx0 * q0->gx + ry1 * q0->gy;
+	q1 = &e[j + by1];
+	v = rx1 * q1->gx + ry1 * q1->gy;
+	b = lerp(sx, u, v);
+	dbx = q0->gx + dsx * (v - u) + sx * (q1->gx - q0->gx);
+	dby = lerp(sx, q0->gy, q1->gy);
+
+	*dx = lerp(sy, dax, dbx);
+	*dy = day + dsy * (b - a) + sy * (dby - day);
+
+	return lerp(sy, a, b);
+}
+
+/*
+*	OpenSimplex2 style simplex noise, lattice points are hashed straight to an entry of the
+*	same table as noise2, so each corner costs a single load
+*/
+
+#define SKEW_2D 0.366025403784439f
+#define UNSKEW_2D -0.21132486540518713f
+#define RSQUARED_2D 0.5f
+/* scales the sum of the a^4 falloffs to roughly [-1, 1] */
+#define SIMPLEX_SCALE_2D 99.0f
+/* the top 10 bits of the corner hash index the first SAMPLE_SIZE entries */
+#define SIMPLEX_HASH_SHIFT 22
+
+static inline int fastfloor(float x)
+{
+	int xi = (int)x;
+	return x < xi ? xi - 1 : xi;
+}
+
+static inline const NoiseEntry2D& corner(const NoiseEntry2D* e, int x, int y, uint32_t seed)
+{
+	uint32_t h = (seed ^ ((uint32_t)x * 0x5205402bu) ^ ((uint32_t)y * 0x598cd327u)) * 0x53a3f72du;
+	return e[h >> SIMPLEX_HASH_SHIFT];
+}
+
+/* a^4 weighted gradient of one corner at offset (ox, oy), corners outside the falloff radius
+   are clamped to zero instead of skipped so the three corners are evaluated without branches */
+static inline float simplexCorner(const NoiseEntry2D* e, int x, int y, float ox, float oy, uint32_t seed)
+{
+	float a = RSQUARED_2D - ox * ox - oy * oy;
+	a = std::max(a, 0.0f);
+	const NoiseEntry2D& g = corner(e, x, y, seed);
+	float a2 = a * a;
+	return a2 * a2 * (g.gx * ox + g.gy * oy);
+}
+
+/* simplexCorner with its derivatives, accumulated into gx and gy */
+static inline float simplexCornerGrad(const NoiseEntry2D* e, int x, int y, float ox, float oy, uint32_t seed, float* gx, float* gy)
+{
+	float a = RSQUARED_2D - ox * ox - oy * oy;
+	a = std::max(a, 0.0f);
+	const NoiseEntry2D& g = corner(e, x, y, seed);
+	float dot = g.gx * ox + g.gy * oy;
+	float a2 = a * a;
+	float a4 = a2 * a2;
+	*gx += a4 * g.gx - 8.0f * a2 * a * dot * ox;
+	*gy += a4 * g.gy - 8.0f * a2 * a * dot * oy;
+	return a4 * dot;
+}
+
+float Perlin::simplex2(float vec[2]) const
+{
+	const NoiseEntry2D* e = mTable->entries;
+	uint32_t seed = (uint32_t)mSeed;
+	float s = (vec[0] + vec[1]) * SKEW_2D;
+	float xs = vec[0] + s;
+	float ys = vec[1] + s;
+	int xsb = fastfloor(xs);
+	int ysb = fastfloor(ys);
+	float xi = xs - xsb;
+	float yi = ys - ysb;
+	float t = (xi + yi) * UNSKEW_2D;
+	float dx0 = xi + t;
+	float dy0 = yi + t;
+
+	/* third corner is (1, 0) or (0, 1) depending on which half of the skewed cell we're in */
+	int i1 = xi > yi ? 1 : 0;
+	int j1 = 1 - i1;
+
+	float value = simplexCorner(e, xsb, ysb, dx0, dy0, seed);
+	value += simplexCorner(e, xsb + 1, ysb + 1, dx0 - 1.0f - 2.0f * UNSKEW_2D, dy0 - 1.0f - 2.0f * UNSKEW_2D, seed);
+	value += simplexCorner(e, xsb + i1, ysb + j1, dx0 - i1 - UNSKEW_2D, dy0 - j1 - UNSKEW_2D, seed);
+
+	return value * SIMPLEX_SCALE_2D;
+}
+
+/* simplex2 with the derivatives of each a^4 * dot contribution */
+
+float Perlin::simplex2_grad(float vec[2], float* dx, float* dy) const
+{
+	const NoiseEntry2D* e = mTable->entries;
+	uint32_t seed = (uint32_t)mSeed;
+	float s = (vec[0] + vec[1]) * SKEW_2D;
+	float xs = vec[0] + s;
+	float ys = vec[1] + s;
+	int xsb = fastfloor(xs);
+	int ysb = fastfloor(ys);
+	float xi = xs - xsb;
+	float yi = ys - ysb;
+	float t = (xi + yi) * UNSKEW_2D;
+	float dx0 = xi + t;
+	float dy0 = yi + t;
+
+	/* third corner is (1, 0) or (0, 1) depending on which half of the skewed cell we're in */
+	int i1 = xi > yi ? 1 : 0;
+	int j1 = 1 - i1;
+
+	float gx = 0.0f;
+	float gy = 0.0f;
+	float value = simplexCornerGrad(e, xsb, ysb, dx0, dy0, seed, &gx, &gy);
+	value += simplexCornerGrad(e, xsb + 1, ysb + 1, dx0 - 1.0f - 2.0f * UNSKEW_2D, dy0 - 1.0f - 2.0f * UNSKEW_2D, seed, &gx, &gy);
+	value += simplexCornerGrad(e, xsb + i1, ysb + j1, dx0 - i1 - UNSKEW_2D, dy0 - j1 - UNSKEW_2D, seed, &gx, &gy);
+
+	*dx = gx * SIMPLEX_SCALE_2D;
+	*dy = gy * SIMPLEX_SCALE_2D;
+	return value * SIMPLEX_SCALE_2D;
+}
+
+/*
+*	Value noise, lattice values come from an integer hash of the lattice point and seed
+*/
+
+static inline float latticeValue(int x, int y, uint32_t seed)
+{
+	uint32_t h = seed ^ ((uint32_t)x * 0x27d4eb2du) ^ ((uint32_t)y * 0x165667b1u);
+	h ^= h >> 15;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return (float)(int)(h >> 8) * (2.0f / 16777215.0f) - 1.0f;
+}
+
+float Perlin::value2(float vec[2]) const
+{
+	int bx0, bx1, by0, by1;
+	float rx0, ry0, sx, sy, a, b, t;
+	uint32_t seed = (uint32_t)mSeed;
+
+	setup_lattice(0, bx0, bx1, rx0);
+	setup_lattice(1, by0, by1, ry0);
+
+	sx = s_curve(rx0);
 	sy = s_curve(ry0);
-	sz = s_curve(rz0);
 
-#define at3(rx,ry,rz) ( rx * q[0] + ry * q[1] + rz * q[2] )
+	a = lerp(sx, latticeValue(bx0, by0, seed), latticeValue(bx1, by0, seed));
+	b = lerp(sx, latticeValue(bx0, by1, seed), latticeValue(bx1, by1, seed));
+
+	return lerp(sy, a, b);
+}
 
-	q = g3[b00 + bz0]; u = at3(rx0, ry0, rz0);
-	q = g3[b10 + bz0]; v = at3(rx1, ry0, rz0);
-	a = lerp(t, u, v);
+float Perlin::value2_grad(float vec[2], float* dx, float* dy) const
+{
+	int bx0, bx1, by0, by1;
+	float rx0, ry0, sx, sy, dsx, dsy, a, b, t;
+	float v00, v10, v01, v11;
+	uint32_t seed = (uint32_t)mSeed;
 
-	q = g3[b01 + bz0]; u = at3(rx0, ry1, rz0);
-	q = g3[b11 + bz0]; v = at3(rx1, ry1, rz0);
-	b = lerp(t, u, v);
+	setup_lattice(0, bx0, bx1, rx0);
+	setup_lattice(1, by0, by1, ry0);
 
-	c = lerp(sy, a, b);
+	sx = s_curve(rx0);
+	sy = s_curve(ry0);
+	dsx = 6.0f * rx0 * (1.0f - rx0);
+	dsy = 6.0f * ry0 * (1.0f - ry0);
 
-	q = g3[b00 + bz1]; u = at3(rx0, ry0, rz1);
-	q = g3[b10 + bz1]; v = at3(rx1, ry0, rz1);
-	a = lerp(t, u, v);
+	v00 = latticeValue(bx0, by0, seed);
+	v10 = latticeValue(bx1, by0, seed);
+	v01 = latticeValue(bx0, by1, seed);
+	v11 = latticeValue(bx1, by1, seed);
 
-	q = g3[b01 + bz1]; u = at3(rx0, ry1, rz1);
-	q = g3[b11 + bz1]; v = at3(rx1, ry1, rz1);
-	b = lerp(t, u, v);
+	a = lerp(sx, v00, v10);
+	b = lerp(sx, v01, v11);
 
-	d = lerp(sy, a, b);
+	*dx = lerp(sy, dsx * (v10 - v00), dsx * (v11 - v01));
+	*dy = dsy * (b - a);
 
-	return lerp(sz, c, d);
+	return lerp(sy, a, b);
 }
 
-void Perlin::normalize2(float v[2])
+float Perlin::basis(float vec[2]) const
 {
-	float s;
+	switch (mBackend)
+	{
+	case NOISE_BACKEND_OPENSIMPLEX2:
+		return simplex2(vec);
+	case NOISE_BACKEND_VALUE:
+		return value2(vec);
+	default:
+		return noise2(vec);
+	}
+}
 
-	s = (float)sqrt(v[0] * v[0] + v[1] * v[1]);
-	s = 1.0f / s;
-	v[0] = v[0] * s;
-	v[1] = v[1] * s;
+float Perlin::basis_grad(float vec[2], float* dx, float* dy) const
+{
+	switch (mBackend)
+	{
+	case NOISE_BACKEND_OPENSIMPLEX2:
+		return simplex2_grad(vec, dx, dy);
+	case NOISE_BACKEND_VALUE:
+		return value2_grad(vec, dx, dy);
+	default:
+		return noise2_grad(vec, dx, dy);
+	}
 }
 
-void Perlin::normalize3(float v[3])
+static void normalize2(float v[2])
 {
 	float s;
 
-	s = (float)sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	s = (float)sqrt(v[0] * v[0] + v[1] * v[1]);
 	s = 1.0f / s;
-
 	v[0] = v[0] * s;
 	v[1] = v[1] * s;
-	v[2] = v[2] * s;
 }
 
-void Perlin::init(void)
+/*
+*	Tables are built from an engine owned by this call and seeded with the seed, raw engine
+*	output is used instead of std distributions, whose results differ between standard
+*	libraries, so a seed produces the same tables on every thread and platform.
+*	Moving from rand() to the engine changed the terrain of every seed. The 1D and 3D
+*	gradients are still drawn (and dropped) so a seed keeps the tables the engine gave it
+*	when Perlin built all three gradient sets itself.
+*/
+NoiseTable2D::NoiseTable2D(int seed)
 {
+	int p[B + B + 2];
+	float g2[B][2];
 	int i, j, k;
+	std::mt19937 random((uint32_t)seed);
 
 	for (i = 0; i < B; i++)
 	{
 		p[i] = i;
-		g1[i] = (float)((rand() % (B + B)) - B) / B;
+		random();
 		for (j = 0; j < 2; j++)
-			g2[i][j] = (float)((rand() % (B + B)) - B) / B;
+			g2[i][j] = (float)((int)(random() % (B + B)) - B) / B;
 		normalize2(g2[i]);
 		for (j = 0; j < 3; j++)
-			g3[i][j] = (float)((rand() % (B + B)) - B) / B;
-		normalize3(g3[i]);
+			random();
 	}
 
 	while (--i)
 	{
 		k = p[i];
-		p[i] = p[j = rand() % B];
+		p[i] = p[j = random() % B];
 		p[j] = k;
 	}
 
 	for (i = 0; i < B + 2; i++)
 	{
 		p[B + i] = p[i];
-		g1[B + i] = g1[i];
-		for (j = 0; j < 2; j++)
-			g2[B + i][j] = g2[i][j];
-		for (j = 0; j < 3; j++)
-			g3[B + i][j] = g3[i][j];
 	}
 
+	for (i = 0; i < B + B + 2; i++)
+	{
+		entries[i].perm = p[i];
+		entries[i].gx = g2[p[i]][0];
+		entries[i].gy = g2[p[i]][1];
+	}
 }
 
+std::shared_ptr<const NoiseTable2D> NoiseTable2D::get(int seed)
+{
+	static std::mutex mutex;
+	static std::map<int, std::weak_ptr<const NoiseTable2D>> cache;
 
-float Perlin::perlin_noise_2D(float vec[2]) const
+	std::lock_guard<std::mutex> lock(mutex);
+	std::shared_ptr<const NoiseTable2D> table = cache[seed].lock();
+	if (!table)
+	{
+		table = std::make_shared<const NoiseTable2D>(seed);
+		cache[seed] = table;
+	}
+	return table;
+}
+
+float Perlin::perlin_noise_2D(float x, float y) const
 {
 	int terms = mOctaves;
-	float freq = mFrequency;
 	float result = 0.0f;
 	float amp = mAmplitude;
-
-	vec[0] *= mFrequency;
-	vec[1] *= mFrequency;
+	float vec[2] = { x * mFrequency, y * mFrequency };
 
 	for (int i = 0; i < terms; i++)
 	{
-		result += noise2(vec) * amp;
+		result += basis(vec) * amp;
+		vec[0] *= 2.0f;
+		vec[1] *= 2.0f;
+		amp *= 0.5f;
+	}
+
+
+	return result;
+}
+
+float Perlin::perlin_noise_2D_grad(float x, float y, float* dx, float* dy) const
+{
+	float vec[2] = { x * mFrequency, y * mFrequency };
+	float result = 0.0f;
+	float amp = mAmplitude;
+	float scale = mFrequency;
+	float gx = 0.0f;
+	float gy = 0.0f;
+
+	for (int i = 0; i < mOctaves; i++)
+	{
+		float nx, ny;
+		result += basis_grad(vec, &nx, &ny) * amp;
+		gx += nx * amp * scale;
+		gy += ny * amp * scale;
 		vec[0] *= 2.0f;
 		vec[1] *= 2.0f;
 		amp *= 0.5f;
+		scale *= 2.0f;
 	}
 
+	*dx = gx;
+	*dy = gy;
+	return result;
+}
+
+/*
+*	Runtime octave count adapters over the compile time specializations
+*/
 
+template <int... O>
+static float dispatchFbm(const Perlin& perlin, int octaves, float x, float y, std::integer_sequence<int, O...>)
+{
+	float result = 0.0f;
+	((octaves == O + 1 ? (result = perlin.Fbm<O + 1>(x, y), true) : false) || ...);
+	return result;
+}
+
+template <int... O>
+static float dispatchFbmWithGradient(const Perlin& perlin, int octaves, float x, float y, float* dx, float* dy, std::integer_sequence<int, O...>)
+{
+	float result = 0.0f;
+	((octaves == O + 1 ? (result = perlin.FbmWithGradient<O + 1>(x, y, dx, dy), true) : false) || ...);
 	return result;
 }
 
+float Perlin::Get(float x, float y) const
+{
+	if (mOctaves < 1 || mOctaves > MAX_SPECIALIZED_OCTAVES)
+		return perlin_noise_2D(x, y);
+	return dispatchFbm(*this, mOctaves, x, y, std::make_integer_sequence<int, MAX_SPECIALIZED_OCTAVES>());
+}
+
+float Perlin::GetWithGradient(float x, float y, float* dx, float* dy) const
+{
+	if (mOctaves < 1 || mOctaves > MAX_SPECIALIZED_OCTAVES)
+		return perlin_noise_2D_grad(x, y, dx, dy);
+	return dispatchFbmWithGradient(*this, mOctaves, x, y, dx, dy, std::make_integer_sequence<int, MAX_SPECIALIZED_OCTAVES>());
+}
+
+/*
+*	Batched evaluation
+*
+*	The kernels mirror noise2, noise2_grad and the octave loops operation by operation
+*	(no FMA, same evaluation order), so every lane produces the same bits as the scalar path.
+*/
+
+NoiseKernel Perlin::kernel = NOISE_KERNEL_AUTO;
+
+#ifdef PERLIN_X86
+
+static bool cpuSupportsSSE4()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 19)) != 0;
+#else
+	return __builtin_cpu_supports("sse4.1");
+#endif
+}
+
+static bool cpuSupportsAVX2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+PERLIN_TARGET("sse4.1")
+static inline __m128i perm4(const NoiseEntry2D* e, __m128i idx)
+{
+	return _mm_set_epi32(e[_mm_extract_epi32(idx, 3)].perm, e[_mm_extract_epi32(idx, 2)].perm,
+		e[_mm_extract_epi32(idx, 1)].perm, e[_mm_extract_epi32(idx, 0)].perm);
+}
+
+PERLIN_TARGET("sse4.1")
+static inline void gradients4(const NoiseEntry2D* e, __m128i idx, __m128* gx, __m128* gy)
+{
+	const NoiseEntry2D& e0 = e[_mm_extract_epi32(idx, 0)];
+	const NoiseEntry2D& e1 = e[_mm_extract_epi32(idx, 1)];
+	const NoiseEntry2D& e2 = e[_mm_extract_epi32(idx, 2)];
+	const NoiseEntry2D& e3 = e[_mm_extract_epi32(idx, 3)];
+	*gx = _mm_set_ps(e3.gx, e2.gx, e1.gx, e0.gx);
+	*gy = _mm_set_ps(e3.gy, e2.gy, e1.gy, e0.gy);
+}
+
+PERLIN_TARGET("sse4.1")
+static inline __m128 gradient4(const NoiseEntry2D* e, __m128i idx, __m128 rx, __m128 ry)
+{
+	__m128 gx, gy;
+	gradients4(e, idx, &gx, &gy);
+	return _mm_add_ps(_mm_mul_ps(rx, gx), _mm_mul_ps(ry, gy));
+}
+
+PERLIN_TARGET("sse4.1")
+static __m128 noise2SSE4(const NoiseEntry2D* e, __m128 vx, __m128 vy)
+{
+	const __m128i bm = _mm_set1_epi32(BM);
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128 onef = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 three = _mm_set1_ps(3.0f);
+
+	__m128 tx = _mm_add_ps(vx, _mm_set1_ps((float)N));
+	__m128i ix = _mm_cvttps_epi32(tx);
+	__m128i bx0 = _mm_and_si128(ix, bm);
+	__m128i bx1 = _mm_and_si128(_mm_add_epi32(bx0, one), bm);
+	__m128 rx0 = _mm_sub_ps(tx, _mm_cvtepi32_ps(ix));
+	__m128 rx1 = _mm_sub_ps(rx0, onef);
+
+	__m128 ty = _mm_add_ps(vy, _mm_set1_ps((float)N));
+	__m128i iy = _mm_cvttps_epi32(ty);
+	__m128i by0 = _mm_and_si128(iy, bm);
+	__m128i by1 = _mm_and_si128(_mm_add_epi32(by0, one), bm);
+	__m128 ry0 = _mm_sub_ps(ty, _mm_cvtepi32_ps(iy));
+	__m128 ry1 = _mm_sub_ps(ry0, onef);
+
+	__m128i i = perm4(e, bx0);
+	__m128i j = perm4(e, bx1);
+
+	__m128i b00 = _mm_add_epi32(i, by0);
+	__m128i b10 = _mm_add_epi32(j, by0);
+	__m128i b01 = _mm_add_epi32(i, by1);
+	__m128i b11 = _mm_add_epi32(j, by1);
+
+	__m128 sx = _mm_mul_ps(_mm_mul_ps(rx0, rx0), _mm_sub_ps(three, _mm_mul_ps(two, rx0)));
+	__m128 sy = _mm_mul_ps(_mm_mul_ps(ry0, ry0), _mm_sub_ps(three, _mm_mul_ps(two, ry0)));
+
+	__m128 u = gradient4(e, b00, rx0, ry0);
+	__m128 v = gradient4(e, b10, rx1, ry0);
+	__m128 a = _mm_add_ps(u, _mm_mul_ps(sx, _mm_sub_ps(v, u)));
+
+	u = gradient4(e, b01, rx0, ry1);
+	v = gradient4(e, b11, rx1, ry1);
+	__m128 b = _mm_add_ps(u, _mm_mul_ps(sx, _mm_sub_ps(v, u)));
+
+	return _mm_add_ps(a, _mm_mul_ps(sy, _mm_sub_ps(b, a)));
+}
+
+/// Returns number of points processed, the remainder is left for the scalar path
+PERLIN_TARGET("sse4.1")
+static size_t batchSSE4(const NoiseEntry2D* e, int octaves, float freq, float amplitude,
+	const float* xs, const float* zs, float* out, size_t n)
+{
+	size_t k = 0;
+	for (; k + 4 <= n; k += 4)
+	{
+		__m128 vx = _mm_mul_ps(_mm_loadu_ps(xs + k), _mm_set1_ps(freq));
+		__m128 vy = _mm_mul_ps(_mm_loadu_ps(zs + k), _mm_set1_ps(freq));
+		__m128 result = _mm_setzero_ps();
+		float amp = amplitude;
+
+		for (int o = 0; o < octaves; o++)
+		{
+			result = _mm_add_ps(result, _mm_mul_ps(noise2SSE4(e, vx, vy), _mm_set1_ps(amp)));
+			vx = _mm_mul_ps(vx, _mm_set1_ps(2.0f));
+			vy = _mm_mul_ps(vy, _mm_set1_ps(2.0f));
+			amp *= 0.5f;
+		}
+		_mm_storeu_ps(out + k, result);
+	}
+	return k;
+}
+
+/* noise2SSE4 with the derivatives of the lerp chain, mirrors noise2_grad */
+PERLIN_TARGET("sse4.1")
+static __m128 noise2GradSSE4(const NoiseEntry2D* e, __m128 vx, __m128 vy, __m128* dx, __m128* dy)
+{
+	const __m128i bm = _mm_set1_epi32(BM);
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128 onef = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 three = _mm_set1_ps(3.0f);
+	const __m128 six = _mm_set1_ps(6.0f);
+
+	__m128 tx = _mm_add_ps(vx, _mm_set1_ps((float)N));
+	__m128i ix = _mm_cvttps_epi32(tx);
+	__m128i bx0 = _mm_and_si128(ix, bm);
+	__m128i bx1 = _mm_and_si128(_mm_add_epi32(bx0, one), bm);
+	__m128 rx0 = _mm_sub_ps(tx, _mm_cvtepi32_ps(ix));
+	__m128 rx1 = _mm_sub_ps(rx0, onef);
+
+	__m128 ty = _mm_add_ps(vy, _mm_set1_ps((float)N));
+	__m128i iy = _mm_cvttps_epi32(ty);
+	__m128i by0 = _mm_and_si128(iy, bm);
+	__m128i by1 = _mm_and_si128(_mm_add_epi32(by0, one), bm);
+	__m128 ry0 = _mm_sub_ps(ty, _mm_cvtepi32_ps(iy));
+	__m128 ry1 = _mm_sub_ps(ry0, onef);
+
+	__m128i i = perm4(e, bx0);
+	__m128i j = perm4(e, bx1);
+
+	__m128 sx = _mm_mul_ps(_mm_mul_ps(rx0, rx0), _mm_sub_ps(three, _mm_mul_ps(two, rx0)));
+	__m128 sy = _mm_mul_ps(_mm_mul_ps(ry0, ry0), _mm_sub_ps(three, _mm_mul_ps(two, ry0)));
+	__m128 dsx = _mm_mul_ps(_mm_mul_ps(six, rx0), _mm_sub_ps(onef, rx0));
+	__m128 dsy = _mm_mul_ps(_mm_mul_ps(six, ry0), _mm_sub_ps(onef, ry0));
+
+	__m128 g0x, g0y, g1x, g1y;
+	gradients4(e, _mm_add_epi32(i, by0), &g0x, &g0y);
+	gradients4(e, _mm_add_epi32(j, by0), &g1x, &g1y);
+	__m128 u = _mm_add_ps(_mm_mul_ps(rx0, g0x), _mm_mul_ps(ry0, g0y));
+	__m128 v = _mm_add_ps(_mm_mul_ps(rx1, g1x), _mm_mul_ps(ry0, g1y));
+	__m128 a = _mm_add_ps(u, _mm_mul_ps(sx, _mm_sub_ps(v, u)));
+	__m128 dax = _mm_add_ps(_mm_add_ps(g0x, _mm_mul_ps(dsx, _mm_sub_ps(v, u))), _mm_mul_ps(sx, _mm_sub_ps(g1x, g0x)));
+	__m128 day = _mm_add_ps(g0y, _mm_mul_ps(sx, _mm_sub_ps(g1y, g0y)));
+
+	gradients4(e, _mm_add_epi32(i, by1), &g0x, &g0y);
+	gradients4(e, _mm_add_epi32(j, by1), &g1x, &g1y);
+	u = _mm_add_ps(_mm_mul_ps(rx0, g0x), _mm_mul_ps(ry1, g0y));
+	v = _mm_add_ps(_mm_mul_ps(rx1, g1x), _mm_mul_ps(ry1, g1y));
+	__m128 b = _mm_add_ps(u, _mm_mul_ps(sx, _mm_sub_ps(v, u)));
+	__m128 dbx = _mm_add_ps(_mm_add_ps(g0x, _mm_mul_ps(dsx, _mm_sub_ps(v, u))), _mm_mul_ps(sx, _mm_sub_ps(g1x, g0x)));
+	__m128 dby = _mm_add_ps(g0y, _mm_mul_ps(sx, _mm_sub_ps(g1y, g0y)));
+
+	*dx = _mm_add_ps(dax, _mm_mul_ps(sy, _mm_sub_ps(dbx, dax)));
+	*dy = _mm_add_ps(_mm_add_ps(day, _mm_mul_ps(dsy, _mm_sub_ps(b, a))), _mm_mul_ps(sy, _mm_sub_ps(dby, day)));
+	return _mm_add_ps(a, _mm_mul_ps(sy, _mm_sub_ps(b, a)));
+}
+
+/// Returns number of points processed, the remainder is left for the scalar path
+PERLIN_TARGET("sse4.1")
+static size_t batchGradSSE4(const NoiseEntry2D* e, int octaves, float freq, float amplitude,
+	const float* xs, const float* zs, float* out, float* dxs, float* dzs, size_t n)
+{
+	size_t k = 0;
+	for (; k + 4 <= n; k += 4)
+	{
+		__m128 vx = _mm_mul_ps(_mm_loadu_ps(xs + k), _mm_set1_ps(freq));
+		__m128 vy = _mm_mul_ps(_mm_loadu_ps(zs + k), _mm_set1_ps(freq));
+		__m128 result = _mm_setzero_ps();
+		__m128 gx = _mm_setzero_ps();
+		__m128 gy = _mm_setzero_ps();
+		float amp = amplitude;
+		float scale = freq;
+
+		for (int o = 0; o < octaves; o++)
+		{
+			__m128 nx, ny;
+			result = _mm_add_ps(result, _mm_mul_ps(noise2GradSSE4(e, vx, vy, &nx, &ny), _mm_set1_ps(amp)));
+			gx = _mm_add_ps(gx, _mm_mul_ps(_mm_mul_ps(nx, _mm_set1_ps(amp)), _mm_set1_ps(scale)));
+			gy = _mm_add_ps(gy, _mm_mul_ps(_mm_mul_ps(ny, _mm_set1_ps(amp)), _mm_set1_ps(scale)));
+			vx = _mm_mul_ps(vx, _mm_set1_ps(2.0f));
+			vy = _mm_mul_ps(vy, _mm_set1_ps(2.0f));
+			amp *= 0.5f;
+			scale *= 2.0f;
+		}
+		_mm_storeu_ps(out + k, result);
+		_mm_storeu_ps(dxs + k, gx);
+		_mm_storeu_ps(dzs + k, gy);
+	}
+	return k;
+}
 
+PERLIN_TARGET("avx2")
+static inline __m256i perm8(const NoiseEntry2D* e, __m256i idx)
+{
+	__m256i offset = _mm256_add_epi32(_mm256_slli_epi32(idx, 1), idx);
+	return _mm256_i32gather_epi32(&e[0].perm, offset, 4);
+}
+
+PERLIN_TARGET("avx2")
+static inline void gradients8(const NoiseEntry2D* e, __m256i idx, __m256* gx, __m256* gy)
+{
+	__m256i offset = _mm256_add_epi32(_mm256_slli_epi32(idx, 1), idx);
+	*gx = _mm256_i32gather_ps(&e[0].gx, offset, 4);
+	*gy = _mm256_i32gather_ps(&e[0].gy, offset, 4);
+}
+
+PERLIN_TARGET("avx2")
+static inline __m256 gradient8(const NoiseEntry2D* e, __m256i idx, __m256 rx, __m256 ry)
+{
+	__m256 gx, gy;
+	gradients8(e, idx, &gx, &gy);
+	return _mm256_add_ps(_mm256_mul_ps(rx, gx), _mm256_mul_ps(ry, gy));
+}
+
+PERLIN_TARGET("avx2")
+static __m256 noise2AVX2(const NoiseEntry2D* e, __m256 vx, __m256 vy)
+{
+	const __m256i bm = _mm256_set1_epi32(BM);
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256 onef = _mm256_set1_ps(1.0f);
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 three = _mm256_set1_ps(3.0f);
+
+	__m256 tx = _mm256_add_ps(vx, _mm256_set1_ps((float)N));
+	__m256i ix = _mm256_cvttps_epi32(tx);
+	__m256i bx0 = _mm256_and_si256(ix, bm);
+	__m256i bx1 = _mm256_and_si256(_mm256_add_epi32(bx0, one), bm);
+	__m256 rx0 = _mm256_sub_ps(tx, _mm256_cvtepi32_ps(ix));
+	__m256 rx1 = _mm256_sub_ps(rx0, onef);
+
+	__m256 ty = _mm256_add_ps(vy, _mm256_set1_ps((float)N));
+	__m256i iy = _mm256_cvttps_epi32(ty);
+	__m256i by0 = _mm256_and_si256(iy, bm);
+	__m256i by1 = _mm256_and_si256(_mm256_add_epi32(by0, one), bm);
+	__m256 ry0 = _mm256_sub_ps(ty, _mm256_cvtepi32_ps(iy));
+	__m256 ry1 = _mm256_sub_ps(ry0, onef);
+
+	__m256i i = perm8(e, bx0);
+	__m256i j = perm8(e, bx1);
+
+	__m256i b00 = _mm256_add_epi32(i, by0);
+	__m256i b10 = _mm256_add_epi32(j, by0);
+	__m256i b01 = _mm256_add_epi32(i, by1);
+	__m256i b11 = _mm256_add_epi32(j, by1);
+
+	__m256 sx = _mm256_mul_ps(_mm256_mul_ps(rx0, rx0), _mm256_sub_ps(three, _mm256_mul_ps(two, rx0)));
+	__m256 sy = _mm256_mul_ps(_mm256_mul_ps(ry0, ry0), _mm256_sub_ps(three, _mm256_mul_ps(two, ry0)));
+
+	__m256 u = gradient8(e, b00, rx0, ry0);
+	__m256 v = gradient8(e, b10, rx1, ry0);
+	__m256 a = _mm256_add_ps(u, _mm256_mul_ps(sx, _mm256_sub_ps(v, u)));
+
+	u = gradient8(e, b01, rx0, ry1);
+	v = gradient8(e, b11, rx1, ry1);
+	__m256 b = _mm256_add_ps(u, _mm256_mul_ps(sx, _mm256_sub_ps(v, u)));
+
+	return _mm256_add_ps(a, _mm256_mul_ps(sy, _mm256_sub_ps(b, a)));
+}
+
+/// Returns number of points processed, the remainder is left for the scalar path
+PERLIN_TARGET("avx2")
+static size_t batchAVX2(const NoiseEntry2D* e, int octaves, float freq, float amplitude,
+	const float* xs, const float* zs, float* out, size_t n)
+{
+	size_t k = 0;
+	for (; k + 8 <= n; k += 8)
+	{
+		__m256 vx = _mm256_mul_ps(_mm256_loadu_ps(xs + k), _mm256_set1_ps(freq));
+		__m256 vy = _mm256_mul_ps(_mm256_loadu_ps(zs + k), _mm256_set1_ps(freq));
+		__m256 result = _mm256_setzero_ps();
+		float amp = amplitude;
+
+		for (int o = 0; o < octaves; o++)
+		{
+			result = _mm256_add_ps(result, _mm256_mul_ps(noise2AVX2(e, vx, vy), _mm256_set1_ps(amp)));
+			vx = _mm256_mul_ps(vx, _mm256_set1_ps(2.0f));
+			vy = _mm256_mul_ps(vy, _mm256_set1_ps(2.0f));
+			amp *= 0.5f;
+		}
+		_mm256_storeu_ps(out + k, result);
+	}
+	return k;
+}
+
+/* noise2AVX2 with the derivatives of the lerp chain, mirrors noise2_grad */
+PERLIN_TARGET("avx2")
+static __m256 noise2GradAVX2(const NoiseEntry2D* e, __m256 vx, __m256 vy, __m256* dx, __m256* dy)
+{
+	const __m256i bm = _mm256_set1_epi32(BM);
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256 onef = _mm256_set1_ps(1.0f);
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 three = _mm256_set1_ps(3.0f);
+	const __m256 six = _mm256_set1_ps(6.0f);
+
+	__m256 tx = _mm256_add_ps(vx, _mm256_set1_ps((float)N));
+	__m256i ix = _mm256_cvttps_epi32(tx);
+	__m256i bx0 = _mm256_and_si256(ix, bm);
+	__m256i bx1 = _mm256_and_si256(_mm256_add_epi32(bx0, one), bm);
+	__m256 rx0 = _mm256_sub_ps(tx, _mm256_cvtepi32_ps(ix));
+	__m256 rx1 = _mm256_sub_ps(rx0, onef);
+
+	__m256 ty = _mm256_add_ps(vy, _mm256_set1_ps((float)N));
+	__m256i iy = _mm256_cvttps_epi32(ty);
+	__m256i by0 = _mm256_and_si256(iy, bm);
+	__m256i by1 = _mm256_and_si256(_mm256_add_epi32(by0, one), bm);
+	__m256 ry0 = _mm256_sub_ps(ty, _mm256_cvtepi32_ps(iy));
+	__m256 ry1 = _mm256_sub_ps(ry0, onef);
+
+	__m256i i = perm8(e, bx0);
+	__m256i j = perm8(e, bx1);
+
+	__m256 sx = _mm256_mul_ps(_mm256_mul_ps(rx0, rx0), _mm256_sub_ps(three, _mm256_mul_ps(two, rx0)));
+	__m256 sy = _mm256_mul_ps(_mm256_mul_ps(ry0, ry0), _mm256_sub_ps(three, _mm256_mul_ps(two, ry0)));
+	__m256 dsx = _mm256_mul_ps(_mm256_mul_ps(six, rx0), _mm256_sub_ps(onef, rx0));
+	__m256 dsy = _mm256_mul_ps(_mm256_mul_ps(six, ry0), _mm256_sub_ps(onef, ry0));
+
+	__m256 g0x, g0y, g1x, g1y;
+	gradients8(e, _mm256_add_epi32(i, by0), &g0x, &g0y);
+	gradients8(e, _mm256_add_epi32(j, by0), &g1x, &g1y);
+	__m256 u = _mm256_add_ps(_mm256_mul_ps(rx0, g0x), _mm256_mul_ps(ry0, g0y));
+	__m256 v = _mm256_add_ps(_mm256_mul_ps(rx1, g1x), _mm256_mul_ps(ry0, g1y));
+	__m256 a = _mm256_add_ps(u, _mm256_mul_ps(sx, _mm256_sub_ps(v, u)));
+	__m256 dax = _mm256_add_ps(_mm256_add_ps(g0x, _mm256_mul_ps(dsx, _mm256_sub_ps(v, u))), _mm256_mul_ps(sx, _mm256_sub_ps(g1x, g0x)));
+	__m256 day = _mm256_add_ps(g0y, _mm256_mul_ps(sx, _mm256_sub_ps(g1y, g0y)));
+
+	gradients8(e, _mm256_add_epi32(i, by1), &g0x, &g0y);
+	gradients8(e, _mm256_add_epi32(j, by1), &g1x, &g1y);
+	u = _mm256_add_ps(_mm256_mul_ps(rx0, g0x), _mm256_mul_ps(ry1, g0y));
+	v = _mm256_add_ps(_mm256_mul_ps(rx1, g1x), _mm256_mul_ps(ry1, g1y));
+	__m256 b = _mm256_add_ps(u, _mm256_mul_ps(sx, _mm256_sub_ps(v, u)));
+	__m256 dbx = _mm256_add_ps(_mm256_add_ps(g0x, _mm256_mul_ps(dsx, _mm256_sub_ps(v, u))), _mm256_mul_ps(sx, _mm256_sub_ps(g1x, g0x)));
+	__m256 dby = _mm256_add_ps(g0y, _mm256_mul_ps(sx, _mm256_sub_ps(g1y, g0y)));
+
+	*dx = _mm256_add_ps(dax, _mm256_mul_ps(sy, _mm256_sub_ps(dbx, dax)));
+	*dy = _mm256_add_ps(_mm256_add_ps(day, _mm256_mul_ps(dsy, _mm256_sub_ps(b, a))), _mm256_mul_ps(sy, _mm256_sub_ps(dby, day)));
+	return _mm256_add_ps(a, _mm256_mul_ps(sy, _mm256_sub_ps(b, a)));
+}
+
+/// Returns number of points processed, the remainder is left for the scalar path
+PERLIN_TARGET("avx2")
+static size_t batchGradAVX2(const NoiseEntry2D* e, int octaves, float freq, float amplitude,
+	const float* xs, const float* zs, float* out, float* dxs, float* dzs, size_t n)
+{
+	size_t k = 0;
+	for (; k + 8 <= n; k += 8)
+	{
+		__m256 vx = _mm256_mul_ps(_mm256_loadu_ps(xs + k), _mm256_set1_ps(freq));
+		__m256 vy = _mm256_mul_ps(_mm256_loadu_ps(zs + k), _mm256_set1_ps(freq));
+		__m256 result = _mm256_setzero_ps();
+		__m256 gx = _mm256_setzero_ps();
+		__m256 gy = _mm256_setzero_ps();
+		float amp = amplitude;
+		float scale = freq;
+
+		for (int o = 0; o < octaves; o++)
+		{
+			__m256 nx, ny;
+			result = _mm256_add_ps(result, _mm256_mul_ps(noise2GradAVX2(e, vx, vy, &nx, &ny), _mm256_set1_ps(amp)));
+			gx = _mm256_add_ps(gx, _mm256_mul_ps(_mm256_mul_ps(nx, _mm256_set1_ps(amp)), _mm256_set1_ps(scale)));
+			gy = _mm256_add_ps(gy, _mm256_mul_ps(_mm256_mul_ps(ny, _mm256_set1_ps(amp)), _mm256_set1_ps(scale)));
+			vx = _mm256_mul_ps(vx, _mm256_set1_ps(2.0f));
+			vy = _mm256_mul_ps(vy, _mm256_set1_ps(2.0f));
+			amp *= 0.5f;
+			scale *= 2.0f;
+		}
+		_mm256_storeu_ps(out + k, result);
+		_mm256_storeu_ps(dxs + k, gx);
+		_mm256_storeu_ps(dzs + k, gy);
+	}
+	return k;
+}
+
+/* lattice value hash, 8 lanes at a time without any table gathers */
+PERLIN_TARGET("avx2")
+static inline __m256 latticeValue8(__m256i x, __m256i y, __m256i seed)
+{
+	__m256i h = _mm256_xor_si256(seed, _mm256_xor_si256(
+		_mm256_mullo_epi32(x, _mm256_set1_epi32((int)0x27d4eb2du)),
+		_mm256_mullo_epi32(y, _mm256_set1_epi32((int)0x165667b1u))));
+	h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+	h = _mm256_mullo_epi32(h, _mm256_set1_epi32((int)0x85ebca6bu));
+	h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 13));
+	h = _mm256_mullo_epi32(h, _mm256_set1_epi32((int)0xc2b2ae35u));
+	h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+	__m256 v = _mm256_cvtepi32_ps(_mm256_srli_epi32(h, 8));
+	return _mm256_sub_ps(_mm256_mul_ps(v, _mm256_set1_ps(2.0f / 16777215.0f)), _mm256_set1_ps(1.0f));
+}
+
+PERLIN_TARGET("avx2")
+static __m256 value2AVX2(__m256i seed, __m256 vx, __m256 vy)
+{
+	const __m256i bm = _mm256_set1_epi32(BM);
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 three = _mm256_set1_ps(3.0f);
+
+	__m256 tx = _mm256_add_ps(vx, _mm256_set1_ps((float)N));
+	__m256i ix = _mm256_cvttps_epi32(tx);
+	__m256i bx0 = _mm256_and_si256(ix, bm);
+	__m256i bx1 = _mm256_and_si256(_mm256_add_epi32(bx0, one), bm);
+	__m256 rx0 = _mm256_sub_ps(tx, _mm256_cvtepi32_ps(ix));
+
+	__m256 ty = _mm256_add_ps(vy, _mm256_set1_ps((float)N));
+	__m256i iy = _mm256_cvttps_epi32(ty);
+	__m256i by0 = _mm256_and_si256(iy, bm);
+	__m256i by1 = _mm256_and_si256(_mm256_add_epi32(by0, one), bm);
+	__m256 ry0 = _mm256_sub_ps(ty, _mm256_cvtepi32_ps(iy));
+
+	__m256 sx = _mm256_mul_ps(_mm256_mul_ps(rx0, rx0), _mm256_sub_ps(three, _mm256_mul_ps(two, rx0)));
+	__m256 sy = _mm256_mul_ps(_mm256_mul_ps(ry0, ry0), _mm256_sub_ps(three, _mm256_mul_ps(two, ry0)));
+
+	__m256 u = latticeValue8(bx0, by0, seed);
+	__m256 v = latticeValue8(bx1, by0, seed);
+	__m256 a = _mm256_add_ps(u, _mm256_mul_ps(sx, _mm256_sub_ps(v, u)));
+
+	u = latticeValue8(bx0, by1, seed);
+	v = latticeValue8(bx1, by1, seed);
+	__m256 b = _mm256_add_ps(u, _mm256_mul_ps(sx, _mm256_sub_ps(v, u)));
+
+	return _mm256_add_ps(a, _mm256_mul_ps(sy, _mm256_sub_ps(b, a)));
+}
+
+/// Returns number of points processed, the remainder is left for the scalar path
+PERLIN_TARGET("avx2")
+static size_t batchValueAVX2(uint32_t seed, int octaves, float freq, float amplitude,
+	const float* xs, const float* zs, float* out, size_t n)
+{
+	__m256i vseed = _mm256_set1_epi32((int)seed);
+	size_t k = 0;
+	for (; k + 8 <= n; k += 8)
+	{
+		__m256 vx = _mm256_mul_ps(_mm256_loadu_ps(xs + k), _mm256_set1_ps(freq));
+		__m256 vy = _mm256_mul_ps(_mm256_loadu_ps(zs + k), _mm256_set1_ps(freq));
+		__m256 result = _mm256_setzero_ps();
+		float amp = amplitude;
+
+		for (int o = 0; o < octaves; o++)
+		{
+			result = _mm256_add_ps(result, _mm256_mul_ps(value2AVX2(vseed, vx, vy), _mm256_set1_ps(amp)));
+			vx = _mm256_mul_ps(vx, _mm256_set1_ps(2.0f));
+			vy = _mm256_mul_ps(vy, _mm256_set1_ps(2.0f));
+			amp *= 0.5f;
+		}
+		_mm256_storeu_ps(out + k, result);
+	}
+	return k;
+}
 
-Perlin::Perlin(int octaves, float freq, float amp, int seed)
+/* floor of 8 lanes, mirrors fastfloor */
+PERLIN_TARGET("avx2")
+static inline __m256i fastfloor8(__m256 x)
+{
+	__m256i xi = _mm256_cvttps_epi32(x);
+	__m256i below = _mm256_castps_si256(_mm256_cmp_ps(x, _mm256_cvtepi32_ps(xi), _CMP_LT_OQ));
+	return _mm256_add_epi32(xi, below);
+}
+
+/* simplexCorner for 8 lanes, the corner hash is one gather per gradient component */
+PERLIN_TARGET("avx2")
+static inline __m256 simplexCorner8(const NoiseEntry2D* e, __m256i x, __m256i y, __m256 ox, __m256 oy, __m256i seed)
+{
+	__m256 a = _mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(RSQUARED_2D), _mm256_mul_ps(ox, ox)), _mm256_mul_ps(oy, oy));
+	a = _mm256_max_ps(_mm256_setzero_ps(), a);
+	__m256i h = _mm256_xor_si256(_mm256_xor_si256(seed,
+		_mm256_mullo_epi32(x, _mm256_set1_epi32(0x5205402b))),
+		_mm256_mullo_epi32(y, _mm256_set1_epi32(0x598cd327)));
+	h = _mm256_srli_epi32(_mm256_mullo_epi32(h, _mm256_set1_epi32(0x53a3f72d)), SIMPLEX_HASH_SHIFT);
+	__m256 gx, gy;
+	gradients8(e, h, &gx, &gy);
+	__m256 a2 = _mm256_mul_ps(a, a);
+	return _mm256_mul_ps(_mm256_mul_ps(a2, a2), _mm256_add_ps(_mm256_mul_ps(gx, ox), _mm256_mul_ps(gy, oy)));
+}
+
+PERLIN_TARGET("avx2")
+static __m256 simplex2AVX2(const NoiseEntry2D* e, __m256i seed, __m256 vx, __m256 vy)
+{
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256 onef = _mm256_set1_ps(1.0f);
+	const __m256 unskew = _mm256_set1_ps(UNSKEW_2D);
+	const __m256 unskew2 = _mm256_set1_ps(2.0f * UNSKEW_2D);
+
+	__m256 s = _mm256_mul_ps(_mm256_add_ps(vx, vy), _mm256_set1_ps(SKEW_2D));
+	__m256 xs = _mm256_add_ps(vx, s);
+	__m256 ys = _mm256_add_ps(vy, s);
+	__m256i xsb = fastfloor8(xs);
+	__m256i ysb = fastfloor8(ys);
+	__m256 xi = _mm256_sub_ps(xs, _mm256_cvtepi32_ps(xsb));
+	__m256 yi = _mm256_sub_ps(ys, _mm256_cvtepi32_ps(ysb));
+	__m256 t = _mm256_mul_ps(_mm256_add_ps(xi, yi), unskew);
+	__m256 dx0 = _mm256_add_ps(xi, t);
+	__m256 dy0 = _mm256_add_ps(yi, t);
+
+	/* third corner is (1, 0) or (0, 1) depending on which half of the skewed cell we're in */
+	__m256i i1 = _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(xi, yi, _CMP_GT_OQ)), one);
+	__m256i j1 = _mm256_sub_epi32(one, i1);
+
+	__m256 value = simplexCorner8(e, xsb, ysb, dx0, dy0, seed);
+	value = _mm256_add_ps(value, simplexCorner8(e, _mm256_add_epi32(xsb, one), _mm256_add_epi32(ysb, one),
+		_mm256_sub_ps(_mm256_sub_ps(dx0, onef), unskew2), _mm256_sub_ps(_mm256_sub_ps(dy0, onef), unskew2), seed));
+	value = _mm256_add_ps(value, simplexCorner8(e, _mm256_add_epi32(xsb, i1), _mm256_add_epi32(ysb, j1),
+		_mm256_sub_ps(_mm256_sub_ps(dx0, _mm256_cvtepi32_ps(i1)), unskew), _mm256_sub_ps(_mm256_sub_ps(dy0, _mm256_cvtepi32_ps(j1)), unskew), seed));
+
+	return _mm256_mul_ps(value, _mm256_set1_ps(SIMPLEX_SCALE_2D));
+}
+
+/// Returns number of points processed, the remainder is left for the scalar path
+PERLIN_TARGET("avx2")
+static size_t batchSimplexAVX2(const NoiseEntry2D* e, uint32_t seed, int octaves, float freq, float amplitude,
+	const float* xs, const float* zs, float* out, size_t n)
+{
+	__m256i vseed = _mm256_set1_epi32((int)seed);
+	size_t k = 0;
+	for (; k + 8 <= n; k += 8)
+	{
+		__m256 vx = _mm256_mul_ps(_mm256_loadu_ps(xs + k), _mm256_set1_ps(freq));
+		__m256 vy = _mm256_mul_ps(_mm256_loadu_ps(zs + k), _mm256_set1_ps(freq));
+		__m256 result = _mm256_setzero_ps();
+		float amp = amplitude;
+
+		for (int o = 0; o < octaves; o++)
+		{
+			result = _mm256_add_ps(result, _mm256_mul_ps(simplex2AVX2(e, vseed, vx, vy), _mm256_set1_ps(amp)));
+			vx = _mm256_mul_ps(vx, _mm256_set1_ps(2.0f));
+			vy = _mm256_mul_ps(vy, _mm256_set1_ps(2.0f));
+			amp *= 0.5f;
+		}
+		_mm256_storeu_ps(out + k, result);
+	}
+	return k;
+}
+
+/* value2AVX2 with derivatives, mirrors value2_grad */
+PERLIN_TARGET("avx2")
+static __m256 value2GradAVX2(__m256i seed, __m256 vx, __m256 vy, __m256* dx, __m256* dy)
+{
+	const __m256i bm = _mm256_set1_epi32(BM);
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256 onef = _mm256_set1_ps(1.0f);
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 three = _mm256_set1_ps(3.0f);
+	const __m256 six = _mm256_set1_ps(6.0f);
+
+	__m256 tx = _mm256_add_ps(vx, _mm256_set1_ps((float)N));
+	__m256i ix = _mm256_cvttps_epi32(tx);
+	__m256i bx0 = _mm256_and_si256(ix, bm);
+	__m256i bx1 = _mm256_and_si256(_mm256_add_epi32(bx0, one), bm);
+	__m256 rx0 = _mm256_sub_ps(tx, _mm256_cvtepi32_ps(ix));
+
+	__m256 ty = _mm256_add_ps(vy, _mm256_set1_ps((float)N));
+	__m256i iy = _mm256_cvttps_epi32(ty);
+	__m256i by0 = _mm256_and_si256(iy, bm);
+	__m256i by1 = _mm256_and_si256(_mm256_add_epi32(by0, one), bm);
+	__m256 ry0 = _mm256_sub_ps(ty, _mm256_cvtepi32_ps(iy));
+
+	__m256 sx = _mm256_mul_ps(_mm256_mul_ps(rx0, rx0), _mm256_sub_ps(three, _mm256_mul_ps(two, rx0)));
+	__m256 sy = _mm256_mul_ps(_mm256_mul_ps(ry0, ry0), _mm256_sub_ps(three, _mm256_mul_ps(two, ry0)));
+	__m256 dsx = _mm256_mul_ps(_mm256_mul_ps(six, rx0), _mm256_sub_ps(onef, rx0));
+	__m256 dsy = _mm256_mul_ps(_mm256_mul_ps(six, ry0), _mm256_sub_ps(onef, ry0));
+
+	__m256 v00 = latticeValue8(bx0, by0, seed);
+	__m256 v10 = latticeValue8(bx1, by0, seed);
+	__m256 v01 = latticeValue8(bx0, by1, seed);
+	__m256 v11 = latticeValue8(bx1, by1, seed);
+
+	__m256 a = _mm256_add_ps(v00, _mm256_mul_ps(sx, _mm256_sub_ps(v10, v00)));
+	__m256 b = _mm256_add_ps(v01, _mm256_mul_ps(sx, _mm256_sub_ps(v11, v01)));
+
+	__m256 dax = _mm256_mul_ps(dsx, _mm256_sub_ps(v10, v00));
+	__m256 dbx = _mm256_mul_ps(dsx, _mm256_sub_ps(v11, v01));
+	*dx = _mm256_add_ps(dax, _mm256_mul_ps(sy, _mm256_sub_ps(dbx, dax)));
+	*dy = _mm256_mul_ps(dsy, _mm256_sub_ps(b, a));
+	return _mm256_add_ps(a, _mm256_mul_ps(sy, _mm256_sub_ps(b, a)));
+}
+
+/// Returns number of points processed, the remainder is left for the scalar path
+PERLIN_TARGET("avx2")
+static size_t batchValueGradAVX2(uint32_t seed, int octaves, float freq, float amplitude,
+	const float* xs, const float* zs, float* out, float* dxs, float* dzs, size_t n)
+{
+	__m256i vseed = _mm256_set1_epi32((int)seed);
+	size_t k = 0;
+	for (; k + 8 <= n; k += 8)
+	{
+		__m256 vx = _mm256_mul_ps(_mm256_loadu_ps(xs + k), _mm256_set1_ps(freq));
+		__m256 vy = _mm256_mul_ps(_mm256_loadu_ps(zs + k), _mm256_set1_ps(freq));
+		__m256 result = _mm256_setzero_ps();
+		__m256 gx = _mm256_setzero_ps();
+		__m256 gy = _mm256_setzero_ps();
+		float amp = amplitude;
+		float scale = freq;
+
+		for (int o = 0; o < octaves; o++)
+		{
+			__m256 nx, ny;
+			result = _mm256_add_ps(result, _mm256_mul_ps(value2GradAVX2(vseed, vx, vy, &nx, &ny), _mm256_set1_ps(amp)));
+			gx = _mm256_add_ps(gx, _mm256_mul_ps(_mm256_mul_ps(nx, _mm256_set1_ps(amp)), _mm256_set1_ps(scale)));
+			gy = _mm256_add_ps(gy, _mm256_mul_ps(_mm256_mul_ps(ny, _mm256_set1_ps(amp)), _mm256_set1_ps(scale)));
+			vx = _mm256_mul_ps(vx, _mm256_set1_ps(2.0f));
+			vy = _mm256_mul_ps(vy, _mm256_set1_ps(2.0f));
+			amp *= 0.5f;
+			scale *= 2.0f;
+		}
+		_mm256_storeu_ps(out + k, result);
+		_mm256_storeu_ps(dxs + k, gx);
+		_mm256_storeu_ps(dzs + k, gy);
+	}
+	return k;
+}
+
+#endif
+
+static NoiseKernel bestKernel()
+{
+#ifdef PERLIN_X86
+	static const NoiseKernel best = cpuSupportsAVX2() ? NOISE_KERNEL_AVX2
+		: cpuSupportsSSE4() ? NOISE_KERNEL_SSE4 : NOISE_KERNEL_SCALAR;
+	return best;
+#else
+	return NOISE_KERNEL_SCALAR;
+#endif
+}
+
+void Perlin::setKernel(NoiseKernel kernel)
+{
+	Perlin::kernel = kernel;
+}
+
+NoiseKernel Perlin::activeKernel()
+{
+	NoiseKernel best = bestKernel();
+	if (kernel == NOISE_KERNEL_AUTO || kernel > best)
+		return best;
+	return kernel;
+}
+
+void Perlin::GetBatch(const float* xs, const float* zs, float* out, size_t n) const
+{
+	size_t done = 0;
+
+#ifdef PERLIN_X86
+	NoiseKernel active = activeKernel();
+	if (mBackend == NOISE_BACKEND_PERLIN && active == NOISE_KERNEL_AVX2)
+		done = batchAVX2(mTable->entries, mOctaves, mFrequency, mAmplitude, xs, zs, out, n);
+	else if (mBackend == NOISE_BACKEND_PERLIN && active == NOISE_KERNEL_SSE4)
+		done = batchSSE4(mTable->entries, mOctaves, mFrequency, mAmplitude, xs, zs, out, n);
+	else if (mBackend == NOISE_BACKEND_OPENSIMPLEX2 && active == NOISE_KERNEL_AVX2)
+		done = batchSimplexAVX2(mTable->entries, (uint32_t)mSeed, mOctaves, mFrequency, mAmplitude, xs, zs, out, n);
+	else if (mBackend == NOISE_BACKEND_VALUE && active == NOISE_KERNEL_AVX2)
+		done = batchValueAVX2((uint32_t)mSeed, mOctaves, mFrequency, mAmplitude, xs, zs, out, n);
+#endif
+
+	for (size_t k = done; k < n; k++)
+	{
+		out[k] = Get(xs[k], zs[k]);
+	}
+}
+
+void Perlin::GetBatchWithGradient(const float* xs, const float* zs, float* out, float* dxs, float* dzs, size_t n) const
+{
+	size_t done = 0;
+
+#ifdef PERLIN_X86
+	NoiseKernel active = activeKernel();
+	if (mBackend == NOISE_BACKEND_PERLIN && active == NOISE_KERNEL_AVX2)
+		done = batchGradAVX2(mTable->entries, mOctaves, mFrequency, mAmplitude, xs, zs, out, dxs, dzs, n);
+	else if (mBackend == NOISE_BACKEND_PERLIN && active == NOISE_KERNEL_SSE4)
+		done = batchGradSSE4(mTable->entries, mOctaves, mFrequency, mAmplitude, xs, zs, out, dxs, dzs, n);
+	else if (mBackend == NOISE_BACKEND_VALUE && active == NOISE_KERNEL_AVX2)
+		done = batchValueGradAVX2((uint32_t)mSeed, mOctaves, mFrequency, mAmplitude, xs, zs, out, dxs, dzs, n);
+#endif
+
+	for (size_t k = done; k < n; k++)
+	{
+		out[k] = GetWithGradient(xs[k], zs[k], &dxs[k], &dzs[k]);
+	}
+}
+
+Perlin::Perlin(int octaves, float freq, float amp, int seed, NoiseBackend backend)
 {
 	mOctaves = octaves;
 	mFrequency = freq;
 	mAmplitude = amp;
 	mSeed = seed;
-	mStart = true;
-	init();
+	mBackend = backend;
+	mTable = NoiseTable2D::get(seed);
+}
+
+NoiseBackend Perlin::backend() const
+{
+	return mBackend;
+}
+
+int Perlin::octaves() const
+{
+	return mOctaves;
+}
+
+float Perlin::frequency() const
+{
+	return mFrequency;
+}
+
+float Perlin::amplitude() const
+{
+	return mAmplitude;
+}
+
+int Perlin::seed() const
+{
+	return mSeed;
+}
+
+const NoiseTable2D& Perlin::table() const
+{
+	return *mTable;
 }
 
 Perlin::Perlin() {}
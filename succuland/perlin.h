@@ -6,52 +6,208 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <random>
+#include <utility>
+#include <memory>
+#include <cstdint>
 
 
 #define SAMPLE_SIZE 1024
 
+/// Vectorized kernels used by Perlin::GetBatch and Perlin::GetBatchWithGradient
+enum NoiseKernel
+{
+    NOISE_KERNEL_AUTO,
+    NOISE_KERNEL_SCALAR,
+    NOISE_KERNEL_SSE4,
+    NOISE_KERNEL_AVX2
+};
+
+/// Basis noise used by the fBm
+enum NoiseBackend
+{
+    /// Classic gradient noise, 4 lattice corners per sample
+    NOISE_BACKEND_PERLIN,
+    /// OpenSimplex2 style simplex noise, 3 lattice corners per sample
+    NOISE_BACKEND_OPENSIMPLEX2,
+    /// Value noise hashed from lattice coordinates and seed, doesn't use the tables
+    NOISE_BACKEND_VALUE
+};
+
+/// Lattice entry packing a permutation value with the gradient that value selects
+struct NoiseEntry2D
+{
+    int32_t perm;
+    float gx;
+    float gy;
+};
+
+/// <summary>
+/// Immutable permutation and gradient table for 2D noise. Entry k holds p[k] and g2[p[k]],
+/// so a lattice corner costs one load instead of a permutation and a gradient lookup,
+/// and the whole table (24 KB) stays resident in L1
+/// </summary>
+class NoiseTable2D
+{
+public:
+    alignas(64) NoiseEntry2D entries[SAMPLE_SIZE + SAMPLE_SIZE + 2];
+
+    explicit NoiseTable2D(int seed);
+
+    /// Get the table for a seed, tables are built once and shared while any noise object uses them
+    static std::shared_ptr<const NoiseTable2D> get(int seed);
+};
+
+/// 2D fBm over a selectable basis noise, copies are cheap and share the seed table
 class Perlin
 {
 public:
 
     Perlin();
-    Perlin(int octaves, float freq, float amp, int seed);
+    Perlin(int octaves, float freq, float amp, int seed, NoiseBackend backend = NOISE_BACKEND_PERLIN);
 
 
-    float Get(float x, float y) const
-    {
-        float vec[2];
-        vec[0] = x;
-        vec[1] = y;
-        return perlin_noise_2D(vec);
-    };
+    /// Evaluate the noise, dispatches to the Fbm specialization matching the octave count
+    float Get(float x, float y) const;
 
     float operator()(float x, float y) const {
         return Get(x, y);
     }
 
+    /// <summary>
+    /// Evaluate the noise and its analytic partial derivatives in one lattice walk
+    /// </summary>
+    /// <param name="x">x coordinate</param>
+    /// <param name="y">y coordinate</param>
+    /// <param name="dx">output derivative along x</param>
+    /// <param name="dy">output derivative along y</param>
+    /// <returns>same value as Get</returns>
+    float GetWithGradient(float x, float y, float* dx, float* dy) const;
+
+    /// <summary>
+    /// fBm with octave count, lacunarity and gain fixed at compile time, the octave loop
+    /// is unrolled and the amplitude and frequency series are constants
+    /// </summary>
+    /// <returns>same value as Get for Perlin with Octaves octaves when Lacunarity and Gain are defaults</returns>
+    template <int Octaves, float Lacunarity = 2.0f, float Gain = 0.5f>
+    float Fbm(float x, float y) const
+    {
+        return fbm_terms<Lacunarity, Gain>(x * mFrequency, y * mFrequency, std::make_integer_sequence<int, Octaves>());
+    }
+
+    /// Compile time specialized variant of GetWithGradient
+    template <int Octaves, float Lacunarity = 2.0f, float Gain = 0.5f>
+    float FbmWithGradient(float x, float y, float* dx, float* dy) const
+    {
+        return fbm_grad_terms<Lacunarity, Gain>(x * mFrequency, y * mFrequency, dx, dy, std::make_integer_sequence<int, Octaves>());
+    }
+
+    /// <summary>
+    /// Evaluate the noise for a batch of points, results are bit-identical to Get
+    /// </summary>
+    /// <param name="xs">x coordinates</param>
+    /// <param name="zs">z coordinates</param>
+    /// <param name="out">output heights</param>
+    /// <param name="n">number of points</param>
+    void GetBatch(const float* xs, const float* zs, float* out, size_t n) const;
+
+    /// <summary>
+    /// Evaluate the noise and its partial derivatives for a batch of points, results are bit-identical to GetWithGradient
+    /// </summary>
+    /// <param name="xs">x coordinates</param>
+    /// <param name="zs">z coordinates</param>
+    /// <param name="out">output heights</param>
+    /// <param name="dxs">output derivatives along x</param>
+    /// <param name="dzs">output derivatives along z</param>
+    /// <param name="n">number of points</param>
+    void GetBatchWithGradient(const float* xs, const float* zs, float* out, float* dxs, float* dzs, size_t n) const;
+
+    /// Force a batch kernel, kernels not supported by the CPU fall back to the best available one
+    static void setKernel(NoiseKernel kernel);
+    /// Kernel currently used by GetBatch and GetBatchWithGradient
+    static NoiseKernel activeKernel();
+
+    /// Basis noise selected at construction
+    NoiseBackend backend() const;
+
+    /// Construction parameters, used to reproduce the noise elsewhere (e.g. on the GPU)
+    int octaves() const;
+    float frequency() const;
+    float amplitude() const;
+    int seed() const;
+    /// Permutation and gradient table of the seed
+    const NoiseTable2D& table() const;
+
 private:
-    void init_perlin(int n, float p);
-    float perlin_noise_2D(float vec[2]) const;
+    /// Largest octave count Get and GetWithGradient dispatch to a specialization
+    static const int MAX_SPECIALIZED_OCTAVES = 8;
+
+    static constexpr float power(float base, int exp)
+    {
+        return exp == 0 ? 1.0f : base * power(base, exp - 1);
+    }
+
+    template <float Lacunarity, float Gain, int... I>
+    float fbm_terms(float x, float y, std::integer_sequence<int, I...>) const
+    {
+        float result = 0.0f;
+        ((result += octave(x * power(Lacunarity, I), y * power(Lacunarity, I)) * (mAmplitude * power(Gain, I))), ...);
+        return result;
+    }
+
+    template <float Lacunarity, float Gain, int... I>
+    float fbm_grad_terms(float x, float y, float* dx, float* dy, std::integer_sequence<int, I...>) const
+    {
+        float result = 0.0f;
+        float gx = 0.0f;
+        float gy = 0.0f;
+        ((result += octave_grad(x * power(Lacunarity, I), y * power(Lacunarity, I),
+            mAmplitude * power(Gain, I), mFrequency * power(Lacunarity, I), &gx, &gy)), ...);
+        *dx = gx;
+        *dy = gy;
+        return result;
+    }
+
+    float octave(float x, float y) const
+    {
+        float vec[2] = { x, y };
+        return basis(vec);
+    }
+
+    /// Weighted octave value, accumulates the weighted derivatives into gx and gy
+    float octave_grad(float x, float y, float amp, float freq, float* gx, float* gy) const
+    {
+        float vec[2] = { x, y };
+        float nx, ny;
+        float value = basis_grad(vec, &nx, &ny) * amp;
+        *gx += nx * amp * freq;
+        *gy += ny * amp * freq;
+        return value;
+    }
+
+    float perlin_noise_2D(float x, float y) const;
+    float perlin_noise_2D_grad(float x, float y, float* dx, float* dy) const;
+
+    /// Basis noise of the selected backend
+    float basis(float vec[2]) const;
+    float basis_grad(float vec[2], float* dx, float* dy) const;
 
-    float noise1(float arg);
     float noise2(float vec[2]) const;
-    float noise3(float vec[3]);
-    void normalize2(float v[2]);
-    void normalize3(float v[3]);
-    void init(void);
+    float noise2_grad(float vec[2], float* dx, float* dy) const;
+    float simplex2(float vec[2]) const;
+    float simplex2_grad(float vec[2], float* dx, float* dy) const;
+    float value2(float vec[2]) const;
+    float value2_grad(float vec[2], float* dx, float* dy) const;
 
     int   mOctaves;
     float mFrequency;
     float mAmplitude;
     int   mSeed;
+    NoiseBackend mBackend;
 
-    int p[SAMPLE_SIZE + SAMPLE_SIZE + 2];
-    float g3[SAMPLE_SIZE + SAMPLE_SIZE + 2][3];
-    float g2[SAMPLE_SIZE + SAMPLE_SIZE + 2][2];
-    float g1[SAMPLE_SIZE + SAMPLE_SIZE + 2];
-    bool  mStart;
+    std::shared_ptr<const NoiseTable2D> mTable;
 
+    static NoiseKernel kernel;
 };
 
 #endif
\ No newline at end of file
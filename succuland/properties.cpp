@@ -42,6 +42,13 @@ MaterialMap::~MaterialMap()
 		glDeleteTextures(1, &specularMap);
 }
 
+VirtualMaterial::VirtualMaterial(const glm::vec3& ambient, const glm::vec3& diffuse, const glm::vec3& specular, float shininess, VirtualTexture* texture, GLuint specularMap)
+	: Material(ambient, diffuse, specular, shininess),
+	texture(texture),
+	specularMap(specularMap)
+{
+}
+
 /*
 *	Light
 */
@@ -7,6 +7,8 @@
 #include "camera.h"
 #include <memory>
 
+class VirtualTexture;
+
 /// Simple material properties
 struct Material 
 {
@@ -31,6 +33,17 @@ struct MaterialMap : Material
 	~MaterialMap();
 };
 
+/// Terrain material whose diffuse map is streamed from a virtual texture, phong.frag looks it up by world position
+struct VirtualMaterial : Material
+{
+	/// Not owned
+	VirtualTexture* texture;
+	/// Specular map shared with another material, not owned, 0 for none
+	GLuint specularMap;
+
+	VirtualMaterial(const glm::vec3& ambient, const glm::vec3& diffuse, const glm::vec3& specular, float shininess, VirtualTexture* texture, GLuint specularMap = 0);
+};
+
 /// Data structure corresponding to same light struct in the shader
 struct GLSLLight 
 {
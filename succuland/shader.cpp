@@ -1,5 +1,8 @@
 #include "shader.h"
 #include "properties.h"
+#include "virtualtexture.h"
+
+#include <cmath>
 
 
 /*
@@ -27,6 +30,37 @@ Shader::Shader(std::string vertFileName, std::string fragFileName) : Shader()
 	}
 
 	GLuint shaders[] = { vertexShader, fragmentShader, 0 };
+	link(shaders);
+}
+
+Shader::Shader(std::string vertFileName, std::string tessControlFileName, std::string tessEvaluationFileName, std::string fragFileName) : Shader()
+{
+	GLuint vertexShader = pgr::createShaderFromFile(GL_VERTEX_SHADER, vertFileName);
+	if (vertexShader == 0) {
+		throw std::runtime_error("Failed to compile vertex shader");
+	}
+
+	GLuint tessControlShader = pgr::createShaderFromFile(GL_TESS_CONTROL_SHADER, tessControlFileName);
+	if (tessControlShader == 0) {
+		throw std::runtime_error("Failed to compile tessellation control shader");
+	}
+
+	GLuint tessEvaluationShader = pgr::createShaderFromFile(GL_TESS_EVALUATION_SHADER, tessEvaluationFileName);
+	if (tessEvaluationShader == 0) {
+		throw std::runtime_error("Failed to compile tessellation evaluation shader");
+	}
+
+	GLuint fragmentShader = pgr::createShaderFromFile(GL_FRAGMENT_SHADER, fragFileName);
+	if (fragmentShader == 0) {
+		throw std::runtime_error("Failed to compile fragment shader");
+	}
+
+	GLuint shaders[] = { vertexShader, tessControlShader, tessEvaluationShader, fragmentShader, 0 };
+	link(shaders);
+}
+
+void Shader::link(const GLuint* shaders)
+{
 	GLuint program = pgr::createProgram(shaders);
 	if (program == 0) {
 		throw std::runtime_error("Failed to compile program");
@@ -37,6 +71,9 @@ Shader::Shader(std::string vertFileName, std::string fragFileName) : Shader()
 	attributes.color = glGetAttribLocation(program, "aColor");
 	attributes.normal = glGetAttribLocation(program, "aNormal");
 	attributes.texCoord = glGetAttribLocation(program, "aTexCoord");
+	attributes.height = glGetAttribLocation(program, "aHeight");
+	attributes.packedNormal = glGetAttribLocation(program, "aPackedNormal");
+	attributes.patchOrigin = glGetAttribLocation(program, "aPatchOrigin");
 
 	uniforms.PVM = glGetUniformLocation(program, "PVM");
 	uniforms.ViewM = glGetUniformLocation(program, "ViewM");
@@ -75,14 +112,23 @@ void Shader::loadFog() const
 	setInteger("fog.isEnabled", fog->isVisible);
 }
 
-void Shader::setTransformParameters(const Camera& camera, const glm::mat4& model) const 
+void Shader::setTransformParameters(const Camera& camera, const glm::dmat4& model) const 
 {
-	glUniformMatrix4fv(uniforms.PVM, 1, GL_FALSE, glm::value_ptr(camera.projectMatrix() * camera.viewMatrix() * model));
+	glm::mat4 relative = glm::mat4(glm::translate(glm::dmat4(1.0), -camera.position) * model);
+	glUniformMatrix4fv(uniforms.PVM, 1, GL_FALSE, glm::value_ptr(camera.projectMatrix() * camera.viewMatrix() * relative));
 	glUniformMatrix4fv(uniforms.ViewM, 1, GL_FALSE, glm::value_ptr(camera.viewMatrix()));
-	glUniformMatrix4fv(uniforms.ModelM, 1, GL_FALSE, glm::value_ptr(model));
+	glUniformMatrix4fv(uniforms.ModelM, 1, GL_FALSE, glm::value_ptr(relative));
 	glUniformMatrix4fv(uniforms.ProjectM, 1, GL_FALSE, glm::value_ptr(camera.projectMatrix()));
 }
 
+void Shader::setTerrainGrid(const glm::vec2& /*origin*/, unsigned int /*width*/, float /*texSpacing*/) const
+{
+}
+
+void Shader::disableTerrain() const
+{
+}
+
 void Shader::setInteger(const std::string uniformName, int value) const 
 {
 	GLint location = glGetUniformLocation(program, uniformName.c_str());
@@ -118,17 +164,32 @@ void Shader::setMat4(const std::string uniformName, glm::mat4& value) const
 *	Lighting shader
 */
 
+UniformBufferObject* LightingShader::lights = nullptr;
+unsigned int LightingShader::lightsUsers = 0;
+unsigned int LightingShader::lightsLoadedNum = 0;
+
 LightingShader::LightingShader() 
 	: Shader(), 
-	uniforms({ -1 }), lightsLoadedNum(0) 
+	uniforms({ -1 })
 {
 }
 
 LightingShader::LightingShader(std::string vertexFile, std::string fragmentFile) 
-	: Shader(vertexFile, fragmentFile),
-	lightsLoadedNum(0)
+	: Shader(vertexFile, fragmentFile)
+{
+	initUniforms();
+}
+
+LightingShader::LightingShader(std::string vertexFile, std::string tessControlFile, std::string tessEvaluationFile, std::string fragmentFile)
+	: Shader(vertexFile, tessControlFile, tessEvaluationFile, fragmentFile)
+{
+	initUniforms();
+}
+
+void LightingShader::initUniforms()
 {
 	uniforms.PVM = glGetUniformLocation(program, "PVM");
+	uniforms.PV = glGetUniformLocation(program, "PV");
 	uniforms.ViewM = glGetUniformLocation(program, "ViewM");
 	uniforms.ModelM = glGetUniformLocation(program, "ModelM");
 	uniforms.NormalM = glGetUniformLocation(program, "NormalM");
@@ -151,34 +212,71 @@ LightingShader::LightingShader(std::string vertexFile, std::string fragmentFile)
 
 	uniforms.materialUseMaps = glGetUniformLocation(program, "material.useMaps");
 
-	uniforms.lightBlockIdx = glGetUniformBlockIndex(program, "Lights");
+	uniforms.terrainMode = glGetUniformLocation(program, "terrain.mode");
+	uniforms.terrainHeightMap = glGetUniformLocation(program, "terrain.heightMap");
+	uniforms.terrainNormalMap = glGetUniformLocation(program, "terrain.normalMap");
+	uniforms.terrainMapOrigin = glGetUniformLocation(program, "terrain.mapOrigin");
+	uniforms.terrainMapSize = glGetUniformLocation(program, "terrain.mapSize");
+	uniforms.terrainGridSize = glGetUniformLocation(program, "terrain.gridSize");
+	uniforms.terrainTexSpacing = glGetUniformLocation(program, "terrain.texSpacing");
+	uniforms.terrainNode = glGetUniformLocation(program, "terrain.node");
+	uniforms.terrainMorph = glGetUniformLocation(program, "terrain.morph");
+
+	uniforms.bakedSunEnabled = glGetUniformLocation(program, "bakedSun.enabled");
+	uniforms.bakedSunMap = glGetUniformLocation(program, "bakedSun.map");
+	uniforms.bakedSunOrigin = glGetUniformLocation(program, "bakedSun.origin");
+	uniforms.bakedSunSize = glGetUniformLocation(program, "bakedSun.size");
+
+	uniforms.virtualEnabled = glGetUniformLocation(program, "virtualTexture.enabled");
+	uniforms.virtualFeedback = glGetUniformLocation(program, "virtualTexture.feedback");
+	uniforms.virtualIndirection = glGetUniformLocation(program, "virtualTexture.indirection");
+	uniforms.virtualAtlas = glGetUniformLocation(program, "virtualTexture.atlas");
+	uniforms.virtualOrigin = glGetUniformLocation(program, "virtualTexture.origin");
+	uniforms.virtualSize = glGetUniformLocation(program, "virtualTexture.size");
+	uniforms.virtualPages = glGetUniformLocation(program, "virtualTexture.pages");
+	uniforms.virtualLevels = glGetUniformLocation(program, "virtualTexture.levels");
+	uniforms.virtualLevelBias = glGetUniformLocation(program, "virtualTexture.levelBias");
 
-	GLint lightBlockSize = 0;
-	glGetActiveUniformBlockiv(program, uniforms.lightBlockIdx, GL_UNIFORM_BLOCK_DATA_SIZE, &lightBlockSize);
+	uniforms.lightBlockIdx = glGetUniformBlockIndex(program, "Lights");
 
-	uniforms.lightUBO = new UniformBufferObject(lightBlockSize, LIGHTS_BINDING_POINT);
+	if (lights == nullptr)
+	{
+		GLint lightBlockSize = 0;
+		glGetActiveUniformBlockiv(program, uniforms.lightBlockIdx, GL_UNIFORM_BLOCK_DATA_SIZE, &lightBlockSize);
+		lights = new UniformBufferObject(lightBlockSize, LIGHTS_BINDING_POINT);
+	}
+	++lightsUsers;
+	uniforms.lightUBO = lights;
 	glUniformBlockBinding(program, uniforms.lightBlockIdx, LIGHTS_BINDING_POINT);
-
 }
 
 LightingShader::~LightingShader()
 {
-	delete uniforms.lightUBO;
+	if (uniforms.lightUBO != nullptr && --lightsUsers == 0)
+	{
+		delete lights;
+		lights = nullptr;
+	}
 }
 
-void LightingShader::setTransformParameters(const Camera& camera, const glm::mat4& model) const 
+void LightingShader::setTransformParameters(const Camera& camera, const glm::dmat4& model) const 
 {
-	glUniformMatrix4fv(uniforms.PVM, 1, GL_FALSE, glm::value_ptr(camera.projectMatrix() * camera.viewMatrix() * model));
+	glm::mat4 relative = glm::mat4(glm::translate(glm::dmat4(1.0), -camera.position) * model);
+	glm::mat4 projectView = camera.projectMatrix() * camera.viewMatrix();
+	glUniformMatrix4fv(uniforms.PVM, 1, GL_FALSE, glm::value_ptr(projectView * relative));
+	glUniformMatrix4fv(uniforms.PV, 1, GL_FALSE, glm::value_ptr(projectView));
 	glUniformMatrix4fv(uniforms.ViewM, 1, GL_FALSE, glm::value_ptr(camera.viewMatrix()));
-	glUniformMatrix4fv(uniforms.ModelM, 1, GL_FALSE, glm::value_ptr(model));
+	glUniformMatrix4fv(uniforms.ModelM, 1, GL_FALSE, glm::value_ptr(relative));
 	glUniformMatrix4fv(uniforms.ProjectM, 1, GL_FALSE, glm::value_ptr(camera.projectMatrix()));
-	glUniformMatrix4fv(uniforms.NormalM, 1, GL_FALSE, glm::value_ptr(glm::transpose(glm::inverse(model))));
-	glUniform3fv(uniforms.cameraPos, 1, glm::value_ptr(camera.position));
+	glUniformMatrix4fv(uniforms.NormalM, 1, GL_FALSE, glm::value_ptr(glm::mat4(glm::transpose(glm::inverse(model)))));
+	glm::vec3 cameraPos = camera.position;
+	glUniform3fv(uniforms.cameraPos, 1, glm::value_ptr(cameraPos));
 }
 
 void LightingShader::setMaterial(Material* material) const
 {
 	MaterialMap* mat = dynamic_cast<MaterialMap*>(material);
+	VirtualMaterial* virt = dynamic_cast<VirtualMaterial*>(material);
 
 	glUniform3fv(uniforms.materialAmbient, 1, glm::value_ptr(material->ambient));
 	glUniform3fv(uniforms.materialDiffuse, 1, glm::value_ptr(material->diffuse));
@@ -205,11 +303,40 @@ void LightingShader::setMaterial(Material* material) const
 			glBindTexture(GL_TEXTURE_2D, mat->specularMap);
 		}
 	}
+	else if (virt)
+	{
+		const VirtualTexture& texture = *virt->texture;
+		glUniform1i(uniforms.materialUseDiffuseMap, 0);
+		glUniform1i(uniforms.materialUseSpecularMap, virt->specularMap != 0);
+		if (virt->specularMap)
+		{
+			glUniform1i(uniforms.materialSpecularMap, 0);
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, virt->specularMap);
+		}
+
+		glActiveTexture(GL_TEXTURE0 + VIRTUAL_INDIRECTION_UNIT);
+		glBindTexture(GL_TEXTURE_2D, texture.indirectionTexture());
+		glActiveTexture(GL_TEXTURE0 + VIRTUAL_ATLAS_UNIT);
+		glBindTexture(GL_TEXTURE_2D, texture.atlasTexture());
+		glActiveTexture(GL_TEXTURE0);
+
+		glUniform1i(uniforms.virtualIndirection, VIRTUAL_INDIRECTION_UNIT);
+		glUniform1i(uniforms.virtualAtlas, VIRTUAL_ATLAS_UNIT);
+		glUniform1i(uniforms.virtualFeedback, texture.inFeedback());
+		glUniform2fv(uniforms.virtualOrigin, 1, glm::value_ptr(texture.origin));
+		glUniform2fv(uniforms.virtualSize, 1, glm::value_ptr(texture.size));
+		glUniform1f(uniforms.virtualPages, float(texture.pages));
+		glUniform1i(uniforms.virtualLevels, texture.levelCount());
+		// The feedback target's larger derivatives would pick coarser levels than the frame needs
+		glUniform1f(uniforms.virtualLevelBias, texture.inFeedback() ? -std::log2(float(VirtualTexture::FEEDBACK_SCALE)) : 0.0f);
+	}
 	else 
 	{
 		glUniform1i(uniforms.materialUseDiffuseMap, 0);
 		glUniform1i(uniforms.materialUseSpecularMap, 0);
 	}
+	glUniform1i(uniforms.virtualEnabled, virt != nullptr);
 }
 
 void LightingShader::addLight(const Light* light, const glm::vec3& position, const glm::vec3& direction)
@@ -233,6 +360,87 @@ void LightingShader::resetLights()
 	uniforms.lightUBO->setData(0, &lightsLoadedNum, 16);
 }
 
+void LightingShader::setTerrainMaps(TerrainMode mode, GLuint heightMap, GLuint normalMap, GLuint sunMap, const glm::vec2& origin, const glm::vec2& size, unsigned int gridSize, float texSpacing) const
+{
+	glActiveTexture(GL_TEXTURE0 + TERRAIN_HEIGHT_MAP_UNIT);
+	glBindTexture(GL_TEXTURE_2D, heightMap);
+	glActiveTexture(GL_TEXTURE0 + TERRAIN_NORMAL_MAP_UNIT);
+	glBindTexture(GL_TEXTURE_2D, normalMap);
+	glActiveTexture(GL_TEXTURE0 + TERRAIN_SUN_MAP_UNIT);
+	glBindTexture(GL_TEXTURE_2D, sunMap);
+	glActiveTexture(GL_TEXTURE0);
+
+	glUniform1i(uniforms.bakedSunEnabled, sunMap != 0);
+	glUniform1i(uniforms.bakedSunMap, TERRAIN_SUN_MAP_UNIT);
+	glUniform2fv(uniforms.bakedSunOrigin, 1, glm::value_ptr(origin));
+	glUniform2fv(uniforms.bakedSunSize, 1, glm::value_ptr(size));
+
+	glUniform1i(uniforms.terrainMode, mode);
+	glUniform1i(uniforms.terrainHeightMap, TERRAIN_HEIGHT_MAP_UNIT);
+	glUniform1i(uniforms.terrainNormalMap, TERRAIN_NORMAL_MAP_UNIT);
+	glUniform2fv(uniforms.terrainMapOrigin, 1, glm::value_ptr(origin));
+	glUniform2fv(uniforms.terrainMapSize, 1, glm::value_ptr(size));
+	glUniform1f(uniforms.terrainGridSize, float(gridSize));
+	glUniform1f(uniforms.terrainTexSpacing, texSpacing);
+}
+
+void LightingShader::setTerrainNode(const glm::vec2& origin, float size, float morphStart, float morphEnd) const
+{
+	glUniform3f(uniforms.terrainNode, origin.x, origin.y, size);
+	glUniform2f(uniforms.terrainMorph, morphStart, morphEnd);
+}
+
+void LightingShader::setTerrainGrid(const glm::vec2& origin, unsigned int width, float texSpacing) const
+{
+	glUniform1i(uniforms.terrainMode, TERRAIN_MODE_COMPACT);
+	glUniform2fv(uniforms.terrainMapOrigin, 1, glm::value_ptr(origin));
+	glUniform2f(uniforms.terrainMapSize, float(width), 0.0f);
+	glUniform1f(uniforms.terrainTexSpacing, texSpacing);
+}
+
+void LightingShader::disableTerrain() const
+{
+	glUniform1i(uniforms.terrainMode, TERRAIN_MODE_NONE);
+	glUniform1i(uniforms.bakedSunEnabled, 0);
+}
+
+/*
+*	Compute shader
+*/
+
+ComputeShader::ComputeShader()
+	: Shader()
+{
+}
+
+ComputeShader::ComputeShader(std::string computeFile)
+	: Shader()
+{
+	GLuint computeShader = pgr::createShaderFromFile(GL_COMPUTE_SHADER, computeFile);
+	if (computeShader == 0) {
+		throw std::runtime_error("Failed to compile compute shader");
+	}
+
+	GLuint shaders[] = { computeShader, 0 };
+	GLuint program = pgr::createProgram(shaders);
+	if (program == 0) {
+		throw std::runtime_error("Failed to compile program");
+	}
+
+	this->program = program;
+}
+
+void ComputeShader::dispatch(GLuint groupsX, GLuint groupsY, GLuint groupsZ) const
+{
+	glDispatchCompute(groupsX, groupsY, groupsZ);
+}
+
+void ComputeShader::setIntegerArray(const std::string uniformName, const GLint* values, int count) const
+{
+	GLint location = glGetUniformLocation(program, uniformName.c_str());
+	glUniform1iv(location, count, values);
+}
+
 /*
 *	UBO wrapper
 */
@@ -66,6 +66,9 @@ public:
 		GLint color;
 		GLint normal;
 		GLint texCoord;
+		GLint height;
+		GLint packedNormal;
+		GLint patchOrigin;
 	} attributes;
 
 	/// Shader uniform locations
@@ -78,6 +81,8 @@ public:
 
 	Shader();
 	Shader(std::string vertexFile, std::string fragmentFile);
+	/// Program with tessellation control and evaluation stages between the vertex and fragment stages
+	Shader(std::string vertexFile, std::string tessControlFile, std::string tessEvaluationFile, std::string fragmentFile);
 	virtual ~Shader() {}
 
 	/// Use current shader
@@ -88,8 +93,20 @@ public:
 	void loadFog() const;
 	/// Set material uniforms
 	virtual void setMaterial(Material* material) const;
-	/// Set transform uniforms
-	virtual void setTransformParameters(const Camera& camera, const glm::mat4& model) const;
+	/// <summary>
+	/// Set transform uniforms, the model is moved relative to the camera in double precision before it is uploaded,
+	/// so ModelM maps to camera relative positions and ViewM only rotates
+	/// </summary>
+	virtual void setTransformParameters(const Camera& camera, const glm::dmat4& model) const;
+	/// <summary>
+	/// Switch the vertex stage to compact terrain, positions and texture coordinates are then rebuilt from the vertex index.
+	/// Vertex (j, i) lies at (j, i) in model space and at origin + (j, i) in the world. Shaders without terrain support ignore it
+	/// </summary>
+	/// <param name="width">Grid points in one row</param>
+	/// <param name="texSpacing">Texture coordinate step between neighbouring grid points</param>
+	virtual void setTerrainGrid(const glm::vec2& origin, unsigned int width, float texSpacing) const;
+	/// Switch the vertex stage back to regular meshes
+	virtual void disableTerrain() const;
 
 	/// Set integer uniform
 	void setInteger(const std::string uniformName, int value) const;
@@ -101,6 +118,10 @@ public:
 	void setVec3(const std::string uniformName, glm::vec3& value) const;
 	/// Set vec4 uniform
 	void setMat4(const std::string uniformName, glm::mat4& value) const;
+
+protected:
+	/// Link the compiled stages, null terminated, and look up the attribute and uniform locations
+	void link(const GLuint* shaders);
 };
 
 /// Shader handling light
@@ -112,12 +133,41 @@ protected:
 	/// Binding point of light UBO
 	static const int LIGHTS_BINDING_POINT = 2;
 
+	/// Light UBO, shared between all lighting shaders so lights added through one reach every program
+	static UniformBufferObject* lights;
+	/// Number of lighting shaders using the light UBO
+	static unsigned int lightsUsers;
 	/// Current number of lights in UBO
-	unsigned int lightsLoadedNum;
+	static unsigned int lightsLoadedNum;
+
+	/// Look up the uniform locations and attach the program to the light UBO
+	void initUniforms();
 public:
+	/// Vertex stage modes, values of terrain.mode in phong.vert
+	enum TerrainMode
+	{
+		TERRAIN_MODE_NONE,
+		TERRAIN_MODE_LOD,
+		TERRAIN_MODE_COMPACT,
+		TERRAIN_MODE_PATCHES,
+		/// Coarse patches subdivided by the tessellation stages in terrain.tesc and terrain.tese
+		TERRAIN_MODE_TESSELLATION,
+	};
+
+	/// Texture units of the terrain height and normal maps while level of detail terrain is drawn
+	static const int TERRAIN_HEIGHT_MAP_UNIT = 11;
+	static const int TERRAIN_NORMAL_MAP_UNIT = 12;
+	/// Texture unit of the baked sun factor of height map terrain
+	static const int TERRAIN_SUN_MAP_UNIT = 13;
+	/// Texture units of the indirection and atlas textures of a virtual material
+	static const int VIRTUAL_INDIRECTION_UNIT = 14;
+	static const int VIRTUAL_ATLAS_UNIT = 15;
+
 	/// Shader uniform locations
 	struct Uniforms {
 		GLint PVM;
+		/// Projection and view rotation for camera relative positions
+		GLint PV;
 		GLint ViewM;
 		GLint ModelM;
 		GLint NormalM;
@@ -138,24 +188,95 @@ public:
 
 		GLint materialUseMaps;
 
+		GLint terrainMode;
+		GLint terrainHeightMap;
+		GLint terrainNormalMap;
+		GLint terrainMapOrigin;
+		GLint terrainMapSize;
+		GLint terrainGridSize;
+		GLint terrainTexSpacing;
+		GLint terrainNode;
+		GLint terrainMorph;
+
+		GLint bakedSunEnabled;
+		GLint bakedSunMap;
+		GLint bakedSunOrigin;
+		GLint bakedSunSize;
+
+		GLint virtualEnabled;
+		GLint virtualFeedback;
+		GLint virtualIndirection;
+		GLint virtualAtlas;
+		GLint virtualOrigin;
+		GLint virtualSize;
+		GLint virtualPages;
+		GLint virtualLevels;
+		GLint virtualLevelBias;
+
 		GLint lightBlockIdx;
 		UniformBufferObject* lightUBO;
 	} uniforms;
 
 	LightingShader();
 	LightingShader(std::string vertexFile, std::string fragmentFile);
+	LightingShader(std::string vertexFile, std::string tessControlFile, std::string tessEvaluationFile, std::string fragmentFile);
 
 	~LightingShader();
 
-	/// Set material uniforms
+	/// Set material uniforms, a VirtualMaterial also binds its virtual texture and draws feedback while it collects it
 	void setMaterial(Material* material) const override;
-	/// Set transform uniforms
-	void setTransformParameters(const Camera& camera, const glm::mat4& model) const override;
+	/// Set transform uniforms, cameraPos stays the world position for the virtual texture and baked sun lookups
+	void setTransformParameters(const Camera& camera, const glm::dmat4& model) const override;
 
 	/// Add light to the UBO
 	void addLight(const Light* light, const glm::vec3& position, const glm::vec3& direction);
 	/// Reset light UBO
 	void resetLights();
+
+	/// <summary>
+	/// Switch the vertex stage to terrain displaced by a height map, vertex positions are then read as grid patch
+	/// points relative to the map origin, which the model matrix places. Texel (j, i) of the maps lies at origin + (j, i)
+	/// </summary>
+	/// <param name="mode">TERRAIN_MODE_LOD places the patch by setTerrainNode, TERRAIN_MODE_PATCHES by the per instance patch origin,
+	/// TERRAIN_MODE_TESSELLATION reads the patch corners relative to the map origin</param>
+	/// <param name="heightMap">R32F texture of the terrain heights</param>
+	/// <param name="normalMap">RGB32F texture of the terrain normals</param>
+	/// <param name="sunMap">Baked sun factor replacing the directional light term in phong.frag, 0 lights the terrain per fragment</param>
+	/// <param name="size">Map size in texels</param>
+	/// <param name="gridSize">Cells along one side of the grid patch mesh</param>
+	/// <param name="texSpacing">Texture coordinate step between neighbouring texels</param>
+	void setTerrainMaps(TerrainMode mode, GLuint heightMap, GLuint normalMap, GLuint sunMap, const glm::vec2& origin, const glm::vec2& size, unsigned int gridSize, float texSpacing) const;
+	/// <summary>
+	/// Place the grid patch over a quadtree node
+	/// </summary>
+	/// <param name="origin">xz position of the node corner relative to the map origin</param>
+	/// <param name="size">Length of the node side</param>
+	/// <param name="morphStart">Camera distance where vertices start morphing into the next coarser level</param>
+	/// <param name="morphEnd">Camera distance where vertices match the next coarser level</param>
+	void setTerrainNode(const glm::vec2& origin, float size, float morphStart, float morphEnd) const;
+	/// Switch the vertex stage to compact terrain
+	void setTerrainGrid(const glm::vec2& origin, unsigned int width, float texSpacing) const override;
+	/// Switch the vertex stage back to regular meshes and light them per fragment
+	void disableTerrain() const override;
+};
+
+/// Shader program with a single compute stage
+class ComputeShader : public Shader
+{
+public:
+	ComputeShader();
+	ComputeShader(std::string computeFile);
+
+	/// <summary>
+	/// Run the program over a grid of work groups, the program has to be in use
+	/// </summary>
+	/// <param name="groupsX">Number of work groups along x</param>
+	/// <param name="groupsY">Number of work groups along y</param>
+	/// <param name="groupsZ">Number of work groups along z</param>
+	void dispatch(GLuint groupsX, GLuint groupsY = 1, GLuint groupsZ = 1) const;
+
+	/// Set integer array uniform
+	void setIntegerArray(const std::string uniformName, const GLint* values, int count) const;
 };
 
 #endif
\ No newline at end of file
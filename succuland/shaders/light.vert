@@ -8,11 +8,11 @@ smooth out float vDist;
 
 uniform mat4 PVM;
 uniform mat4 ModelM;
-uniform vec3 cameraPos;
 
 void main()
 {
 	gl_Position = PVM * vec4(aPosition, 1.0f);
-	vDist = distance((ModelM * vec4(aPosition, 1.0)).xyz, cameraPos);
+	// ModelM maps to positions relative to the camera
+	vDist = length((ModelM * vec4(aPosition, 1.0)).xyz);
 	
 }
\ No newline at end of file
@@ -47,6 +47,38 @@ layout (std140) uniform Lights
 	Light lights[MAX_LIGHT_NUM];
 } light_block;
 
+// Sun diffuse factor of height map terrain baked by HeightMap::bakeSun, texel (j, i) lies at origin + (j, i).
+// While enabled it replaces the per fragment term of directional lights, view dependent specular is left out
+uniform struct BakedSun
+{
+	bool enabled;
+	sampler2D map;
+	vec2 origin;
+	vec2 size;
+} bakedSun;
+
+// Same as VirtualTexture::PAGE_SIZE and VirtualTexture::PAGE_BORDER
+#define VIRTUAL_PAGE_SIZE 128.0
+#define VIRTUAL_PAGE_BORDER 4.0
+
+// Diffuse map of a VirtualMaterial, uv (0, 0) to (1, 1) spans origin to origin + size in world xz
+uniform struct VirtualTexture
+{
+	bool enabled;
+	// Write the page and level the fragment needs instead of its color
+	bool feedback;
+	// Slot column, row and level of the finest resident page covering each page, one mip level per page level
+	sampler2D indirection;
+	sampler2D atlas;
+	vec2 origin;
+	vec2 size;
+	// Pages along one side of the finest level
+	float pages;
+	int levels;
+	float levelBias;
+} virtualTexture;
+
+// World position of the camera, vPosition is relative to it
 uniform vec3 cameraPos;
 
 smooth in vec3 vPosition;
@@ -61,7 +93,39 @@ float getFogFactor(Fog fog, float fogCoordinate)
 	return result;
 }
 
-vec4 calculateLight(Light light) 
+vec2 virtualUV()
+{
+	return clamp((vPosition.xz + cameraPos.xz - virtualTexture.origin) / virtualTexture.size, 0.0, 0.99999);
+}
+
+int virtualLevel(vec2 uv)
+{
+	vec2 texels = uv * virtualTexture.pages * VIRTUAL_PAGE_SIZE;
+	vec2 dx = dFdx(texels);
+	vec2 dy = dFdy(texels);
+	float level = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + virtualTexture.levelBias;
+	return int(clamp(floor(level), 0.0, float(virtualTexture.levels - 1)));
+}
+
+vec4 virtualFeedback(vec2 uv, int level)
+{
+	// Read back by VirtualTexture::request, alpha 0 is left where no terrain was drawn
+	vec2 page = floor(uv * virtualTexture.pages / exp2(float(level)));
+	return vec4(page, float(level), 255.0) / 255.0;
+}
+
+vec3 virtualSample(vec2 uv, int level)
+{
+	ivec2 page = ivec2(uv * virtualTexture.pages / exp2(float(level)));
+	vec4 entry = round(texelFetch(virtualTexture.indirection, page, level) * 255.0);
+
+	// The entry may point at a coarser ancestor when the page itself isn't resident yet
+	vec2 inPage = fract(uv * virtualTexture.pages / exp2(entry.b));
+	vec2 texel = entry.rg * (VIRTUAL_PAGE_SIZE + 2.0 * VIRTUAL_PAGE_BORDER) + VIRTUAL_PAGE_BORDER + inPage * VIRTUAL_PAGE_SIZE;
+	return textureLod(virtualTexture.atlas, texel / vec2(textureSize(virtualTexture.atlas, 0)), 0.0).rgb;
+}
+
+vec4 calculateLight(Light light, vec3 diffM) 
 {
 	vec3 ret = vec3(0.0);
 
@@ -76,17 +140,12 @@ vec4 calculateLight(Light light)
 		L = normalize(light.direction);
 	}
 	R = reflect(-L, vNormal);
-	V = normalize(cameraPos-vPosition);
+	V = normalize(-vPosition);
 
 	float diffFactor = max(dot(vNormal, L), 0.0);
 	float specFactor = pow(max(dot(R, V), 0.0), material.shininess);
 
-	vec3 diffM = vec3(1.0);
 	vec3 specM = vec3(1.0);
-	if (material.useDiffuseMap)
-	{
-		diffM = texture(material.diffuseMap, vTexCoord).rgb;
-	}
 	if (material.useSpecularMap)
 	{
 		specM = texture(material.specularMap, vTexCoord).rgb;
@@ -117,13 +176,40 @@ vec4 calculateLight(Light light)
 	return vec4(ret, 1.0);
 }
 
+vec4 calculateBakedSun(Light light, vec3 diffM)
+{
+	float diffFactor = texture(bakedSun.map, (vPosition.xz + cameraPos.xz - bakedSun.origin + 0.5) / bakedSun.size).r;
+	return vec4(material.ambient * light.ambient + material.diffuse * light.diffuse * diffM * diffFactor, 1.0);
+}
+
 void main() 
 {
 	float globalAmbient = 0.4;
 
+	vec3 diffM = vec3(1.0);
+	if (virtualTexture.enabled)
+	{
+		vec2 uv = virtualUV();
+		int level = virtualLevel(uv);
+		if (virtualTexture.feedback)
+		{
+			fColor = virtualFeedback(uv, level);
+			return;
+		}
+		diffM = virtualSample(uv, level);
+	}
+	else if (material.useDiffuseMap)
+	{
+		diffM = texture(material.diffuseMap, vTexCoord).rgb;
+	}
+
 	fColor = vec4(material.ambient * globalAmbient, 0.0);
 	for (uint i = 0; i < light_block.lightNum; ++i) {
-		fColor += calculateLight(light_block.lights[i]);
+		Light light = light_block.lights[i];
+		if (bakedSun.enabled && !light.point && !light.spotlight)
+			fColor += calculateBakedSun(light, diffM);
+		else
+			fColor += calculateLight(light, diffM);
 	}
 
 	if (fog.isEnabled) 
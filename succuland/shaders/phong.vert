@@ -4,23 +4,120 @@ in vec3 aPosition;
 in vec3 aColor;
 in vec3 aNormal;
 in vec2 aTexCoord;
+// Compact terrain vertices
+in float aHeight;
+in vec2 aPackedNormal;
+// Per instance corner of an instanced terrain patch
+in vec2 aPatchOrigin;
 
-uniform mat4 PVM;
+// Projection and view rotation, ModelM maps to positions relative to the camera
+uniform mat4 PV;
 uniform mat4 ViewM;
 uniform mat4 ModelM;
 uniform mat4 NormalM;
-uniform vec3 cameraPos;
 
+// Values of LightingShader::TerrainMode
+#define TERRAIN_MODE_NONE 0
+// Terrain positions are relative to the map origin, ModelM carries the origin relative to the camera
+// Level of detail terrain, aPosition is a grid patch point in cell units
+#define TERRAIN_MODE_LOD 1
+// Compact terrain mesh, only aHeight and aPackedNormal are stored and the rest follows from gl_VertexID
+#define TERRAIN_MODE_COMPACT 2
+// Instanced terrain patches, aPosition is a grid patch point and aPatchOrigin the patch corner relative to the map origin
+#define TERRAIN_MODE_PATCHES 3
+
+uniform struct Terrain
+{
+	int mode;
+	sampler2D heightMap;
+	sampler2D normalMap;
+	// World position of texel (0, 0), only texture coordinates use it, and map size in texels, compact meshes only use the row width
+	vec2 mapOrigin;
+	vec2 mapSize;
+	float gridSize;
+	float texSpacing;
+	// Corner relative to the map origin and side length of the drawn quadtree node
+	vec3 node;
+	// Camera distances where morphing into the next level starts and ends
+	vec2 morph;
+} terrain;
+
+// Position relative to the camera
 smooth out vec3 vPosition;
 smooth out vec3 vNormal;
 smooth out vec2 vTexCoord;
 smooth out float vDist;
 
-void main() 
+vec2 terrainUV(vec2 xz)
+{
+	return (xz + 0.5) / terrain.mapSize;
+}
+
+vec2 terrainTexCoord(vec2 xz)
+{
+	// Texture coordinates stay world based so the material tiles the same wherever the map lies
+	return (terrain.mapOrigin + xz) * terrain.texSpacing;
+}
+
+vec2 terrainPosition(vec2 corner, float cellSize, vec2 gridPos)
+{
+	// Patches hanging over the map edge collapse onto it
+	vec2 xz = corner + gridPos * cellSize;
+	return clamp(xz, vec2(0.0), terrain.mapSize - 1.0);
+}
+
+void displaceTerrain(vec2 xz, out vec3 position, out vec3 normal, out vec2 texCoord)
+{
+	vec2 uv = terrainUV(xz);
+	position = vec3(xz.x, textureLod(terrain.heightMap, uv, 0.0).r, xz.y);
+	normal = normalize(textureLod(terrain.normalMap, uv, 0.0).xyz);
+	texCoord = terrainTexCoord(xz);
+}
+
+vec3 unpackNormal(vec2 p)
+{
+	// Octahedral decoding around y, inverse of TerrainGrid::packNormal
+	vec3 n = vec3(p.x, 1.0 - abs(p.x) - abs(p.y), p.y);
+	float t = max(-n.y, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.z += n.z >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+void main()
 {
-	gl_Position = PVM * vec4(aPosition, 1.0);
-	vPosition = (ModelM * vec4(aPosition, 1.0)).xyz;
-	vNormal = (NormalM * vec4(aNormal, 1.0)).xyz;;
-	vTexCoord = aTexCoord;
-	vDist = distance(cameraPos, vPosition);
-}
\ No newline at end of file
+	vec3 position = aPosition;
+	vec3 normal = aNormal;
+	vec2 texCoord = aTexCoord;
+
+	if (terrain.mode == TERRAIN_MODE_COMPACT)
+	{
+		int width = int(terrain.mapSize.x);
+		vec2 xz = vec2(gl_VertexID % width, gl_VertexID / width);
+		position = vec3(xz.x, aHeight, xz.y);
+		normal = unpackNormal(aPackedNormal);
+		texCoord = terrainTexCoord(xz);
+	}
+	else if (terrain.mode == TERRAIN_MODE_LOD)
+	{
+		float cellSize = terrain.node.z / terrain.gridSize;
+		vec2 gridPos = aPosition.xz;
+		vec2 xz = terrainPosition(terrain.node.xy, cellSize, gridPos);
+		float dist = length((ModelM * vec4(xz.x, textureLod(terrain.heightMap, terrainUV(xz), 0.0).r, xz.y, 1.0)).xyz);
+		float morph = clamp((dist - terrain.morph.x) / (terrain.morph.y - terrain.morph.x), 0.0, 1.0);
+
+		// Odd grid points slide onto their even neighbour, fully morphed patches match the next coarser level
+		gridPos -= fract(gridPos * 0.5) * 2.0 * morph;
+		displaceTerrain(terrainPosition(terrain.node.xy, cellSize, gridPos), position, normal, texCoord);
+	}
+	else if (terrain.mode == TERRAIN_MODE_PATCHES)
+	{
+		displaceTerrain(terrainPosition(aPatchOrigin, 1.0, aPosition.xz), position, normal, texCoord);
+	}
+
+	vPosition = (ModelM * vec4(position, 1.0)).xyz;
+	gl_Position = PV * vec4(vPosition, 1.0);
+	vNormal = (NormalM * vec4(normal, 1.0)).xyz;;
+	vTexCoord = texCoord;
+	vDist = length(vPosition);
+}
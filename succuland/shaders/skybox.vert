@@ -12,7 +12,8 @@ uniform mat4 ModelM;
 void main() 
 {
 	vTexCoord = vec3(aPosition.x, -aPosition.y, aPosition.z);
-	gl_Position = (ProjectM * mat4(mat3(ViewM)) * ModelM * vec4(aPosition, 1.0)).xyww;
+	// ModelM is relative to the camera, only its rotation and scale apply so the sky stays centered on the camera
+	gl_Position = (ProjectM * mat4(mat3(ViewM)) * mat4(mat3(ModelM)) * vec4(aPosition, 1.0)).xyww;
 
-	vDist = -(ModelM * vec4(aPosition, 1.0)).y * 20;
+	vDist = -(mat3(ModelM) * aPosition).y * 20;
 }
\ No newline at end of file
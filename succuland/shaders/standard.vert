@@ -12,7 +12,6 @@ out float vDist;
 
 uniform mat4 PVM;
 uniform mat4 ModelM;
-uniform vec3 cameraPos;
 
 void main() 
 {
@@ -21,5 +20,6 @@ void main()
 	vNormal = aNormal;
 
 	gl_Position = PVM * vec4(aPosition, 1.0f);
-	vDist = distance((ModelM * vec4(aPosition, 1.0)).xyz, cameraPos);
+	// ModelM maps to positions relative to the camera
+	vDist = length((ModelM * vec4(aPosition, 1.0)).xyz);
 }
@@ -0,0 +1,11 @@
+#version 400 core
+
+// Corners of the coarse terrain patches, terrain.tesc and terrain.tese subdivide and displace them
+in vec3 aPosition;
+
+out vec2 vcCorner;
+
+void main()
+{
+	vcCorner = aPosition.xz;
+}
@@ -0,0 +1,302 @@
+/*
+*	Terrain grid generation
+*/
+
+#include "terrain.h"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+TerrainGrid::TerrainGrid(unsigned int width, unsigned int height, const Perlin& perlin, bool withNormals, bool withTexCoords, bool compact)
+	: TerrainGrid(width, height, glm::vec2(-(width / 2.0f), -(height / 2.0f)), perlin, withNormals, withTexCoords, compact)
+{
+}
+
+TerrainGrid::TerrainGrid(unsigned int width, unsigned int height, const glm::vec2& origin, const Perlin& perlin, bool withNormals, bool withTexCoords, bool compact)
+	: width(width), height(height), origin(origin), perlin(perlin), withNormals(withNormals), withTexCoords(withTexCoords), compact(compact)
+{
+}
+
+void TerrainGrid::generate(ThreadPool& pool, bool vertexData)
+{
+	// Every array is sized up front, tiles of rows then write their own slices of them in parallel
+	size_t count = size_t(width) * height;
+	if (vertexData && compact)
+	{
+		if (withNormals)
+			packedNormals.resize(count);
+	}
+	else if (vertexData)
+	{
+		vertices.resize(count);
+		if (withNormals)
+			normals.resize(count);
+		if (withTexCoords)
+			texCoords.resize(count);
+	}
+	initBlocks();
+	heightField = HeightField(width, height, origin.x, origin.y);
+
+	pool.parallelFor(0, height, TILE_ROWS, [this, vertexData](unsigned int first, unsigned int last)
+	{
+		if (vertexData)
+			generateRows(first, last);
+		generateStrips(first, last);
+	});
+
+	if (vertexData)
+		measureBlocks();
+}
+
+void TerrainGrid::initBlocks()
+{
+	blocks.clear();
+	size_t next = 0;
+	for (unsigned int bi = 0; bi < blockRows(); ++bi)
+	{
+		unsigned int rows = std::min(BLOCK_SIZE, stripCount() - bi * BLOCK_SIZE);
+		for (unsigned int bj = 0; bj < blockColumns(); ++bj)
+		{
+			unsigned int cells = blockCells(bj);
+			unsigned int bands = (cells - 1) / BAND_SIZE;
+			unsigned int rowLength = bands * stripLength(BAND_SIZE) + stripLength(cells - bands * BAND_SIZE);
+			Block block = { next, rows * rowLength, glm::vec3(0.0f), glm::vec3(0.0f) };
+			blocks.push_back(block);
+			next += block.indexCount;
+		}
+	}
+	indices.resize(next);
+}
+
+void TerrainGrid::measureBlocks()
+{
+	for (unsigned int bi = 0; bi < blockRows(); ++bi)
+	{
+		for (unsigned int bj = 0; bj < blockColumns(); ++bj)
+		{
+			measureBlock(bi, bj);
+		}
+	}
+}
+
+void TerrainGrid::measureBlock(unsigned int bi, unsigned int bj)
+{
+	unsigned int i0 = bi * BLOCK_SIZE;
+	unsigned int i1 = std::min(i0 + BLOCK_SIZE, height - 1);
+	unsigned int j0 = bj * BLOCK_SIZE;
+	unsigned int j1 = std::min(j0 + BLOCK_SIZE, width - 1);
+	float low = heightField.at(i0, j0);
+	float high = low;
+	for (unsigned int i = i0; i <= i1; ++i)
+	{
+		for (unsigned int j = j0; j <= j1; ++j)
+		{
+			low = std::min(low, heightField.at(i, j));
+			high = std::max(high, heightField.at(i, j));
+		}
+	}
+	Block& block = blocks[bi * blockColumns() + bj];
+	block.low = glm::vec3(origin.x + j0, low, origin.y + i0);
+	block.high = glm::vec3(origin.x + j1, high, origin.y + i1);
+}
+
+TerrainGrid::Region TerrainGrid::editHeights(const Region& region, const std::function<float(float x, float z, float height)>& edit)
+{
+	Region edited = { std::min(region.i0, height), std::min(region.j0, width), std::min(region.i1, height), std::min(region.j1, width) };
+	if (edited.i0 >= edited.i1 || edited.j0 >= edited.j1)
+		return { 0, 0, 0, 0 };
+
+	float* heights = heightField.data();
+	for (unsigned int i = edited.i0; i < edited.i1; ++i)
+	{
+		for (unsigned int j = edited.j0; j < edited.j1; ++j)
+		{
+			heights[i * width + j] = edit(origin.x + j, origin.y + i, heights[i * width + j]);
+		}
+	}
+
+	// Normals of the neighbours of edited points depend on the new heights too
+	Region dirty = { edited.i0 > 0 ? edited.i0 - 1 : 0, edited.j0 > 0 ? edited.j0 - 1 : 0, std::min(edited.i1 + 1, height), std::min(edited.j1 + 1, width) };
+	for (unsigned int i = dirty.i0; i < dirty.i1; ++i)
+	{
+		for (unsigned int j = dirty.j0; j < dirty.j1; ++j)
+		{
+			// GPU generated grids keep no vertex arrays, only the ones generated on the CPU are updated
+			size_t v = size_t(i) * width + j;
+			glm::vec3 normal = heightNormal(i, j);
+			if (!packedNormals.empty())
+				packedNormals[v] = packNormal(normal);
+			if (!vertices.empty())
+				vertices[v].y = heights[v];
+			if (!normals.empty())
+				normals[v] = normal;
+		}
+	}
+
+	// Blocks share their edge points with the blocks before them
+	unsigned int bi0 = (edited.i0 > 0 ? edited.i0 - 1 : 0) / BLOCK_SIZE;
+	unsigned int bi1 = std::min((edited.i1 - 1) / BLOCK_SIZE, blockRows() - 1);
+	unsigned int bj0 = (edited.j0 > 0 ? edited.j0 - 1 : 0) / BLOCK_SIZE;
+	unsigned int bj1 = std::min((edited.j1 - 1) / BLOCK_SIZE, blockColumns() - 1);
+	for (unsigned int bi = bi0; bi <= bi1; ++bi)
+	{
+		for (unsigned int bj = bj0; bj <= bj1; ++bj)
+		{
+			measureBlock(bi, bj);
+		}
+	}
+	return dirty;
+}
+
+glm::vec3 TerrainGrid::heightNormal(unsigned int i, unsigned int j) const
+{
+	// Central differences inside the grid, one sided ones on its edge
+	unsigned int jl = j > 0 ? j - 1 : j;
+	unsigned int jr = std::min(j + 1, width - 1);
+	unsigned int il = i > 0 ? i - 1 : i;
+	unsigned int ir = std::min(i + 1, height - 1);
+	float dhdx = (heightField.at(i, jr) - heightField.at(i, jl)) / float(jr - jl);
+	float dhdz = (heightField.at(ir, j) - heightField.at(il, j)) / float(ir - il);
+	return glm::normalize(glm::vec3(-dhdx, 1.0f, -dhdz));
+}
+
+void TerrainGrid::generateRows(unsigned int first, unsigned int last)
+{
+	// Fill vertices and normals a row at a time through the batch kernels, normals come from the analytic noise gradient (-dh/dx, 1, -dh/dz)
+	float* heights = heightField.data();
+	std::vector<float> xs(width);
+	std::vector<float> zs(width);
+	std::vector<float> dxs(withNormals ? width : 0);
+	std::vector<float> dzs(withNormals ? width : 0);
+	for (unsigned int i = first; i < last; ++i)
+	{
+		for (unsigned int j = 0; j < width; ++j)
+		{
+			xs[j] = origin.x + j;
+			zs[j] = origin.y + i;
+		}
+		float* ys = heights + i * width;
+		if (withNormals)
+			perlin.GetBatchWithGradient(xs.data(), zs.data(), ys, dxs.data(), dzs.data(), width);
+		else
+			perlin.GetBatch(xs.data(), zs.data(), ys, width);
+
+		for (unsigned int j = 0; j < width; ++j)
+		{
+			glm::vec3 normal = withNormals ? glm::normalize(glm::vec3(-dxs[j], 1.0f, -dzs[j])) : glm::vec3(0.0f);
+			if (compact)
+			{
+				if (withNormals)
+					packedNormals[i * width + j] = packNormal(normal);
+				continue;
+			}
+			vertices[i * width + j] = glm::vec3(float(j), ys[j], float(i));
+			if (withNormals)
+				normals[i * width + j] = normal;
+		}
+	}
+
+	if (withTexCoords && !compact)
+	{
+		for (unsigned int i = first; i < last; ++i)
+		{
+			for (unsigned int j = 0; j < width; ++j)
+			{
+				texCoords[i * width + j] = glm::vec2((origin.x + j) * TEX_SPACING, (origin.y + i) * TEX_SPACING);
+			}
+		}
+	}
+}
+
+void TerrainGrid::generateStrips(unsigned int first, unsigned int last)
+{
+	// The strips of row i join it with row i + 1, one strip per band it crosses
+	for (unsigned int i = first; i < std::min(last, stripCount()); ++i)
+	{
+		unsigned int bi = i / BLOCK_SIZE;
+		unsigned int row = i - bi * BLOCK_SIZE;
+		unsigned int rows = std::min(BLOCK_SIZE, stripCount() - bi * BLOCK_SIZE);
+		for (unsigned int bj = 0; bj < blockColumns(); ++bj)
+		{
+			// Bands before the last one are full, each band stores all its rows before the next band starts
+			size_t bandStart = blocks[bi * blockColumns() + bj].firstIndex;
+			unsigned int cells = blockCells(bj);
+			for (unsigned int b = 0; b * BAND_SIZE < cells; ++b)
+			{
+				unsigned int bandCells = std::min(BAND_SIZE, cells - b * BAND_SIZE);
+				unsigned int* strip = &indices[bandStart + size_t(row) * stripLength(bandCells)];
+				unsigned int j0 = bj * BLOCK_SIZE + b * BAND_SIZE;
+				for (unsigned int j = 0; j <= bandCells; ++j)
+				{
+					strip[2 * j] = i * width + j0 + j;
+					strip[2 * j + 1] = (i + 1) * width + j0 + j;
+				}
+				strip[2 * (bandCells + 1)] = RESTART_INDEX;
+				bandStart += size_t(rows) * stripLength(bandCells);
+			}
+		}
+	}
+}
+
+unsigned int TerrainGrid::stripCount() const
+{
+	return height > 0 ? height - 1 : 0;
+}
+
+unsigned int TerrainGrid::blockColumns() const
+{
+	return width > 1 ? (width - 2) / BLOCK_SIZE + 1 : 0;
+}
+
+unsigned int TerrainGrid::blockRows() const
+{
+	return height > 1 ? (height - 2) / BLOCK_SIZE + 1 : 0;
+}
+
+unsigned int TerrainGrid::blockCells(unsigned int bj) const
+{
+	return std::min(BLOCK_SIZE, width - 1 - bj * BLOCK_SIZE);
+}
+
+unsigned int TerrainGrid::stripLength(unsigned int cells)
+{
+	return 2 * (cells + 1) + 1;
+}
+
+const Perlin& TerrainGrid::noise() const
+{
+	return perlin;
+}
+
+bool TerrainGrid::isCompact() const
+{
+	return compact;
+}
+
+glm::dmat4 TerrainGrid::model() const
+{
+	return glm::translate(glm::dmat4(1.0), glm::dvec3(origin.x, 0.0, origin.y));
+}
+
+uint32_t TerrainGrid::packNormal(const glm::vec3& normal)
+{
+	// Project onto the octahedron and unfold it around y, terrain normals point up and stay in the inner square
+	glm::vec3 n = normal / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+	glm::vec2 p(n.x, n.z);
+	if (n.y < 0.0f)
+	{
+		p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * glm::vec2(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return glm::packSnorm2x16(p);
+}
+
+glm::vec3 TerrainGrid::unpackNormal(uint32_t packed)
+{
+	glm::vec2 p = glm::unpackSnorm2x16(packed);
+	glm::vec3 n(p.x, 1.0f - std::abs(p.x) - std::abs(p.y), p.y);
+	float t = std::max(-n.y, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.z += n.z >= 0.0f ? -t : t;
+	return glm::normalize(n);
+}
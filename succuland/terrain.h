@@ -0,0 +1,144 @@
+#pragma once
+
+#ifndef _TERRAIN_H
+#define _TERRAIN_H
+
+#include "perlin.h"
+#include "heightfield.h"
+#include "threadpool.h"
+#include "meshopt.h"
+
+#include <vector>
+#include <functional>
+#include <glm/glm.hpp>
+
+/// <summary>
+/// CPU side data of the terrain grid, generated without a GL context.
+/// Row i of the grid lies at z = origin.y + i, column j at x = origin.x + j,
+/// every pair of neighbouring rows is joined by triangle strips, one per band of a culling block.
+/// Vertices are stored relative to origin and placed by model(), so they stay exact far from the world origin.
+/// Texture coordinates follow the world position, so neighbouring grids tile seamlessly
+/// </summary>
+class TerrainGrid
+{
+public:
+	/// Number of grid rows generated by one thread pool task
+	static const unsigned int TILE_ROWS = 16;
+	/// Texture coordinate step between neighbouring grid points
+	static constexpr float TEX_SPACING = 0.05f;
+	/// Index ending every strip, matches GL_PRIMITIVE_RESTART_FIXED_INDEX for unsigned int indices
+	static const unsigned int RESTART_INDEX = 0xFFFFFFFFu;
+	/// Cells along one side of a culling block
+	static constexpr unsigned int BLOCK_SIZE = 32;
+	/// Cells along x of one strip, blocks are split into bands of strips so both rows of a strip fit in the
+	/// post-transform cache and the row it shares with the next strip is still cached when that one reuses it
+	static constexpr unsigned int BAND_SIZE = MeshOptimizer::CACHE_SIZE / 2 - 1;
+
+	/// Square part of the grid culled as a whole, its strips are stored together in indices
+	struct Block
+	{
+		/// First index of the block in indices
+		size_t firstIndex;
+		unsigned int indexCount;
+		/// Bounding box of the block grid points
+		glm::vec3 low;
+		glm::vec3 high;
+	};
+
+	/// Grid points in rows [i0, i1) and columns [j0, j1)
+	struct Region
+	{
+		unsigned int i0;
+		unsigned int j0;
+		unsigned int i1;
+		unsigned int j1;
+	};
+
+	const unsigned int width;
+	const unsigned int height;
+	/// World position of grid point (0, 0)
+	const glm::vec2 origin;
+
+	/// Vertex (i, j) is (j, height, i), relative to origin
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> texCoords;
+	/// Octahedral encoded normals as two snorm16 values, replace vertices, normals and texture coordinates in the compact format
+	std::vector<uint32_t> packedNormals;
+	/// Triangle strip indices grouped by block, band by band and row by row inside a block and every strip ends with RESTART_INDEX,
+	/// so the whole grid or any run of neighbouring blocks is drawn by one call with primitive restart
+	std::vector<unsigned int> indices;
+	/// Culling blocks, row by row along x, in the order of their indices
+	std::vector<Block> blocks;
+
+	/// Heights of the grid points, used for runtime height queries
+	HeightField heightField;
+
+	/// <param name="perlin">Noise defining the heights, has to outlive the grid</param>
+	/// <param name="withNormals">Generate normals</param>
+	/// <param name="withTexCoords">Generate texture coordinates</param>
+	/// <param name="compact">Generate only the heights and packed normals, positions and texture coordinates follow from the grid index</param>
+	TerrainGrid(unsigned int width, unsigned int height, const Perlin& perlin, bool withNormals, bool withTexCoords, bool compact = false);
+	/// Grid starting at origin instead of being centered around 0.0
+	TerrainGrid(unsigned int width, unsigned int height, const glm::vec2& origin, const Perlin& perlin, bool withNormals, bool withTexCoords, bool compact = false);
+
+	/// <summary>
+	/// Size every array up front and fill them in parallel tiles of rows
+	/// </summary>
+	/// <param name="pool">Pool running the tiles</param>
+	/// <param name="vertexData">Generate vertices, normals, texture coordinates and heights, otherwise only the
+	/// indices are generated and the height field is left for the caller to fill</param>
+	void generate(ThreadPool& pool, bool vertexData = true);
+
+	/// Generate vertices, normals, texture coordinates and heights of rows [first, last)
+	void generateRows(unsigned int first, unsigned int last);
+	/// Generate the strip indices of rows [first, last)
+	void generateStrips(unsigned int first, unsigned int last);
+	/// Fill the block bounds from the height field, generate does it unless the heights are left to the caller
+	void measureBlocks();
+
+	/// <summary>
+	/// Change the heights of a region and update everything depending on them, the cost follows the region size
+	/// </summary>
+	/// <param name="region">Edited grid points, clamped to the grid</param>
+	/// <param name="edit">New height of a grid point from its world x, z and current height</param>
+	/// <returns>Grid points whose vertex data changed, the edited ones and a 1 point border of changed normals</returns>
+	Region editHeights(const Region& region, const std::function<float(float x, float z, float height)>& edit);
+	/// Normal of grid point i, j from the differences of its neighbouring heights, close to the noise gradient on unedited terrain
+	glm::vec3 heightNormal(unsigned int i, unsigned int j) const;
+
+	/// Number of strips along a column of the grid, one less than the number of rows
+	unsigned int stripCount() const;
+	/// Number of blocks along x
+	unsigned int blockColumns() const;
+	/// Number of blocks along z
+	unsigned int blockRows() const;
+	/// Noise the grid is generated from
+	const Perlin& noise() const;
+	/// Whether the grid is generated in the compact format
+	bool isCompact() const;
+	/// Model matrix moving the grid relative vertices to origin, kept in double so it can be made camera relative exactly
+	glm::dmat4 model() const;
+
+	/// Octahedral encoding of a unit normal into two snorm16 values, the first one in the low bits
+	static uint32_t packNormal(const glm::vec3& normal);
+	/// Inverse of packNormal
+	static glm::vec3 unpackNormal(uint32_t packed);
+
+protected:
+	const Perlin& perlin;
+	bool withNormals;
+	bool withTexCoords;
+	bool compact;
+
+	/// Lay out the block index ranges
+	void initBlocks();
+	/// Fill the bounds of block bi, bj from the height field
+	void measureBlock(unsigned int bi, unsigned int bj);
+	/// Cells along x of block column bj, neighbouring blocks share their edge column of grid points
+	unsigned int blockCells(unsigned int bj) const;
+	/// Indices taken by one strip over cells cells including its restart index
+	static unsigned int stripLength(unsigned int cells);
+};
+
+#endif
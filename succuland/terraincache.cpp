@@ -0,0 +1,210 @@
+/*
+*	On-disk cache of generated terrain meshes
+*/
+
+#include "terraincache.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+TerrainCache::Key TerrainCache::key(const TerrainGrid& grid, uint32_t flags)
+{
+	const Perlin& perlin = grid.noise();
+	Key key;
+	// Zeroed first so the key compares and writes byte by byte
+	std::memset(&key, 0, sizeof(Key));
+	key.version = VERSION;
+	key.width = grid.width;
+	key.height = grid.height;
+	key.seed = perlin.seed();
+	key.octaves = perlin.octaves();
+	key.frequency = perlin.frequency();
+	key.amplitude = perlin.amplitude();
+	key.backend = perlin.backend();
+	key.flags = flags;
+	key.blockSize = sizeof(TerrainGrid::Block);
+	return key;
+}
+
+TerrainCache::TerrainCache(const std::string& path, const Key& key)
+	: view(nullptr), size(0), header(), file(nullptr), mapping(nullptr)
+{
+	if (!map(path))
+		return;
+
+	// Sizes are checked before any section is read, a truncated or foreign file is just a miss
+	if (size < sizeof(Header))
+	{
+		unmap();
+		return;
+	}
+	std::memcpy(&header, view, sizeof(Header));
+	if (std::memcmp(&header.key, &key, sizeof(Key)) != 0 || size != vertexOffset() + header.vertexBytes)
+		unmap();
+}
+
+TerrainCache::~TerrainCache()
+{
+	unmap();
+}
+
+bool TerrainCache::valid() const
+{
+	return view != nullptr;
+}
+
+const void* TerrainCache::vertexData() const
+{
+	return view + vertexOffset();
+}
+
+size_t TerrainCache::vertexBytes() const
+{
+	return size_t(header.vertexBytes);
+}
+
+const unsigned int* TerrainCache::indices() const
+{
+	return reinterpret_cast<const unsigned int*>(view + indicesOffset());
+}
+
+size_t TerrainCache::indexCount() const
+{
+	return size_t(header.indexCount);
+}
+
+void TerrainCache::restore(TerrainGrid& grid) const
+{
+	grid.blocks.resize(size_t(header.blockCount));
+	std::memcpy(grid.blocks.data(), view + sizeof(Header), grid.blocks.size() * sizeof(TerrainGrid::Block));
+	grid.heightField = HeightField(grid.width, grid.height, grid.origin.x, grid.origin.y);
+	std::memcpy(grid.heightField.data(), view + heightsOffset(), size_t(grid.width) * grid.height * sizeof(float));
+}
+
+void TerrainCache::write(const std::string& path, const Key& key, const TerrainGrid& grid, const void* vertexData, size_t vertexBytes)
+{
+	Header header;
+	std::memset(&header, 0, sizeof(Header));
+	header.key = key;
+	header.blockCount = grid.blocks.size();
+	header.indexCount = grid.indices.size();
+	header.vertexBytes = vertexBytes;
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	if (!out)
+		throw std::runtime_error("Can't write terrain cache " + path);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+	out.write(reinterpret_cast<const char*>(grid.blocks.data()), grid.blocks.size() * sizeof(TerrainGrid::Block));
+	out.write(reinterpret_cast<const char*>(grid.heightField.data()), size_t(grid.width) * grid.height * sizeof(float));
+	out.write(reinterpret_cast<const char*>(grid.indices.data()), grid.indices.size() * sizeof(unsigned int));
+	out.write(static_cast<const char*>(vertexData), vertexBytes);
+	if (!out)
+		throw std::runtime_error("Can't write terrain cache " + path);
+}
+
+size_t TerrainCache::heightsOffset() const
+{
+	return sizeof(Header) + size_t(header.blockCount) * sizeof(TerrainGrid::Block);
+}
+
+size_t TerrainCache::indicesOffset() const
+{
+	return heightsOffset() + size_t(header.key.width) * header.key.height * sizeof(float);
+}
+
+size_t TerrainCache::vertexOffset() const
+{
+	return indicesOffset() + size_t(header.indexCount) * sizeof(unsigned int);
+}
+
+#ifdef _WIN32
+
+bool TerrainCache::map(const std::string& path)
+{
+	HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (handle == INVALID_HANDLE_VALUE)
+		return false;
+	file = handle;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart == 0)
+	{
+		unmap();
+		return false;
+	}
+	size = size_t(fileSize.QuadPart);
+
+	mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping != nullptr)
+		view = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (view == nullptr)
+	{
+		unmap();
+		return false;
+	}
+	return true;
+}
+
+void TerrainCache::unmap()
+{
+	if (view != nullptr)
+		UnmapViewOfFile(view);
+	if (mapping != nullptr)
+		CloseHandle(mapping);
+	if (file != nullptr)
+		CloseHandle(file);
+	view = nullptr;
+	mapping = nullptr;
+	file = nullptr;
+	size = 0;
+}
+
+#else
+
+bool TerrainCache::map(const std::string& path)
+{
+	// The mapping stays valid after the descriptor is closed
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+	size = size_t(info.st_size);
+
+	void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (address == MAP_FAILED)
+	{
+		size = 0;
+		return false;
+	}
+	view = static_cast<const char*>(address);
+	return true;
+}
+
+void TerrainCache::unmap()
+{
+	if (view != nullptr)
+		munmap(const_cast<char*>(view), size);
+	view = nullptr;
+	size = 0;
+}
+
+#endif
@@ -0,0 +1,93 @@
+#pragma once
+
+#ifndef _TERRAINCACHE_H
+#define _TERRAINCACHE_H
+
+#include "terrain.h"
+
+#include <string>
+#include <cstdint>
+
+/// <summary>
+/// Binary file holding one generated terrain mesh, keyed by every parameter the generation depends on.
+/// The file is memory mapped, a cached mesh is uploaded straight from the mapping without generating it
+/// </summary>
+class TerrainCache
+{
+public:
+	/// Bumped whenever the generated data or the file layout changes, files of other versions are rebuilt
+	static const uint32_t VERSION = 2;
+
+	/// Parameters the cached mesh was generated with, the file is only used for an identical key
+	struct Key
+	{
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+		int32_t seed;
+		int32_t octaves;
+		float frequency;
+		float amplitude;
+		int32_t backend;
+		/// Vertex attribute flags of the mesh, they decide the vertex buffer layout
+		uint32_t flags;
+		/// Guards the raw block records against a different layout of TerrainGrid::Block
+		uint32_t blockSize;
+	};
+
+	/// Key of a grid generated into a mesh with the given vertex attribute flags
+	static Key key(const TerrainGrid& grid, uint32_t flags);
+
+	/// Map the file at path, the cache stays invalid when the file is missing, damaged or holds another key
+	TerrainCache(const std::string& path, const Key& key);
+	~TerrainCache();
+
+	TerrainCache(const TerrainCache&) = delete;
+	TerrainCache& operator=(const TerrainCache&) = delete;
+
+	/// Whether the file holds the mesh of the key
+	bool valid() const;
+
+	/// Vertex buffer contents in the layout of the mesh
+	const void* vertexData() const;
+	size_t vertexBytes() const;
+	/// Triangle strip indices of the grid
+	const unsigned int* indices() const;
+	size_t indexCount() const;
+	/// Copy the heights and the culling blocks into a grid of the key
+	void restore(TerrainGrid& grid) const;
+
+	/// <summary>
+	/// Write the file for a generated grid, replaces any file at path
+	/// </summary>
+	/// <param name="vertexData">Vertex buffer contents of the mesh, vertex arrays of the grid may be empty after GPU generation</param>
+	static void write(const std::string& path, const Key& key, const TerrainGrid& grid, const void* vertexData, size_t vertexBytes);
+
+protected:
+	/// File layout: header, blocks, heights, indices and vertex data, sections are unaligned
+	struct Header
+	{
+		Key key;
+		uint64_t blockCount;
+		uint64_t indexCount;
+		uint64_t vertexBytes;
+	};
+
+	/// Read only view of the whole file, nullptr when the cache is invalid
+	const char* view;
+	size_t size;
+	Header header;
+	/// Platform handles of the mapping
+	void* file;
+	void* mapping;
+
+	/// Map the file, false if it can't be opened
+	bool map(const std::string& path);
+	void unmap();
+	/// Offset of the heights, indices and vertex data sections
+	size_t heightsOffset() const;
+	size_t indicesOffset() const;
+	size_t vertexOffset() const;
+};
+
+#endif
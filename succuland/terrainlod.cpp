@@ -0,0 +1,208 @@
+/*
+*	Quadtree level of detail terrain
+*/
+
+#include "terrainlod.h"
+#include "camera.h"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+TerrainLOD::TerrainLOD(unsigned int width, unsigned int length, const Perlin& perlin, float detailRange, float viewRange, LightingShader* shader, Material* material)
+	: shader(shader), material(material), patch(PATCH_SIZE, shader),
+	map(width, length, glm::vec2(-(width / 2.0f), -(length / 2.0f)), perlin),
+	viewRange(viewRange), triangles(0), culled(0)
+{
+	for (unsigned int level = 0; level < LOD_LEVELS; ++level)
+		ranges[level] = detailRange * float(1u << level);
+
+	const unsigned int rootSize = PATCH_SIZE << (LOD_LEVELS - 1);
+	for (unsigned int i = 0; i < length - 1; i += rootSize)
+	{
+		for (unsigned int j = 0; j < width - 1; j += rootSize)
+		{
+			roots.push_back(buildNode(i, j, rootSize));
+		}
+	}
+}
+
+int TerrainLOD::buildNode(unsigned int i, unsigned int j, unsigned int size)
+{
+	int index = (int)nodes.size();
+	nodes.push_back({ map.origin + glm::vec2(j, i), float(size), 0.0f, 0.0f, { -1, -1, -1, -1 } });
+
+	if (size > PATCH_SIZE)
+	{
+		// Children share their edge grid points, together they cover every point of the parent
+		unsigned int half = size / 2;
+		for (unsigned int q = 0; q < 4; ++q)
+		{
+			unsigned int ci = i + (q >> 1) * half;
+			unsigned int cj = j + (q & 1) * half;
+			if (ci >= map.length - 1 || cj >= map.width - 1)
+				continue;
+
+			int child = buildNode(ci, cj, half);
+			nodes[index].children[q] = child;
+		}
+	}
+
+	fitNode(index);
+	return index;
+}
+
+void TerrainLOD::fitNode(int index)
+{
+	Node& node = nodes[index];
+	node.minHeight = std::numeric_limits<float>::max();
+	node.maxHeight = std::numeric_limits<float>::lowest();
+	if (node.size > PATCH_SIZE)
+	{
+		for (int child : node.children)
+		{
+			if (child < 0)
+				continue;
+			node.minHeight = std::min(node.minHeight, nodes[child].minHeight);
+			node.maxHeight = std::max(node.maxHeight, nodes[child].maxHeight);
+		}
+		return;
+	}
+
+	const HeightField& heights = map.getHeightField();
+	unsigned int i = unsigned(node.origin.y - map.origin.y);
+	unsigned int j = unsigned(node.origin.x - map.origin.x);
+	unsigned int size = unsigned(node.size);
+	for (unsigned int y = i; y <= std::min(i + size, map.length - 1); ++y)
+	{
+		for (unsigned int x = j; x <= std::min(j + size, map.width - 1); ++x)
+		{
+			node.minHeight = std::min(node.minHeight, heights.at(y, x));
+			node.maxHeight = std::max(node.maxHeight, heights.at(y, x));
+		}
+	}
+}
+
+void TerrainLOD::refitNode(int index, const TerrainGrid::Region& region)
+{
+	// Nodes cover size + 1 grid points, their last row and column are shared with the next node
+	const Node& node = nodes[index];
+	unsigned int i = unsigned(node.origin.y - map.origin.y);
+	unsigned int j = unsigned(node.origin.x - map.origin.x);
+	unsigned int size = unsigned(node.size);
+	if (i >= region.i1 || region.i0 > i + size || j >= region.j1 || region.j0 > j + size)
+		return;
+
+	for (int child : node.children)
+	{
+		if (child >= 0)
+			refitNode(child, region);
+	}
+	fitNode(index);
+}
+
+bool TerrainLOD::inRange(const Node& node, const glm::vec3& camera, float range) const
+{
+	glm::vec3 low(node.origin.x, node.minHeight, node.origin.y);
+	glm::vec3 high(node.origin.x + node.size, node.maxHeight, node.origin.y + node.size);
+	glm::vec3 closest = glm::clamp(camera, low, high);
+	return glm::distance(camera, closest) <= range;
+}
+
+bool TerrainLOD::select(int index, unsigned int level, const glm::vec3& camera, const Frustum& frustum)
+{
+	const Node& node = nodes[index];
+	if (!inRange(node, camera, viewRange))
+		return true;
+	if (!inRange(node, camera, ranges[level]))
+		return false;
+	if (!frustum.intersects(glm::vec3(node.origin.x, node.minHeight, node.origin.y), glm::vec3(node.origin.x + node.size, node.maxHeight, node.origin.y + node.size)))
+	{
+		++culled;
+		return true;
+	}
+
+	if (level == 0 || !inRange(node, camera, ranges[level - 1]))
+	{
+		selection.push_back({ index, level, 0b1111 });
+		return true;
+	}
+
+	// Quadrants the finer level doesn't reach are drawn at this level
+	uint8_t mask = 0;
+	for (unsigned int q = 0; q < 4; ++q)
+	{
+		int child = node.children[q];
+		if (child >= 0 && !select(child, level - 1, camera, frustum))
+			mask |= 1 << q;
+	}
+	if (mask != 0)
+		selection.push_back({ index, level, mask });
+	return true;
+}
+
+void TerrainLOD::draw(const Camera& camera)
+{
+	selection.clear();
+	culled = 0;
+	Frustum frustum = camera.frustum();
+	for (int root : roots)
+	{
+		select(root, LOD_LEVELS - 1, camera.position, frustum);
+	}
+
+	shader->use();
+	shader->setTransformParameters(camera, map.model());
+	shader->loadFog();
+	shader->setMaterial(material);
+	shader->setTerrainMaps(LightingShader::TERRAIN_MODE_LOD, map.heightTexture(), map.normalTexture(), map.sunTexture(), map.origin, glm::vec2(map.width, map.length), PATCH_SIZE, TerrainGrid::TEX_SPACING);
+
+	triangles = 0;
+	for (const Selection& s : selection)
+	{
+		const Node& node = nodes[s.node];
+		float previous = s.level > 0 ? ranges[s.level - 1] : 0.0f;
+		float morphStart = previous + (ranges[s.level] - previous) * MORPH_START;
+		shader->setTerrainNode(node.origin - map.origin, node.size, morphStart, ranges[s.level]);
+		patch.drawQuadrants(s.mask);
+		triangles += patch.numPrimitives / 4 * std::popcount(s.mask);
+	}
+
+	shader->disableTerrain();
+	Shader::unbind();
+}
+
+const HeightField& TerrainLOD::getHeightField() const
+{
+	return map.getHeightField();
+}
+
+TerrainGrid::Region TerrainLOD::editHeights(const glm::vec2& low, const glm::vec2& high, const std::function<float(float x, float z, float height)>& edit)
+{
+	TerrainGrid::Region changed = map.editHeights(low, high, edit);
+	for (int root : roots)
+	{
+		refitNode(root, changed);
+	}
+	return changed;
+}
+
+void TerrainLOD::bakeSun(const glm::vec3& direction)
+{
+	map.bakeSun(direction);
+}
+
+size_t TerrainLOD::drawnNodes() const
+{
+	return selection.size();
+}
+
+size_t TerrainLOD::drawnTriangles() const
+{
+	return triangles;
+}
+
+size_t TerrainLOD::culledNodes() const
+{
+	return culled;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#ifndef _TERRAINLOD_H
+#define _TERRAINLOD_H
+
+#include "pgr.h"
+#include "geometry.h"
+#include "heightmap.h"
+
+#include <vector>
+
+class Camera;
+
+/// <summary>
+/// Continuous distance-dependent level of detail terrain (CDLOD). A quadtree over the height map picks nodes
+/// every frame by camera distance, every node is drawn with the same grid patch mesh and phong.vert displaces
+/// and morphs its vertices, so the triangle count depends on the level ranges rather than the terrain size
+/// </summary>
+class TerrainLOD
+{
+public:
+	/// Cells along one side of the shared patch mesh, a leaf node is drawn at one cell per grid point
+	static const unsigned int PATCH_SIZE = 16;
+	/// Number of quadtree levels, a root node covers PATCH_SIZE << (LOD_LEVELS - 1) grid points
+	static const unsigned int LOD_LEVELS = 6;
+	/// Part of a level range after which vertices start morphing into the next level
+	static constexpr float MORPH_START = 0.7f;
+
+	/// <summary>
+	/// Generate the terrain height map, the grid is centered around 0.0
+	/// </summary>
+	/// <param name="perlin">Noise defining the heights</param>
+	/// <param name="detailRange">Camera distance drawn at full resolution, every further level doubles it,
+	/// has to exceed the diagonal of a leaf node</param>
+	/// <param name="viewRange">Nodes further than this from the camera aren't drawn</param>
+	TerrainLOD(unsigned int width, unsigned int length, const Perlin& perlin, float detailRange, float viewRange, LightingShader* shader, Material* material);
+
+	TerrainLOD(const TerrainLOD&) = delete;
+	TerrainLOD& operator=(const TerrainLOD&) = delete;
+
+	/// Select nodes around the camera and inside its frustum and draw them
+	void draw(const Camera& camera);
+
+	/// Heights of the full resolution grid
+	const HeightField& getHeightField() const;
+	/// Change the heights inside a rectangle and refit the height ranges of the nodes it touches, see HeightMap::editHeights
+	TerrainGrid::Region editHeights(const glm::vec2& low, const glm::vec2& high, const std::function<float(float x, float z, float height)>& edit);
+	/// Bake the sun lighting into the height map, see HeightMap::bakeSun
+	void bakeSun(const glm::vec3& direction);
+
+	/// Nodes drawn by the last draw call
+	size_t drawnNodes() const;
+	/// Triangles drawn by the last draw call
+	size_t drawnTriangles() const;
+	/// Nodes in range but outside the frustum in the last draw call, their subtrees aren't visited
+	size_t culledNodes() const;
+
+protected:
+	/// Square node of the quadtree with the height range of the grid points it covers
+	struct Node
+	{
+		glm::vec2 origin;
+		float size;
+		float minHeight;
+		float maxHeight;
+		/// Indices of the children in quadrant order, -1 for children outside the terrain
+		int children[4];
+	};
+
+	/// Node picked for drawing at a level, only the quadrants in mask are drawn
+	struct Selection
+	{
+		int node;
+		unsigned int level;
+		uint8_t mask;
+	};
+
+	LightingShader* shader;
+	Material* material;
+	GridPatchMesh patch;
+	HeightMap map;
+
+	/// Nodes of every tree, children follow their parents
+	std::vector<Node> nodes;
+	std::vector<int> roots;
+	/// Camera distance covered by each level
+	float ranges[LOD_LEVELS];
+	const float viewRange;
+
+	std::vector<Selection> selection;
+	size_t triangles;
+	size_t culled;
+
+	/// Build the node covering size grid points from the grid point (i, j) and its subtree, returns its index
+	int buildNode(unsigned int i, unsigned int j, unsigned int size);
+	/// Measure the height range of a node from its children, or from its grid points for a leaf
+	void fitNode(int node);
+	/// Fit the nodes of the subtree whose grid points overlap region again, children before their parents
+	void refitNode(int node, const TerrainGrid::Region& region);
+	/// <summary>
+	/// Pick the node or the parts of it within the range of the level, finer levels are picked where they reach
+	/// </summary>
+	/// <returns>False if the node is out of the level range and its parent has to draw its area,
+	/// nodes out of the view range or the frustum are skipped and count as handled</returns>
+	bool select(int node, unsigned int level, const glm::vec3& camera, const Frustum& frustum);
+	/// Whether a sphere around the camera reaches the node bounds
+	bool inRange(const Node& node, const glm::vec3& camera, float range) const;
+};
+
+#endif
@@ -0,0 +1,123 @@
+/*
+*	Instanced height map terrain
+*/
+
+#include "terrainpatches.h"
+#include "camera.h"
+
+#include <algorithm>
+#include <limits>
+
+TerrainPatches::TerrainPatches(unsigned int width, unsigned int length, const Perlin& perlin, float viewRange, LightingShader* shader, Material* material)
+	: shader(shader), material(material), mesh(PATCH_SIZE, shader),
+	map(width, length, glm::vec2(-(width / 2.0f), -(length / 2.0f)), perlin),
+	viewRange(viewRange), instanceBuffer(0)
+{
+	buildPatches();
+
+	glGenBuffers(1, &instanceBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, patches.size() * sizeof(glm::vec2), nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	mesh.setInstanceOrigins(instanceBuffer);
+}
+
+TerrainPatches::~TerrainPatches()
+{
+	glDeleteBuffers(1, &instanceBuffer);
+}
+
+void TerrainPatches::buildPatches()
+{
+	patches.clear();
+	for (unsigned int i = 0; i < map.length - 1; i += PATCH_SIZE)
+	{
+		for (unsigned int j = 0; j < map.width - 1; j += PATCH_SIZE)
+		{
+			Patch patch = { map.origin + glm::vec2(j, i), 0.0f, 0.0f };
+			fitPatch(patch);
+			patches.push_back(patch);
+		}
+	}
+}
+
+void TerrainPatches::fitPatch(Patch& patch) const
+{
+	// Neighbouring patches share their edge grid points
+	const HeightField& heights = map.getHeightField();
+	unsigned int i = unsigned(patch.origin.y - map.origin.y);
+	unsigned int j = unsigned(patch.origin.x - map.origin.x);
+	patch.minHeight = std::numeric_limits<float>::max();
+	patch.maxHeight = std::numeric_limits<float>::lowest();
+	for (unsigned int y = i; y <= std::min(i + PATCH_SIZE, map.length - 1); ++y)
+	{
+		for (unsigned int x = j; x <= std::min(j + PATCH_SIZE, map.width - 1); ++x)
+		{
+			patch.minHeight = std::min(patch.minHeight, heights.at(y, x));
+			patch.maxHeight = std::max(patch.maxHeight, heights.at(y, x));
+		}
+	}
+}
+
+void TerrainPatches::draw(const Camera& camera)
+{
+	instances.clear();
+	Frustum frustum = camera.frustum();
+	glm::vec3 eye = camera.position;
+	for (const Patch& patch : patches)
+	{
+		glm::vec3 low(patch.origin.x, patch.minHeight, patch.origin.y);
+		glm::vec3 high(patch.origin.x + PATCH_SIZE, patch.maxHeight, patch.origin.y + PATCH_SIZE);
+		if (glm::distance(eye, glm::clamp(eye, low, high)) <= viewRange && frustum.intersects(low, high))
+			instances.push_back(patch.origin - map.origin);
+	}
+	if (instances.empty())
+		return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(glm::vec2), instances.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	shader->use();
+	shader->setTransformParameters(camera, map.model());
+	shader->loadFog();
+	shader->setMaterial(material);
+	shader->setTerrainMaps(LightingShader::TERRAIN_MODE_PATCHES, map.heightTexture(), map.normalTexture(), map.sunTexture(), map.origin, glm::vec2(map.width, map.length), PATCH_SIZE, TerrainGrid::TEX_SPACING);
+	mesh.drawInstanced((unsigned int)instances.size());
+	shader->disableTerrain();
+	Shader::unbind();
+}
+
+const HeightField& TerrainPatches::getHeightField() const
+{
+	return map.getHeightField();
+}
+
+TerrainGrid::Region TerrainPatches::editHeights(const glm::vec2& low, const glm::vec2& high, const std::function<float(float x, float z, float height)>& edit)
+{
+	TerrainGrid::Region changed = map.editHeights(low, high, edit);
+	for (Patch& patch : patches)
+	{
+		// Patches cover PATCH_SIZE + 1 grid points, their last row and column are shared with the next patch
+		unsigned int i = unsigned(patch.origin.y - map.origin.y);
+		unsigned int j = unsigned(patch.origin.x - map.origin.x);
+		if (i < changed.i1 && changed.i0 <= i + PATCH_SIZE && j < changed.j1 && changed.j0 <= j + PATCH_SIZE)
+			fitPatch(patch);
+	}
+	return changed;
+}
+
+void TerrainPatches::bakeSun(const glm::vec3& direction)
+{
+	map.bakeSun(direction);
+}
+
+size_t TerrainPatches::drawnPatches() const
+{
+	return instances.size();
+}
+
+size_t TerrainPatches::culledPatches() const
+{
+	return patches.size() - instances.size();
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#ifndef _TERRAINPATCHES_H
+#define _TERRAINPATCHES_H
+
+#include "pgr.h"
+#include "geometry.h"
+#include "heightmap.h"
+
+#include <vector>
+
+class Camera;
+
+/// <summary>
+/// Terrain drawn by instancing one small patch mesh over a height map. Mesh memory doesn't depend on the terrain
+/// size and an edit of the terrain only uploads the changed texels. Patches out of the view range are left out of the instances
+/// </summary>
+class TerrainPatches
+{
+public:
+	/// Cells along one side of a patch, one cell per grid point
+	static const unsigned int PATCH_SIZE = 32;
+
+	/// <summary>
+	/// Generate the terrain height map, the grid is centered around 0.0
+	/// </summary>
+	/// <param name="perlin">Noise defining the heights</param>
+	/// <param name="viewRange">Patches further than this from the camera aren't drawn</param>
+	TerrainPatches(unsigned int width, unsigned int length, const Perlin& perlin, float viewRange, LightingShader* shader, Material* material);
+	~TerrainPatches();
+
+	TerrainPatches(const TerrainPatches&) = delete;
+	TerrainPatches& operator=(const TerrainPatches&) = delete;
+
+	/// Draw the patches in range of the camera and inside its frustum in one instanced call
+	void draw(const Camera& camera);
+
+	/// Heights of the grid points
+	const HeightField& getHeightField() const;
+	/// Change the heights inside a rectangle and refit the height ranges of the patches it touches, see HeightMap::editHeights
+	TerrainGrid::Region editHeights(const glm::vec2& low, const glm::vec2& high, const std::function<float(float x, float z, float height)>& edit);
+	/// Bake the sun lighting into the height map, see HeightMap::bakeSun
+	void bakeSun(const glm::vec3& direction);
+
+	/// Patches drawn by the last draw call
+	size_t drawnPatches() const;
+	/// Patches left out of the last draw call by range or frustum
+	size_t culledPatches() const;
+
+protected:
+	/// Corner and height range of one patch
+	struct Patch
+	{
+		glm::vec2 origin;
+		float minHeight;
+		float maxHeight;
+	};
+
+	LightingShader* shader;
+	Material* material;
+	GridPatchMesh mesh;
+	HeightMap map;
+	const float viewRange;
+
+	std::vector<Patch> patches;
+	/// Corners of the patches drawn this frame, streamed into instanceBuffer
+	std::vector<glm::vec2> instances;
+	GLuint instanceBuffer;
+
+	/// Split the height map into patches and measure their height ranges
+	void buildPatches();
+	/// Measure the height range of the grid points under a patch
+	void fitPatch(Patch& patch) const;
+};
+
+#endif
@@ -0,0 +1,243 @@
+/*
+*	Streaming chunked terrain
+*/
+
+#include "terrainstream.h"
+#include "camera.h"
+
+#include <algorithm>
+#include <cmath>
+
+TerrainStreamer::TerrainStreamer(const Perlin& perlin, float loadRadius, Shader* shader, Material* material, uint8_t flags)
+	: perlin(perlin), loadRadius(loadRadius), evictMargin(float(CHUNK_SIZE)),
+	shader(shader), material(material), flags(flags), stop(false)
+{
+	worker = std::thread(&TerrainStreamer::work, this);
+}
+
+TerrainStreamer::~TerrainStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	wake.notify_all();
+	worker.join();
+}
+
+void TerrainStreamer::loadAround(const glm::vec3& center)
+{
+	std::vector<ChunkKey> keys;
+	for (const ChunkKey& key : chunksAround(center, loadRadius))
+	{
+		if (chunks.count(key) == 0 && pending.count(key) == 0)
+			keys.push_back(key);
+	}
+
+	for (auto& grid : generate(keys))
+	{
+		upload(std::move(grid));
+	}
+}
+
+void TerrainStreamer::stream(const glm::vec3& center)
+{
+	std::vector<std::unique_ptr<TerrainGrid>> ready;
+	bool requested = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// Drop requests that left the range before the background thread got to them
+		for (auto it = requests.begin(); it != requests.end();)
+		{
+			if (distance(*it, center) > loadRadius + evictMargin)
+			{
+				pending.erase(*it);
+				it = requests.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		for (const ChunkKey& key : chunksAround(center, loadRadius))
+		{
+			if (chunks.count(key) == 0 && pending.insert(key).second)
+			{
+				requests.push_back(key);
+				requested = true;
+			}
+		}
+		std::sort(requests.begin(), requests.end(), [&center](const ChunkKey& a, const ChunkKey& b)
+		{
+			return distance(a, center) < distance(b, center);
+		});
+
+		size_t count = std::min(finished.size(), size_t(MAX_UPLOADS_PER_STREAM));
+		for (size_t i = 0; i < count; ++i)
+		{
+			ready.push_back(std::move(finished[i]));
+		}
+		finished.erase(finished.begin(), finished.begin() + count);
+	}
+	if (requested)
+		wake.notify_one();
+
+	for (auto& grid : ready)
+	{
+		ChunkKey key = chunkAt(grid->origin.x, grid->origin.y);
+		pending.erase(key);
+		if (distance(key, center) <= loadRadius + evictMargin)
+			upload(std::move(grid));
+	}
+
+	for (auto it = chunks.begin(); it != chunks.end();)
+	{
+		if (distance(it->first, center) > loadRadius + evictMargin)
+			it = chunks.erase(it);
+		else
+			++it;
+	}
+}
+
+void TerrainStreamer::draw(const Camera& camera) const
+{
+	if (chunks.empty())
+		return;
+
+	shader->use();
+	shader->loadFog();
+	Frustum frustum = camera.frustum();
+	for (const auto& chunk : chunks)
+	{
+		// Chunk vertices are relative to the chunk origin, which is moved relative to the camera in double precision
+		shader->setTransformParameters(camera, chunk.second->model());
+		chunk.second->cull(frustum);
+		chunk.second->draw();
+	}
+	Shader::unbind();
+}
+
+float TerrainStreamer::Get(float x, float z) const
+{
+	auto chunk = chunks.find(chunkAt(x, z));
+	if (chunk == chunks.end())
+		return perlin.Get(x, z);
+	return chunk->second->getHeightField().Get(x, z);
+}
+
+size_t TerrainStreamer::loadedChunks() const
+{
+	return chunks.size();
+}
+
+size_t TerrainStreamer::pendingChunks() const
+{
+	return pending.size();
+}
+
+size_t TerrainStreamer::drawnBlocks() const
+{
+	size_t count = 0;
+	for (const auto& chunk : chunks)
+	{
+		count += chunk.second->drawnBlocks();
+	}
+	return count;
+}
+
+size_t TerrainStreamer::culledBlocks() const
+{
+	size_t count = 0;
+	for (const auto& chunk : chunks)
+	{
+		count += chunk.second->culledBlocks();
+	}
+	return count;
+}
+
+TerrainStreamer::ChunkKey TerrainStreamer::chunkAt(float x, float z)
+{
+	return ChunkKey((int)std::floor(x / CHUNK_SIZE), (int)std::floor(z / CHUNK_SIZE));
+}
+
+float TerrainStreamer::distance(const ChunkKey& key, const glm::vec3& center)
+{
+	float x0 = float(key.first * CHUNK_SIZE);
+	float z0 = float(key.second * CHUNK_SIZE);
+	float dx = std::max({ x0 - center.x, 0.0f, center.x - (x0 + CHUNK_SIZE) });
+	float dz = std::max({ z0 - center.z, 0.0f, center.z - (z0 + CHUNK_SIZE) });
+	return std::sqrt(dx * dx + dz * dz);
+}
+
+std::vector<TerrainStreamer::ChunkKey> TerrainStreamer::chunksAround(const glm::vec3& center, float radius)
+{
+	ChunkKey low = chunkAt(center.x - radius, center.z - radius);
+	ChunkKey high = chunkAt(center.x + radius, center.z + radius);
+
+	std::vector<ChunkKey> keys;
+	for (int i = low.first; i <= high.first; ++i)
+	{
+		for (int j = low.second; j <= high.second; ++j)
+		{
+			if (distance(ChunkKey(i, j), center) <= radius)
+				keys.emplace_back(i, j);
+		}
+	}
+	std::sort(keys.begin(), keys.end(), [&center](const ChunkKey& a, const ChunkKey& b)
+	{
+		return distance(a, center) < distance(b, center);
+	});
+	return keys;
+}
+
+std::vector<std::unique_ptr<TerrainGrid>> TerrainStreamer::generate(const std::vector<ChunkKey>& keys) const
+{
+	std::vector<std::unique_ptr<TerrainGrid>> grids(keys.size());
+	ThreadPool::shared().parallelFor(0, (unsigned int)keys.size(), 1, [&](unsigned int first, unsigned int last)
+	{
+		// Chunks are the parallel tasks here, rows of one chunk are generated sequentially
+		ThreadPool serial(0);
+		for (unsigned int k = first; k < last; ++k)
+		{
+			glm::vec2 origin(float(keys[k].first * CHUNK_SIZE), float(keys[k].second * CHUNK_SIZE));
+			grids[k] = std::make_unique<TerrainGrid>(CHUNK_SIZE + 1, CHUNK_SIZE + 1, origin, perlin, (flags & NORMAL_BIT) != 0, (flags & TEXTURE_BIT) != 0, (flags & COMPACT_BIT) != 0);
+			grids[k]->generate(serial);
+		}
+	});
+	return grids;
+}
+
+void TerrainStreamer::upload(std::unique_ptr<TerrainGrid> grid)
+{
+	ChunkKey key = chunkAt(grid->origin.x, grid->origin.y);
+	chunks[key] = std::make_unique<TerrainMesh>(std::move(*grid), shader, material, flags);
+}
+
+void TerrainStreamer::work()
+{
+	while (true)
+	{
+		std::vector<ChunkKey> batch;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return stop || !requests.empty(); });
+			if (stop)
+				return;
+
+			// Nearest requests first, as many as the pool can generate at once
+			size_t count = std::min(requests.size(), size_t(ThreadPool::shared().concurrency()));
+			batch.assign(requests.begin(), requests.begin() + count);
+			requests.erase(requests.begin(), requests.begin() + count);
+		}
+
+		std::vector<std::unique_ptr<TerrainGrid>> grids = generate(batch);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto& grid : grids)
+		{
+			finished.push_back(std::move(grid));
+		}
+	}
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#ifndef _TERRAINSTREAM_H
+#define _TERRAINSTREAM_H
+
+#include "pgr.h"
+#include "geometry.h"
+#include "terrain.h"
+
+#include <map>
+#include <set>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class Camera;
+
+/// <summary>
+/// Terrain made of square chunks that are generated, uploaded and evicted around a moving center.
+/// Chunks are generated on a background thread and uploaded by stream(), every public member
+/// has to be called from the thread owning the GL context
+/// </summary>
+class TerrainStreamer : public HeightQuery
+{
+public:
+	/// Grid cells along one side of a chunk, neighbouring chunks share their edge vertices
+	static const int CHUNK_SIZE = 64;
+	/// Most chunks uploaded by one stream() call, keeps frame times even while moving
+	static const int MAX_UPLOADS_PER_STREAM = 4;
+
+	/// <summary>
+	/// Create an empty terrain, no chunks are generated until loadAround or stream is called
+	/// </summary>
+	/// <param name="perlin">Noise defining the heights</param>
+	/// <param name="loadRadius">Chunks closer than this to the center are loaded</param>
+	/// <param name="flags">Vertex data of the chunk meshes</param>
+	TerrainStreamer(const Perlin& perlin, float loadRadius, Shader* shader, Material* material, uint8_t flags);
+	~TerrainStreamer();
+
+	TerrainStreamer(const TerrainStreamer&) = delete;
+	TerrainStreamer& operator=(const TerrainStreamer&) = delete;
+
+	/// Generate and upload every chunk within the load radius of center before returning
+	void loadAround(const glm::vec3& center);
+
+	/// <summary>
+	/// Request missing chunks around center nearest first, upload chunks the background thread finished
+	/// and evict chunks that moved out of range. Meant to be called once per frame
+	/// </summary>
+	void stream(const glm::vec3& center);
+
+	/// Draw the blocks of the loaded chunks inside the camera frustum
+	void draw(const Camera& camera) const;
+
+	/// Height of the loaded chunk containing x, z, falls back to the noise where no chunk is loaded
+	float Get(float x, float z) const override;
+
+	size_t loadedChunks() const;
+	size_t pendingChunks() const;
+	/// Blocks of all chunks drawn by the last draw call
+	size_t drawnBlocks() const;
+	/// Blocks of all chunks left out by the last draw call
+	size_t culledBlocks() const;
+
+protected:
+	/// Chunk coordinates, chunk (i, j) covers x in [i, i + 1] * CHUNK_SIZE and z in [j, j + 1] * CHUNK_SIZE
+	typedef std::pair<int, int> ChunkKey;
+
+	const Perlin perlin;
+	const float loadRadius;
+	/// Chunks further than loadRadius + evictMargin are evicted, the margin stops chunks on the border from reloading
+	const float evictMargin;
+
+	Shader* shader;
+	Material* material;
+	uint8_t flags;
+
+	/// Uploaded chunks
+	std::map<ChunkKey, std::unique_ptr<TerrainMesh>> chunks;
+	/// Requested chunks that aren't uploaded yet
+	std::set<ChunkKey> pending;
+
+	// Shared with the background thread
+	std::mutex mutex;
+	std::condition_variable wake;
+	/// Chunks waiting for generation, nearest first
+	std::deque<ChunkKey> requests;
+	/// Generated chunks waiting for upload
+	std::vector<std::unique_ptr<TerrainGrid>> finished;
+	bool stop;
+
+	std::thread worker;
+
+	/// Chunk containing world position x, z
+	static ChunkKey chunkAt(float x, float z);
+	/// Horizontal distance between center and the closest point of the chunk
+	static float distance(const ChunkKey& key, const glm::vec3& center);
+	/// Chunks within radius of center, nearest first
+	static std::vector<ChunkKey> chunksAround(const glm::vec3& center, float radius);
+
+	/// Generate the grids of the chunks in parallel, one chunk per pool task
+	std::vector<std::unique_ptr<TerrainGrid>> generate(const std::vector<ChunkKey>& keys) const;
+	/// Upload a generated grid and add it to the loaded chunks
+	void upload(std::unique_ptr<TerrainGrid> grid);
+
+	/// Background thread main loop
+	void work();
+};
+
+#endif
@@ -0,0 +1,49 @@
+/*
+*	Tessellated height map terrain
+*/
+
+#include "terraintess.h"
+#include "camera.h"
+
+#include <algorithm>
+
+TerrainTessellation::TerrainTessellation(unsigned int width, unsigned int length, const Perlin& perlin, LightingShader* shader, Material* material)
+	: shader(shader), material(material),
+	map(width, length, glm::vec2(-(width / 2.0f), -(length / 2.0f)), perlin),
+	mesh(glm::vec2(0.0f), width, length, PATCH_SIZE, shader)
+{
+}
+
+void TerrainTessellation::draw(const Camera& camera)
+{
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	GLint maxLevel = 0;
+	glGetIntegerv(GL_MAX_TESS_GEN_LEVEL, &maxLevel);
+
+	shader->use();
+	shader->setTransformParameters(camera, map.model());
+	shader->loadFog();
+	shader->setMaterial(material);
+	shader->setTerrainMaps(LightingShader::TERRAIN_MODE_TESSELLATION, map.heightTexture(), map.normalTexture(), map.sunTexture(), map.origin, glm::vec2(map.width, map.length), PATCH_SIZE, TerrainGrid::TEX_SPACING);
+	shader->setFloat("tessellation.viewportHeight", float(viewport[3]));
+	shader->setFloat("tessellation.edgePixels", EDGE_PIXELS);
+	shader->setFloat("tessellation.maxLevel", float(std::min<GLint>(PATCH_SIZE, maxLevel)));
+	mesh.draw();
+	Shader::unbind();
+}
+
+const HeightField& TerrainTessellation::getHeightField() const
+{
+	return map.getHeightField();
+}
+
+TerrainGrid::Region TerrainTessellation::editHeights(const glm::vec2& low, const glm::vec2& high, const std::function<float(float x, float z, float height)>& edit)
+{
+	return map.editHeights(low, high, edit);
+}
+
+void TerrainTessellation::bakeSun(const glm::vec3& direction)
+{
+	map.bakeSun(direction);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#ifndef _TERRAINTESS_H
+#define _TERRAINTESS_H
+
+#include "pgr.h"
+#include "geometry.h"
+#include "heightmap.h"
+
+class Camera;
+
+/// <summary>
+/// Terrain sent to the GPU as coarse quad patches that the tessellation stages subdivide by the screen size of their
+/// edges and displace by a height map, nothing is selected on the CPU. Needs a shader built from terrain.vert,
+/// terrain.tesc, terrain.tese and phong.frag
+/// </summary>
+class TerrainTessellation
+{
+public:
+	/// Cells along one side of a patch, the highest tessellation level puts one segment on every cell
+	static const unsigned int PATCH_SIZE = 32;
+	/// Screen length of one subdivided edge in pixels
+	static constexpr float EDGE_PIXELS = 8.0f;
+
+	/// <summary>
+	/// Generate the terrain height map, the grid is centered around 0.0
+	/// </summary>
+	/// <param name="perlin">Noise defining the heights</param>
+	/// <param name="shader">Lighting shader with the tessellation stages</param>
+	TerrainTessellation(unsigned int width, unsigned int length, const Perlin& perlin, LightingShader* shader, Material* material);
+
+	TerrainTessellation(const TerrainTessellation&) = delete;
+	TerrainTessellation& operator=(const TerrainTessellation&) = delete;
+
+	/// Draw all patches, tessellated for the current viewport
+	void draw(const Camera& camera);
+
+	/// Heights of the grid points
+	const HeightField& getHeightField() const;
+	/// Change the heights inside a rectangle, patches keep no height ranges so only the map changes, see HeightMap::editHeights
+	TerrainGrid::Region editHeights(const glm::vec2& low, const glm::vec2& high, const std::function<float(float x, float z, float height)>& edit);
+	/// Bake the sun lighting into the height map, see HeightMap::bakeSun
+	void bakeSun(const glm::vec3& direction);
+
+protected:
+	LightingShader* shader;
+	Material* material;
+	HeightMap map;
+	QuadPatchMesh mesh;
+};
+
+#endif
@@ -0,0 +1,126 @@
+/*
+*	Simple thread pool for data parallel loops
+*/
+
+#include "threadpool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int threads)
+	: body(nullptr), end(0), grain(1), next(0), generation(0), pending(0), stop(false)
+{
+	workers.reserve(threads);
+	for (unsigned int i = 0; i < threads; ++i)
+	{
+		workers.emplace_back(&ThreadPool::work, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	wake.notify_all();
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::parallelFor(unsigned int begin, unsigned int end, unsigned int grain, const RangeFunction& body)
+{
+	if (begin >= end)
+		return;
+	if (grain == 0)
+		grain = 1;
+
+	// Not worth waking anyone for a single tile
+	if (workers.empty() || end - begin <= grain)
+	{
+		body(begin, end);
+		return;
+	}
+
+	std::lock_guard<std::mutex> submit(submitMutex);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->body = &body;
+		this->end = end;
+		this->grain = grain;
+		this->next.store(begin);
+		this->error = nullptr;
+		this->pending = (unsigned int)workers.size();
+		++generation;
+	}
+	wake.notify_all();
+
+	runTiles();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this] { return pending == 0; });
+	this->body = nullptr;
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
+unsigned int ThreadPool::concurrency() const
+{
+	return (unsigned int)workers.size() + 1;
+}
+
+ThreadPool& ThreadPool::shared()
+{
+	static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+	return pool;
+}
+
+void ThreadPool::work()
+{
+	uint64_t seen = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this, seen] { return stop || generation != seen; });
+			if (stop)
+				return;
+			seen = generation;
+		}
+
+		runTiles();
+
+		bool last;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			last = --pending == 0;
+		}
+		if (last)
+			finished.notify_one();
+	}
+}
+
+void ThreadPool::runTiles()
+{
+	while (true)
+	{
+		unsigned int first = next.fetch_add(grain);
+		if (first >= end)
+			return;
+
+		try
+		{
+			(*body)(first, std::min(first + grain, end));
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!error)
+				error = std::current_exception();
+			// Skip the remaining tiles
+			next.store(end);
+		}
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#ifndef _THREADPOOL_H
+#define _THREADPOOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <exception>
+#include <cstdint>
+
+/// <summary>
+/// Fixed set of worker threads running one parallel loop at a time.
+/// The calling thread takes part in the loop, so a pool of N threads keeps N + 1 cores busy.
+/// </summary>
+class ThreadPool
+{
+public:
+	/// Loop body, called with a half open range [begin, end) of loop indices
+	typedef std::function<void(unsigned int, unsigned int)> RangeFunction;
+
+	/// <param name="threads">Number of worker threads, 0 runs every loop on the calling thread</param>
+	explicit ThreadPool(unsigned int threads);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/// <summary>
+	/// Split [begin, end) into tiles of at most grain indices and run body on every tile, returns once all tiles are done.
+	/// Tiles are handed out dynamically, so uneven tiles still balance. Not reentrant, body must not call parallelFor of the same pool.
+	/// The first exception thrown by body is rethrown on the calling thread.
+	/// </summary>
+	void parallelFor(unsigned int begin, unsigned int end, unsigned int grain, const RangeFunction& body);
+
+	/// Number of threads taking part in a loop, including the calling one
+	unsigned int concurrency() const;
+
+	/// Pool shared by the whole application, sized to the hardware concurrency
+	static ThreadPool& shared();
+
+private:
+	std::vector<std::thread> workers;
+
+	/// Serializes parallelFor calls
+	std::mutex submitMutex;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+
+	/// Current loop, valid while pending is non zero
+	const RangeFunction* body;
+	unsigned int end;
+	unsigned int grain;
+	std::atomic<unsigned int> next;
+	std::exception_ptr error;
+
+	/// Incremented for every loop so workers notice new work
+	uint64_t generation;
+	/// Workers that did not finish the current loop yet
+	unsigned int pending;
+	bool stop;
+
+	/// Worker thread main loop
+	void work();
+	/// Take tiles of the current loop until none are left
+	void runTiles();
+};
+
+#endif
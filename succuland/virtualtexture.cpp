@@ -0,0 +1,396 @@
+/*
+*	Virtual texture streamed into a page atlas
+*/
+
+#include "virtualtexture.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+VirtualTexture::VirtualTexture(const glm::vec2& origin, const glm::vec2& size, unsigned int pages, unsigned int slots, const PageSource& source)
+	: origin(origin), size(size), pages(pages), slots(slots), source(source), levels(0),
+	atlas(0), indirection(0), framebuffer(0), colorBuffer(0), depthBuffer(0), readBuffers{ 0, 0 }, pendingPixels{ 0, 0 },
+	feedbackWidth(0), feedbackHeight(0), viewport{ 0, 0, 0, 0 }, feedback(false), frame(0)
+{
+	// Feedback pixels and indirection entries store pages and slots in 8 bits
+	if (pages == 0 || pages > 256 || (pages & (pages - 1)) != 0)
+		throw std::runtime_error("Virtual texture needs a power of two up to 256 pages along a side");
+	if (slots == 0 || slots > 256)
+		throw std::runtime_error("Virtual texture atlas needs 1 to 256 slots along a side");
+
+	while ((pages >> levels) > 0)
+		++levels;
+
+	glGenTextures(1, &atlas);
+	glBindTexture(GL_TEXTURE_2D, atlas);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, slots * SLOT_SIZE, slots * SLOT_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+	glGenTextures(1, &indirection);
+	glBindTexture(GL_TEXTURE_2D, indirection);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	table.resize(levels);
+	for (unsigned int level = 0; level < levels; ++level)
+	{
+		unsigned int side = pages >> level;
+		table[level].resize(size_t(side) * side);
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, side, side, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	atlasSlots.assign(size_t(slots) * slots, { 0, 0, false });
+
+	// The root page is never evicted
+	uint32_t root = pageKey(levels - 1, 0, 0);
+	atlasSlots[0] = { root, std::numeric_limits<uint64_t>::max(), true };
+	resident[root] = 0;
+	load({ { root, 0 } });
+	updateIndirection();
+
+	glGenFramebuffers(1, &framebuffer);
+	glGenRenderbuffers(1, &colorBuffer);
+	glGenRenderbuffers(1, &depthBuffer);
+	glGenBuffers(2, readBuffers);
+
+	std::cout << "INFO: virtual texture of " << pages * PAGE_SIZE << " x " << pages * PAGE_SIZE << " texels in a "
+		<< slots * SLOT_SIZE << " x " << slots * SLOT_SIZE << " atlas" << std::endl;
+}
+
+VirtualTexture::~VirtualTexture()
+{
+	glDeleteTextures(1, &atlas);
+	glDeleteTextures(1, &indirection);
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteRenderbuffers(1, &colorBuffer);
+	glDeleteRenderbuffers(1, &depthBuffer);
+	glDeleteBuffers(2, readBuffers);
+}
+
+uint32_t VirtualTexture::pageKey(unsigned int level, unsigned int x, unsigned int y)
+{
+	return (level << 16) | (y << 8) | x;
+}
+
+/*
+*	Feedback
+*/
+
+void VirtualTexture::beginFeedback()
+{
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	unsigned int width = std::max(1u, (unsigned int)viewport[2] / FEEDBACK_SCALE);
+	unsigned int height = std::max(1u, (unsigned int)viewport[3] / FEEDBACK_SCALE);
+	if (width != feedbackWidth || height != feedbackHeight)
+		resizeFeedback(width, height);
+
+	// Cleared without touching the clear color of the main framebuffer, alpha 0 marks pixels without terrain
+	const GLfloat noPage[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	const GLfloat farDepth = 1.0f;
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, feedbackWidth, feedbackHeight);
+	glClearBufferfv(GL_COLOR, 0, noPage);
+	glClearBufferfv(GL_DEPTH, 0, &farDepth);
+	feedback = true;
+}
+
+void VirtualTexture::endFeedback()
+{
+	feedback = false;
+	unsigned int current = frame % 2;
+	unsigned int previous = 1 - current;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readBuffers[current]);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	pendingPixels[current] = size_t(feedbackWidth) * feedbackHeight;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+	if (pendingPixels[previous] > 0)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readBuffers[previous]);
+		const uint8_t* pixels = (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pendingPixels[previous] * 4, GL_MAP_READ_BIT);
+		if (pixels != nullptr)
+		{
+			request(pixels, pendingPixels[previous]);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		pendingPixels[previous] = 0;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	++frame;
+}
+
+bool VirtualTexture::inFeedback() const
+{
+	return feedback;
+}
+
+void VirtualTexture::resizeFeedback(unsigned int width, unsigned int height)
+{
+	feedbackWidth = width;
+	feedbackHeight = height;
+
+	glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+		throw std::runtime_error("Virtual texture feedback framebuffer is incomplete");
+
+	// Readbacks of the old size are dropped
+	for (unsigned int k = 0; k < 2; ++k)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readBuffers[k]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, size_t(width) * height * 4, nullptr, GL_STREAM_READ);
+		pendingPixels[k] = 0;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+/*
+*	Page cache
+*/
+
+void VirtualTexture::request(const uint8_t* pixels, size_t count)
+{
+	// Every requested page keeps its ancestors too, they are what's shown until it is loaded
+	std::vector<uint32_t> requested;
+	for (size_t p = 0; p < count; ++p)
+	{
+		const uint8_t* pixel = pixels + 4 * p;
+		unsigned int level = pixel[2];
+		if (pixel[3] == 0 || level >= levels || pixel[0] >= (pages >> level) || pixel[1] >= (pages >> level))
+			continue;
+		requested.push_back(pageKey(level, pixel[0], pixel[1]));
+	}
+	std::sort(requested.begin(), requested.end());
+	requested.erase(std::unique(requested.begin(), requested.end()), requested.end());
+
+	size_t leaves = requested.size();
+	for (size_t r = 0; r < leaves; ++r)
+	{
+		unsigned int level = requested[r] >> 16;
+		unsigned int x = requested[r] & 0xFF;
+		unsigned int y = (requested[r] >> 8) & 0xFF;
+		while (++level < levels)
+			requested.push_back(pageKey(level, x >>= 1, y >>= 1));
+	}
+	std::sort(requested.begin(), requested.end());
+	requested.erase(std::unique(requested.begin(), requested.end()), requested.end());
+
+	std::vector<uint32_t> missing;
+	for (uint32_t page : requested)
+	{
+		auto found = resident.find(page);
+		if (found == resident.end())
+			missing.push_back(page);
+		else if (atlasSlots[found->second].lastUsed != std::numeric_limits<uint64_t>::max())
+			atlasSlots[found->second].lastUsed = frame;
+	}
+
+	// Coarse pages first, they cover the most pixels and a finer page only refines them
+	std::sort(missing.begin(), missing.end(), [](uint32_t a, uint32_t b) { return (a >> 16) > (b >> 16); });
+
+	std::vector<std::pair<uint32_t, unsigned int>> batch;
+	for (uint32_t page : missing)
+	{
+		if (batch.size() == UPLOADS_PER_FRAME)
+			break;
+		int slot = evictSlot();
+		if (slot < 0)
+			break;
+		Slot& s = atlasSlots[slot];
+		if (s.used)
+			resident.erase(s.page);
+		s = { page, frame, true };
+		resident[page] = slot;
+		batch.push_back({ page, (unsigned int)slot });
+	}
+
+	if (!batch.empty())
+	{
+		load(batch);
+		updateIndirection();
+	}
+}
+
+int VirtualTexture::evictSlot() const
+{
+	int oldest = -1;
+	for (size_t s = 0; s < atlasSlots.size(); ++s)
+	{
+		const Slot& slot = atlasSlots[s];
+		if (!slot.used)
+			return int(s);
+		// Pages requested this frame stay, the atlas is full until some leave the view
+		if (slot.lastUsed < frame && (oldest < 0 || slot.lastUsed < atlasSlots[oldest].lastUsed))
+			oldest = int(s);
+	}
+	return oldest;
+}
+
+void VirtualTexture::load(const std::vector<std::pair<uint32_t, unsigned int>>& batch)
+{
+	const size_t slotBytes = size_t(SLOT_SIZE) * SLOT_SIZE * 4;
+	std::vector<uint8_t> texels(batch.size() * slotBytes);
+
+	ThreadPool::shared().parallelFor(0, (unsigned int)batch.size(), 1, [&](unsigned int first, unsigned int last)
+	{
+		for (unsigned int b = first; b < last; ++b)
+		{
+			uint32_t page = batch[b].first;
+			unsigned int level = page >> 16;
+			glm::vec2 pageSize = size / float(pages >> level);
+			glm::vec2 step = pageSize / float(PAGE_SIZE);
+			glm::vec2 corner = origin + glm::vec2(page & 0xFF, (page >> 8) & 0xFF) * pageSize;
+			source(corner + step * (0.5f - float(PAGE_BORDER)), step, SLOT_SIZE, texels.data() + b * slotBytes);
+		}
+	});
+
+	glBindTexture(GL_TEXTURE_2D, atlas);
+	for (size_t b = 0; b < batch.size(); ++b)
+	{
+		unsigned int slot = batch[b].second;
+		glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % slots) * SLOT_SIZE, (slot / slots) * SLOT_SIZE, SLOT_SIZE, SLOT_SIZE,
+			GL_RGBA, GL_UNSIGNED_BYTE, texels.data() + b * slotBytes);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void VirtualTexture::updateIndirection()
+{
+	// Coarse to fine, a page without its own slot uses the entry of its parent
+	glBindTexture(GL_TEXTURE_2D, indirection);
+	for (int level = int(levels) - 1; level >= 0; --level)
+	{
+		unsigned int side = pages >> level;
+		for (unsigned int y = 0; y < side; ++y)
+		{
+			for (unsigned int x = 0; x < side; ++x)
+			{
+				auto found = resident.find(pageKey(level, x, y));
+				glm::u8vec4& entry = table[level][size_t(y) * side + x];
+				if (found != resident.end())
+					entry = glm::u8vec4(found->second % slots, found->second / slots, level, 255);
+				else
+					entry = table[level + 1][size_t(y / 2) * (side / 2) + x / 2];
+			}
+		}
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, side, side, GL_RGBA, GL_UNSIGNED_BYTE, table[level].data());
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+GLuint VirtualTexture::indirectionTexture() const
+{
+	return indirection;
+}
+
+GLuint VirtualTexture::atlasTexture() const
+{
+	return atlas;
+}
+
+unsigned int VirtualTexture::levelCount() const
+{
+	return levels;
+}
+
+size_t VirtualTexture::residentPages() const
+{
+	return resident.size();
+}
+
+/*
+*	Material pages
+*/
+
+MaterialPages::MaterialPages(GLuint texture, float texSpacing, const Perlin& perlin)
+	: texSpacing(texSpacing), perlin(perlin)
+{
+	glBindTexture(GL_TEXTURE_2D, texture);
+	for (GLint level = 0; ; ++level)
+	{
+		GLint width = 0, height = 0;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+		if (width == 0 || height == 0)
+			break;
+		levels.push_back({ (unsigned int)width, (unsigned int)height, std::vector<uint8_t>(size_t(width) * height * 4) });
+		glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_UNSIGNED_BYTE, levels.back().texels.data());
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (levels.empty())
+		throw std::runtime_error("Material texture for virtual texture pages is empty");
+}
+
+glm::vec3 MaterialPages::sample(const Level& level, const glm::vec2& uv) const
+{
+	glm::vec2 texel = uv * glm::vec2(level.width, level.height) - 0.5f;
+	glm::vec2 cell = glm::floor(texel);
+	glm::vec2 f = texel - cell;
+
+	auto fetch = [&](int s, int t)
+	{
+		// Mirrored repeat along s, period of two widths
+		int w = int(level.width);
+		int h = int(level.height);
+		s = ((s % (2 * w)) + 2 * w) % (2 * w);
+		if (s >= w)
+			s = 2 * w - 1 - s;
+		t = ((t % h) + h) % h;
+		const uint8_t* p = level.texels.data() + 4 * (size_t(t) * w + s);
+		return glm::vec3(p[0], p[1], p[2]);
+	};
+	int s = int(cell.x);
+	int t = int(cell.y);
+	return glm::mix(glm::mix(fetch(s, t), fetch(s + 1, t), f.x), glm::mix(fetch(s, t + 1), fetch(s + 1, t + 1), f.x), f.y);
+}
+
+void MaterialPages::operator()(const glm::vec2& first, const glm::vec2& step, unsigned int size, uint8_t* texels) const
+{
+	// Mip level whose texels match the page texel footprint
+	float footprint = glm::max(step.x, step.y) * texSpacing * float(levels[0].width);
+	unsigned int mip = std::min((unsigned int)std::max(std::log2(footprint) + 0.5f, 0.0f), (unsigned int)levels.size() - 1);
+	const Level& level = levels[mip];
+
+	std::vector<float> xs(size), zs(size), tint(size);
+	for (unsigned int r = 0; r < size; ++r)
+	{
+		for (unsigned int c = 0; c < size; ++c)
+		{
+			xs[c] = first.x + step.x * c;
+			zs[c] = first.y + step.y * r;
+		}
+		perlin.GetBatch(xs.data(), zs.data(), tint.data(), size);
+		for (unsigned int c = 0; c < size; ++c)
+		{
+			float brightness = 1.0f + 0.25f * glm::clamp(tint[c], -1.0f, 1.0f);
+			glm::vec3 color = glm::clamp(sample(level, glm::vec2(xs[c], zs[c]) * texSpacing) * brightness, 0.0f, 255.0f);
+			uint8_t* out = texels + 4 * (size_t(r) * size + c);
+			out[0] = uint8_t(color.r + 0.5f);
+			out[1] = uint8_t(color.g + 0.5f);
+			out[2] = uint8_t(color.b + 0.5f);
+			out[3] = 255;
+		}
+	}
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#ifndef _VIRTUALTEXTURE_H
+#define _VIRTUALTEXTURE_H
+
+#include "pgr.h"
+#include "perlin.h"
+#include <glm/gtc/type_precision.hpp>
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+/// <summary>
+/// Fills one page of a virtual texture. Texel (c, r) of the size x size RGBA8 block is centered at the world position
+/// first + step * (c, r). Called from the shared thread pool for several pages at once
+/// </summary>
+typedef std::function<void(const glm::vec2& first, const glm::vec2& step, unsigned int size, uint8_t* texels)> PageSource;
+
+/// <summary>
+/// Terrain texture far larger than video memory, stretched over the world rectangle from origin to origin + size.
+/// It is split into square pages on a mip chain, where level L has pages >> L pages along a side. A feedback pass
+/// draws the terrain at a low resolution, and phong.frag writes the page and level each pixel needs. Missing pages
+/// are generated by the page source and copied into a fixed atlas of slots. An indirection texture maps every page
+/// to the finest resident page covering it, so video memory doesn't depend on the virtual size
+/// </summary>
+class VirtualTexture
+{
+public:
+	/// Texels along one side of a page
+	static const unsigned int PAGE_SIZE = 128;
+	/// Texels of the neighbouring pages kept around a page in its slot so bilinear filtering doesn't bleed between slots
+	static const unsigned int PAGE_BORDER = 4;
+	/// Texels along one side of an atlas slot
+	static const unsigned int SLOT_SIZE = PAGE_SIZE + 2 * PAGE_BORDER;
+	/// The feedback target is this many times smaller than the viewport along each side
+	static const unsigned int FEEDBACK_SCALE = 8;
+	/// Pages generated per frame at most, the rest wait for later frames and coarser pages are shown meanwhile
+	static const unsigned int UPLOADS_PER_FRAME = 8;
+
+	const glm::vec2 origin;
+	const glm::vec2 size;
+	/// Pages along one side of the finest level
+	const unsigned int pages;
+	/// Atlas slots along one side
+	const unsigned int slots;
+
+	/// <summary>
+	/// Create the atlas and indirection textures, the single page of the coarsest level is generated right away
+	/// and stays resident so every lookup finds a page
+	/// </summary>
+	/// <param name="pages">Pages along one side of the finest level, a power of two up to 256</param>
+	/// <param name="slots">Atlas slots along one side, at most slots x slots pages are resident</param>
+	/// <param name="source">Generates the texels of the pages</param>
+	VirtualTexture(const glm::vec2& origin, const glm::vec2& size, unsigned int pages, unsigned int slots, const PageSource& source);
+	~VirtualTexture();
+
+	VirtualTexture(const VirtualTexture&) = delete;
+	VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+	/// Bind and clear the feedback target, terrain drawn until endFeedback writes page requests instead of colors
+	void beginFeedback();
+	/// <summary>
+	/// Restore the framebuffer and stream in the pages requested by the previous frame's feedback. The readback of
+	/// this frame's feedback is only mapped next frame so it doesn't stall on the draw
+	/// </summary>
+	void endFeedback();
+	/// Whether the terrain is being drawn into the feedback target
+	bool inFeedback() const;
+
+	/// RGBA8 mip chain with one texel per page, slot column and row, resident level and 255 in alpha
+	GLuint indirectionTexture() const;
+	/// RGBA8 texture of slots x slots pages with their borders
+	GLuint atlasTexture() const;
+	/// Levels of the mip chain, the coarsest holds one page
+	unsigned int levelCount() const;
+	/// Pages currently in the atlas
+	size_t residentPages() const;
+
+protected:
+	/// Atlas slot and the page it holds
+	struct Slot
+	{
+		uint32_t page;
+		/// Frame the page was last requested in
+		uint64_t lastUsed;
+		bool used;
+	};
+
+	PageSource source;
+	unsigned int levels;
+
+	GLuint atlas;
+	GLuint indirection;
+	std::vector<Slot> atlasSlots;
+	/// Slot of every resident page, keyed by pageKey
+	std::unordered_map<uint32_t, unsigned int> resident;
+	/// Indirection entries of every level, rebuilt when pages come and go
+	std::vector<std::vector<glm::u8vec4>> table;
+
+	GLuint framebuffer;
+	GLuint colorBuffer;
+	GLuint depthBuffer;
+	/// Feedback readbacks alternate between two pixel buffers
+	GLuint readBuffers[2];
+	/// Pixels read into each pixel buffer and not yet processed, 0 for none
+	size_t pendingPixels[2];
+	unsigned int feedbackWidth;
+	unsigned int feedbackHeight;
+	GLint viewport[4];
+	bool feedback;
+	uint64_t frame;
+
+	/// Page (x, y) of a level packed into one key
+	static uint32_t pageKey(unsigned int level, unsigned int x, unsigned int y);
+	/// Size the feedback target and the pixel buffers for the viewport
+	void resizeFeedback(unsigned int width, unsigned int height);
+	/// Turn the feedback pixels into page requests, make them resident and update the indirection
+	void request(const uint8_t* pixels, size_t count);
+	/// Slot for a new page, a free one or the least recently used one not needed this frame, -1 if none
+	int evictSlot() const;
+	/// Generate the pages into the slots and copy them into the atlas
+	void load(const std::vector<std::pair<uint32_t, unsigned int>>& batch);
+	/// Point every indirection entry at its finest resident page and upload the levels
+	void updateIndirection();
+};
+
+/// <summary>
+/// Page source tiling a material texture over the terrain at the same scale as TerrainGrid::TEX_SPACING. The
+/// brightness is varied by low frequency noise so the tiling doesn't repeat visibly, coarse pages read coarser mip levels
+/// </summary>
+class MaterialPages
+{
+public:
+	/// <summary>
+	/// Read all mip levels of the texture back from the GPU
+	/// </summary>
+	/// <param name="texSpacing">Texture coordinate step of one world unit</param>
+	/// <param name="perlin">Noise varying the brightness, values in about -1 to 1</param>
+	MaterialPages(GLuint texture, float texSpacing, const Perlin& perlin);
+
+	void operator()(const glm::vec2& first, const glm::vec2& step, unsigned int size, uint8_t* texels) const;
+
+protected:
+	/// One mip level of the texture
+	struct Level
+	{
+		unsigned int width;
+		unsigned int height;
+		std::vector<uint8_t> texels;
+	};
+
+	std::vector<Level> levels;
+	float texSpacing;
+	Perlin perlin;
+
+	/// Bilinear sample, mirrored along s and repeated along t like the material texture
+	glm::vec3 sample(const Level& level, const glm::vec2& uv) const;
+};
+
+#endif